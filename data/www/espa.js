@@ -80,9 +80,81 @@ function reboot(message) {
 
 let fetchStatusFailed = false;
 
+// Persistent API connection so status polling does not open a new TCP connection each time.
+// Replies arrive in request order, so pending requests are resolved first-in first-out.
+// Replies starting with "Error" are the server refusing the request and reject it instead.
+let apiSocket = null;
+const apiPending = [];
+
+// A request with no reply by then is given up on. Later replies could no longer be
+// matched to their requests, so the socket is dropped and the next poll reconnects.
+const API_REQUEST_TIMEOUT_MS = 5000;
+// After the server refuses or drops a connection, HTTP is used until the next attempt.
+const API_RETRY_MIN_MS = 10000;
+const API_RETRY_MAX_MS = 300000;
+let apiRetryDelay = API_RETRY_MIN_MS;
+let apiRetryAt = 0;
+
+function openApiSocket() {
+    const protocol = location.protocol === 'https:' ? 'wss://' : 'ws://';
+    const socket = new WebSocket(protocol + location.host + '/api/ws');
+    let opened = false;
+    let refused = false;
+    apiSocket = socket;
+    socket.onmessage = (event) => {
+        const pending = apiPending.shift();
+        if (typeof event.data === 'string' && event.data.startsWith('Error')) {
+            refused = true;
+            if (pending) pending.reject(new Error(event.data));
+            return;
+        }
+        apiRetryDelay = API_RETRY_MIN_MS;
+        if (pending) pending.resolve(event.data);
+    };
+    socket.onclose = () => {
+        // A socket dropped by resetApiSocket() has already failed its requests.
+        if (apiSocket !== socket) return;
+        apiSocket = null;
+        if (refused || !opened) {
+            apiRetryAt = Date.now() + apiRetryDelay;
+            apiRetryDelay = Math.min(apiRetryDelay * 2, API_RETRY_MAX_MS);
+        }
+        while (apiPending.length) apiPending.shift().reject(new Error('API socket closed'));
+    };
+    socket.onopen = () => { opened = true; };
+}
+
+function resetApiSocket() {
+    const socket = apiSocket;
+    apiSocket = null;
+    while (apiPending.length) apiPending.shift().reject(new Error('API socket reset'));
+    if (socket) {
+        socket.onmessage = null;
+        socket.close();
+    }
+}
+
+function apiRequest(command, fallbackUrl) {
+    if (!apiSocket && Date.now() >= apiRetryAt) openApiSocket();
+    if (!apiSocket || apiSocket.readyState !== WebSocket.OPEN) {
+        return fetch(fallbackUrl).then(response => response.text());
+    }
+    return new Promise((resolve, reject) => {
+        const entry = {};
+        const timer = setTimeout(() => {
+            reject(new Error('API request timed out'));
+            resetApiSocket();
+        }, API_REQUEST_TIMEOUT_MS);
+        entry.resolve = (value) => { clearTimeout(timer); resolve(value); };
+        entry.reject = (error) => { clearTimeout(timer); reject(error); };
+        apiPending.push(entry);
+        apiSocket.send(command);
+    });
+}
+
 function fetchStatus() {
-    fetch('/json')
-        .then(response => response.json())
+    apiRequest('json', '/json')
+        .then(text => JSON.parse(text))
         .then(value_json => {
             if (fetchStatusFailed) {
                 clearAlert();
@@ -197,6 +269,7 @@ function loadConfig() {
             document.getElementById('mqttUsername').value = data.mqttUsername;
             document.getElementById('mqttPassword').value = data.mqttPassword;
             document.getElementById('spaPollFrequency').value = data.spaPollFrequency;
+            document.getElementById('timeZone').value = data.timeZone;
 
             // Enable form fields and save button
             $('#config_form input').prop('disabled', false);
@@ -303,6 +376,7 @@ $(document).ready(function () {
         if (appFile) {
             const appData = new FormData();
             appData.append('updateType', 'application');
+            if ($('#appSha256').val()) appData.append('sha256', $('#appSha256').val().trim());
             appData.append('update', appFile);
             fileNum++;
             $('#msg').html(`<p style="color:blue;">Uploading file ${fileNum} of ${totalFiles} - Application update.</p>`);
@@ -313,6 +387,7 @@ $(document).ready(function () {
         if (fsFile) {
             const fsData = new FormData();
             fsData.append('updateType', 'filesystem');
+            if ($('#fsSha256').val()) fsData.append('sha256', $('#fsSha256').val().trim());
             fsData.append('update', fsFile);
             fileNum++;
             $('#msg').html(`<p style="color:blue;">Uploading file ${fileNum} of ${totalFiles} - File system update.</p>`);
@@ -356,8 +431,8 @@ $(document).ready(function () {
                 showAlert('The firmware has been uploaded.', 'alert-success', 'Firmware uploaded');
                 resolve(true);
             },
-            error: function () {
-                showAlert('The firmware update failed. Please try again.', 'alert-danger', 'Error');
+            error: function (xhr) {
+                showAlert('The firmware update failed. ' + (xhr.responseText || 'Please try again.'), 'alert-danger', 'Error');
                 resolve(false);
             }
             });
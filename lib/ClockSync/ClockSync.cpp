@@ -0,0 +1,98 @@
+#include "ClockSync.h"
+
+void ClockSync::recordSample(time_t spaTime, time_t referenceTime) {
+    const int32_t offset = (int32_t)(spaTime - referenceTime);
+
+    if (_hasOffset) {
+        const float deviation = offset - expectedOffset(referenceTime);
+        if (deviation > STEP_THRESHOLD_S || deviation < -STEP_THRESHOLD_S) reset();
+    }
+
+    _hasOffset = true;
+    _offset = offset;
+    _offsetAt = referenceTime;
+
+    if (_count > 0 && referenceTime - _lastWindowSample < (time_t)SAMPLE_INTERVAL_S) return;
+    if (_count == 0) _origin = referenceTime;
+    _lastWindowSample = referenceTime;
+
+    _window[_next] = {(uint32_t)(referenceTime - _origin), offset};
+    _next = (_next + 1) % WINDOW;
+    if (_count < WINDOW) _count++;
+    fit();
+}
+
+float ClockSync::expectedOffset(time_t referenceTime) const {
+    if (!driftKnown()) return _offset;
+    return _fitMeanOffset + _driftPpm / 1e6f * ((float)(referenceTime - _origin) - _fitMeanAt);
+}
+
+void ClockSync::fit() {
+    if (!driftKnown()) return;
+
+    float meanAt = 0;
+    float meanOffset = 0;
+    for (size_t i = 0; i < _count; i++) {
+        meanAt += _window[i].at;
+        meanOffset += _window[i].offset;
+    }
+    meanAt /= _count;
+    meanOffset /= _count;
+
+    float covariance = 0;
+    float variance = 0;
+    for (size_t i = 0; i < _count; i++) {
+        const float dx = _window[i].at - meanAt;
+        covariance += dx * (_window[i].offset - meanOffset);
+        variance += dx * dx;
+    }
+
+    _fitMeanAt = meanAt;
+    _fitMeanOffset = meanOffset;
+    _driftPpm = variance > 0 ? covariance / variance * 1e6f : 0;
+}
+
+uint32_t ClockSync::secondsUntilCorrection() const {
+    if (!driftKnown() || _driftPpm == 0) return 0;
+
+    const float rate = _driftPpm / 1e6f;
+    const float limit = rate > 0 ? CORRECTION_THRESHOLD_S : -CORRECTION_THRESHOLD_S;
+    const float remaining = (limit - expectedOffset(_offsetAt)) / rate;
+    return remaining > 0 ? (uint32_t)remaining : 0;
+}
+
+int32_t ClockSync::correctionS() const {
+    if (!_hasOffset || abs(_offset) < CORRECTION_THRESHOLD_S) return 0;
+    // Nearest whole minute, so the seconds the controller keeps end up within 30 s.
+    const int32_t minutes = (_offset + (_offset > 0 ? 30 : -30)) / 60;
+    return -minutes * 60;
+}
+
+void ClockSync::recordCorrection() {
+    _corrections++;
+    reset();
+}
+
+void ClockSync::reset() {
+    _next = 0;
+    _count = 0;
+    _hasOffset = false;
+    _offset = 0;
+    _driftPpm = 0;
+}
+
+uint8_t ClockSync::differingFields(time_t current, time_t target) {
+    tmElements_t a;
+    tmElements_t b;
+    breakTime(current, a);
+    breakTime(target, b);
+
+    uint8_t fields = 0;
+    if (a.Year != b.Year) fields |= YEAR;
+    if (a.Month != b.Month) fields |= MONTH;
+    if (a.Day != b.Day) fields |= DAY;
+    if (a.Hour != b.Hour) fields |= HOUR;
+    if (a.Minute != b.Minute) fields |= MINUTE;
+    if (a.Wday != b.Wday) fields |= WEEKDAY;
+    return fields;
+}
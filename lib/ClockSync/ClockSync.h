@@ -0,0 +1,101 @@
+#ifndef CLOCKSYNC_H
+#define CLOCKSYNC_H
+
+/**
+ * @file ClockSync.h
+ * @brief Spa clock offset and drift against a reference (NTP) clock.
+ *
+ * Every RF frame carries the spa's clock. recordSample() compares it with the
+ * reference clock, both as local time. The latest difference is the offset.
+ * Every SAMPLE_INTERVAL_S one sample also enters a window, and once the window
+ * holds MIN_SAMPLES, a least squares fit over it gives the drift rate.
+ *
+ * A sample more than STEP_THRESHOLD_S away from where the fit (or the previous
+ * sample) puts it means the clock was set, or the time zone changed, so the
+ * window starts again.
+ *
+ * The controller's seconds cannot be written, so corrections move the clock
+ * by whole minutes. One is due when the offset reaches CORRECTION_THRESHOLD_S,
+ * and it leaves at most 30 s behind.
+ *
+ * Recording and lookups happen on the loop task only.
+ */
+
+#include <Arduino.h>
+#include <TimeLib.h>
+
+class ClockSync {
+public:
+    /// @brief Two days of hourly samples: the spa clock reads in whole seconds, so a
+    /// ppm-level rate needs a long baseline.
+    static constexpr size_t WINDOW = 48;
+    static constexpr uint32_t SAMPLE_INTERVAL_S = 3600;
+    /// @brief Samples needed before a drift rate is reported (12 hours).
+    static constexpr size_t MIN_SAMPLES = 12;
+    static constexpr int32_t STEP_THRESHOLD_S = 5;
+    static constexpr int32_t CORRECTION_THRESHOLD_S = 45;
+
+    /// @brief Spa clock fields, as a mask for differingFields().
+    enum Field : uint8_t {
+        YEAR = 1 << 0,
+        MONTH = 1 << 1,
+        DAY = 1 << 2,
+        HOUR = 1 << 3,
+        MINUTE = 1 << 4,
+        WEEKDAY = 1 << 5,
+        ALL_FIELDS = 0x3f
+    };
+
+    /// @brief Compare the spa clock with the reference clock, both local time in seconds.
+    void recordSample(time_t spaTime, time_t referenceTime);
+
+    /// @brief A sample has been recorded since the last reset.
+    bool hasOffset() const { return _hasOffset; }
+    /// @brief Spa clock minus reference clock at the last sample, in seconds.
+    int32_t offsetS() const { return _offset; }
+
+    bool driftKnown() const { return _count >= MIN_SAMPLES; }
+    /// @brief Rate the spa clock gains (positive) or loses on the reference, in ppm; 0 until driftKnown().
+    float driftPpm() const { return _driftPpm; }
+    /// @brief Time until the offset reaches CORRECTION_THRESHOLD_S at the current drift, 0 if never (or already).
+    uint32_t secondsUntilCorrection() const;
+
+    /// @brief Seconds to add to the spa clock (a whole number of minutes), 0 if no correction is due.
+    int32_t correctionS() const;
+    /// @brief A correction of correctionS() was written; the offset steps, so estimation starts again.
+    void recordCorrection();
+    uint32_t corrections() const { return _corrections; }
+
+    /// @brief Forget all samples (e.g. the reference clock went away).
+    void reset();
+
+    /// @brief Fields of the spa clock that differ between two times.
+    static uint8_t differingFields(time_t current, time_t target);
+
+private:
+    struct Sample {
+        uint32_t at;        ///< Reference time, seconds after _origin
+        int32_t offset;
+    };
+
+    Sample _window[WINDOW] = {};
+    uint8_t _next = 0;
+    uint8_t _count = 0;
+    time_t _origin = 0;
+    time_t _lastWindowSample = 0;
+
+    bool _hasOffset = false;
+    int32_t _offset = 0;
+    time_t _offsetAt = 0;
+    float _driftPpm = 0;
+    float _fitMeanAt = 0;       ///< The fitted line passes through (_fitMeanAt, _fitMeanOffset)
+    float _fitMeanOffset = 0;
+
+    uint32_t _corrections = 0;
+
+    /// @brief Where the estimate puts the offset at a reference time.
+    float expectedOffset(time_t referenceTime) const;
+    void fit();
+};
+
+#endif // CLOCKSYNC_H
@@ -72,6 +72,8 @@ public:
     Setting<int> SpaPollFrequency = Setting<int>("SpaPollFrequency", 60, 10, 300);
     Setting<bool> SoftAPAlwaysOn = Setting<bool>("SoftAPAlwaysOn", true);
     Setting<String> SoftAPPassword = Setting<String>("SoftAPPassword", "eSPA-Password");
+    /// @brief POSIX TZ string of the spa's local time, e.g. "AEST-10AEDT,M10.1.0,M4.1.0/3"; empty disables spa clock correction.
+    Setting<String> TimeZone = Setting<String>("TimeZone", "");
 };
 
 class Config : public ControllerConfig {
@@ -0,0 +1,188 @@
+#include "CrashLog.h"
+
+RTC_NOINIT_ATTR CrashLog::Store CrashLog::_store;
+
+void CrashLog::begin() {
+    _resetReason = esp_reset_reason();
+
+    // RTC memory holds noise after power is applied; anything else keeps it.
+    const bool coldStart = _resetReason == ESP_RST_POWERON || _resetReason == ESP_RST_BROWNOUT;
+    if (coldStart || _store.magic != STORE_MAGIC || _store.active > 1) {
+        _store.magic = STORE_MAGIC;
+        _store.bootCount = 0;
+        _store.active = 0;
+        _store.banks[0].magic = 0;
+        _store.banks[1].magic = 0;
+    } else {
+        _store.active ^= 1;
+    }
+
+    _store.bootCount++;
+    _previous = bankIsValid(_store.banks[_store.active ^ 1]) ? &_store.banks[_store.active ^ 1] : nullptr;
+    _bank = &_store.banks[_store.active];
+    resetBank(*_bank, _store.bootCount);
+}
+
+bool CrashLog::hasPreviousRun() const {
+    return _previous != nullptr;
+}
+
+void CrashLog::append(uint8_t level, const uint8_t *data, size_t len) {
+    if (_bank == nullptr) return;
+
+    while (len > 0) {
+        if (!_bank->lineOpen) startLine(level);
+
+        const uint8_t *newline = (const uint8_t *)memchr(data, '\n', len);
+        const size_t chunk = newline == nullptr ? len : (size_t)(newline - data) + 1;
+        put((const char *)data, chunk);
+        if (newline != nullptr) _bank->lineOpen = 0;
+        data += chunk;
+        len -= chunk;
+    }
+}
+
+void CrashLog::recordLoop(uint32_t durationUs) {
+    if (_bank == nullptr) return;
+
+    const uint32_t now = millis();
+    _bank->uptimeMs = now;
+    _bank->loopCount++;
+    _bank->loopTotalUs += durationUs;
+    if (durationUs > _bank->loopMaxUs) _bank->loopMaxUs = durationUs;
+
+    if (now - _lastHeapSample >= HEAP_SAMPLE_INTERVAL_MS) {
+        _lastHeapSample = now;
+        _bank->minFreeHeap = ESP.getMinFreeHeap();
+    }
+}
+
+String CrashLog::report() const {
+    String out;
+    out.reserve(LOG_CAPACITY * 2 + 512);
+
+    out += "Boot count: " + String(_store.bootCount) + "\n";
+    out += "Reset reason: " + String(resetReasonName(_resetReason)) + "\n\n";
+
+    out += "== Previous run ==\n";
+    if (_previous == nullptr) {
+        out += "No data (first boot after power-on)\n";
+    } else {
+        appendSummary(out, *_previous);
+        appendLog(out, *_previous);
+    }
+
+    if (_bank != nullptr) {
+        out += "\n== Current run ==\n";
+        appendSummary(out, *_bank);
+        appendLog(out, *_bank);
+    }
+    return out;
+}
+
+const char *CrashLog::resetReasonName(esp_reset_reason_t reason) {
+    switch (reason) {
+        case ESP_RST_POWERON:   return "power-on";
+        case ESP_RST_EXT:       return "external pin";
+        case ESP_RST_SW:        return "software restart";
+        case ESP_RST_PANIC:     return "exception/panic";
+        case ESP_RST_INT_WDT:   return "interrupt watchdog";
+        case ESP_RST_TASK_WDT:  return "task watchdog";
+        case ESP_RST_WDT:       return "other watchdog";
+        case ESP_RST_DEEPSLEEP: return "deep sleep wake";
+        case ESP_RST_BROWNOUT:  return "brownout";
+        case ESP_RST_SDIO:      return "SDIO";
+        default:                return "unknown";
+    }
+}
+
+void CrashLog::put(const char *data, size_t len) {
+    // Only the most recent LOG_CAPACITY bytes can survive, skip the rest.
+    if (len > LOG_CAPACITY) {
+        data += len - LOG_CAPACITY;
+        len = LOG_CAPACITY;
+    }
+
+    const size_t first = min(len, (size_t)(LOG_CAPACITY - _bank->head));
+    memcpy(_bank->log + _bank->head, data, first);
+    memcpy(_bank->log, data + first, len - first);
+
+    _bank->head = (_bank->head + len) % LOG_CAPACITY;
+    _bank->used = min((size_t)(_bank->used + len), LOG_CAPACITY);
+}
+
+void CrashLog::startLine(uint8_t level) {
+    // "[<seconds>.<millis>] <level> ", built by hand to keep snprintf off this path.
+    static const char levels[] = "PVDIWEA";
+    char prefix[20];
+    char *p = prefix + sizeof(prefix);
+    const uint32_t now = millis();
+
+    *--p = ' ';
+    *--p = level < sizeof(levels) - 1 ? levels[level] : '?';
+    *--p = ' ';
+    *--p = ']';
+    uint32_t ms = now % 1000;
+    for (int i = 0; i < 3; i++, ms /= 10) *--p = '0' + ms % 10;
+    *--p = '.';
+    uint32_t seconds = now / 1000;
+    do { *--p = '0' + seconds % 10; seconds /= 10; } while (seconds > 0);
+    *--p = '[';
+
+    put(p, prefix + sizeof(prefix) - p);
+    _bank->lineOpen = 1;
+}
+
+void CrashLog::resetBank(Bank &bank, uint32_t sequence) {
+    memset(&bank, 0, sizeof(bank));
+    bank.magic = BANK_MAGIC;
+    bank.sequence = sequence;
+    bank.minFreeHeap = UINT32_MAX;
+}
+
+bool CrashLog::bankIsValid(const Bank &bank) {
+    return bank.magic == BANK_MAGIC && bank.head < LOG_CAPACITY && bank.used <= LOG_CAPACITY;
+}
+
+void CrashLog::appendSummary(String &out, const Bank &bank) {
+    out += "Boot: " + String(bank.sequence) + "\n";
+    out += "Uptime: " + String(bank.uptimeMs / 1000) + " s\n";
+    out += "Loop iterations: " + String(bank.loopCount) + "\n";
+    if (bank.loopCount > 0) {
+        out += "Loop avg/max: " + String((uint32_t)(bank.loopTotalUs / bank.loopCount)) + " / " + String(bank.loopMaxUs) + " us\n";
+    }
+    if (bank.minFreeHeap != UINT32_MAX) {
+        out += "Min free heap: " + String(bank.minFreeHeap) + " bytes\n";
+    }
+}
+
+void CrashLog::appendLog(String &out, const Bank &bank) {
+    out += "-- WARNING+ log --\n";
+    if (bank.used == 0) {
+        out += "(empty)\n";
+        return;
+    }
+
+    size_t start = bank.used < LOG_CAPACITY ? 0 : bank.head;
+    size_t remaining = bank.used;
+
+    // Once the ring has wrapped the oldest line is partial; drop it.
+    if (bank.used == LOG_CAPACITY) {
+        while (remaining > 0 && bank.log[start] != '\n') {
+            start = (start + 1) % LOG_CAPACITY;
+            remaining--;
+        }
+        if (remaining > 0) {
+            start = (start + 1) % LOG_CAPACITY;
+            remaining--;
+        }
+    }
+
+    for (; remaining > 0; remaining--, start = (start + 1) % LOG_CAPACITY) {
+        const char c = bank.log[start];
+        if (c == '\r') continue;
+        // RTC memory is not checksummed, so never pass stray bytes to the client.
+        out += (c == '\n' || (c >= 0x20 && c < 0x7f)) ? c : '?';
+    }
+    if (!out.endsWith("\n")) out += "\n";
+}
@@ -0,0 +1,87 @@
+#ifndef CRASHLOG_H
+#define CRASHLOG_H
+
+/**
+ * @file CrashLog.h
+ * @brief WARNING+ log lines and loop statistics that survive a warm reset.
+ *
+ * Everything lives in RTC memory marked RTC_NOINIT_ATTR, which the bootloader
+ * leaves alone on software, watchdog and panic resets. There are two banks:
+ * the current run writes one while the other keeps whatever the previous run
+ * had written when it went down. A power-on reset clears both.
+ *
+ * Appending a line is a bounded memcpy into the ring; formatting of the
+ * report only happens when it is requested.
+ */
+
+#include <Arduino.h>
+#include <esp_attr.h>
+#include <esp_system.h>
+
+class CrashLog {
+public:
+    /// @brief Bytes of log text kept per run.
+    static constexpr size_t LOG_CAPACITY = 2048;
+
+    /// @brief Select the banks for this run. Call once, as early as possible in setup().
+    void begin();
+
+    /// @brief True if the previous run left a valid bank behind.
+    bool hasPreviousRun() const;
+
+    /// @brief Append log output. A line is opened on the first byte and closed by '\n'.
+    /// @param level RemoteDebug level of the line, recorded in its prefix.
+    void append(uint8_t level, const uint8_t *data, size_t len);
+
+    /// @brief Record one main loop iteration; also refreshes uptime and the heap low-water mark.
+    void recordLoop(uint32_t durationUs);
+
+    /// @brief Plain text report of the previous run followed by the current one.
+    String report() const;
+
+    /// @brief Name of the reason the previous run ended, as reported for this boot.
+    static const char *resetReasonName(esp_reset_reason_t reason);
+
+private:
+    struct Bank {
+        uint32_t magic;
+        uint32_t sequence;          // boot count when the bank was started
+        uint32_t head;              // next write position in log
+        uint32_t used;              // bytes of log holding data, up to LOG_CAPACITY
+        uint32_t uptimeMs;          // last uptime seen by recordLoop()
+        uint32_t loopCount;
+        uint32_t loopMaxUs;
+        uint64_t loopTotalUs;
+        uint32_t minFreeHeap;
+        uint32_t lineOpen;          // a line has been started but not terminated
+        char log[LOG_CAPACITY];
+    };
+
+    struct Store {
+        uint32_t magic;
+        uint32_t bootCount;
+        uint32_t active;            // index of the bank the current run writes
+        Bank banks[2];
+    };
+
+    static constexpr uint32_t STORE_MAGIC = 0x48535243;    // "CRSH"
+    static constexpr uint32_t BANK_MAGIC = 0x4B4E4142;     // "BANK"
+    static constexpr uint32_t HEAP_SAMPLE_INTERVAL_MS = 1000;
+
+    static Store _store;
+
+    Bank *_bank = nullptr;
+    const Bank *_previous = nullptr;
+    esp_reset_reason_t _resetReason = ESP_RST_UNKNOWN;
+    uint32_t _lastHeapSample = 0;
+
+    void put(const char *data, size_t len);
+    void startLine(uint8_t level);
+
+    static void resetBank(Bank &bank, uint32_t sequence);
+    static bool bankIsValid(const Bank &bank);
+    static void appendSummary(String &out, const Bank &bank);
+    static void appendLog(String &out, const Bank &bank);
+};
+
+#endif // CRASHLOG_H
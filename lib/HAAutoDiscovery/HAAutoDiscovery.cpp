@@ -44,6 +44,7 @@ void generateCommonAdJSON(
 }
 
 void generateSensorAdJSON(String& output, const AutoDiscoveryInformationTemplate& config, const SpaADInformationTemplate& spa, String &discoveryTopic, String stateClass, String unitOfMeasure) {
+   SPA_HEAP_TAG(HAAutoDiscovery);
    JsonDocument json;
    generateCommonAdJSON(json, config, spa, discoveryTopic, "sensor");
 
@@ -54,6 +55,7 @@ void generateSensorAdJSON(String& output, const AutoDiscoveryInformationTemplate
 }
 
 void generateBinarySensorAdJSON(String& output, const AutoDiscoveryInformationTemplate& config, const SpaADInformationTemplate& spa, String &discoveryTopic) {
+   SPA_HEAP_TAG(HAAutoDiscovery);
    JsonDocument json;
    generateCommonAdJSON(json, config, spa, discoveryTopic, "binary_sensor");
 
@@ -61,6 +63,7 @@ void generateBinarySensorAdJSON(String& output, const AutoDiscoveryInformationTe
 }
 
 void generateTextAdJSON(String& output, const AutoDiscoveryInformationTemplate& config, const SpaADInformationTemplate& spa, String &discoveryTopic, String regex) {
+   SPA_HEAP_TAG(HAAutoDiscovery);
    JsonDocument json;
    generateCommonAdJSON(json, config, spa, discoveryTopic, "text");
 
@@ -71,6 +74,7 @@ void generateTextAdJSON(String& output, const AutoDiscoveryInformationTemplate&
 }
 
 void generateNumberAdJSON(String& output, const AutoDiscoveryInformationTemplate& config, const SpaADInformationTemplate& spa, String &discoveryTopic, String unitOfMeasure, int min, int max, int step) {
+   SPA_HEAP_TAG(HAAutoDiscovery);
    JsonDocument json;
    generateCommonAdJSON(json, config, spa, discoveryTopic, "number");
 
@@ -85,6 +89,7 @@ void generateNumberAdJSON(String& output, const AutoDiscoveryInformationTemplate
 }
 
 void generateSwitchAdJSON(String& output, const AutoDiscoveryInformationTemplate& config, const SpaADInformationTemplate& spa, String &discoveryTopic) {
+   SPA_HEAP_TAG(HAAutoDiscovery);
    JsonDocument json;
    generateCommonAdJSON(json, config, spa, discoveryTopic, "switch");
 
@@ -94,6 +99,7 @@ void generateSwitchAdJSON(String& output, const AutoDiscoveryInformationTemplate
 }
 
 void generateButtonAdJSON(String& output, const AutoDiscoveryInformationTemplate& config, const SpaADInformationTemplate& spa, String &discoveryTopic) {
+   SPA_HEAP_TAG(HAAutoDiscovery);
    JsonDocument json;
    generateCommonAdJSON(json, config, spa, discoveryTopic, "button");
    json.remove("state_topic");
@@ -104,6 +110,7 @@ void generateButtonAdJSON(String& output, const AutoDiscoveryInformationTemplate
 }
 
 void generateClimateAdJSON(String& output, const AutoDiscoveryInformationTemplate& config, const SpaADInformationTemplate& spa, String &discoveryTopic) {
+   SPA_HEAP_TAG(HAAutoDiscovery);
    JsonDocument json;
    generateCommonAdJSON(json, config, spa, discoveryTopic, "climate");
 
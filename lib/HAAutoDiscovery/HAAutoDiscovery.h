@@ -4,6 +4,7 @@
 #include <Arduino.h>
 #include <ArduinoJson.h>
 #include "SpaInterface.h"
+#include "HeapTracker.h"
 
 
 /// @brief Configuration structure for the data elements for the Spa.
@@ -0,0 +1,170 @@
+#include "HeapTracker.h"
+#include <ArduinoJson.h>
+
+namespace {
+
+// The tag in effect on each task that has used a Scope. Looked up by task
+// handle rather than thread_local, because malloc runs before the scheduler
+// has set up task-local storage.
+constexpr size_t MAX_TAGGED_TASKS = 8;
+
+struct TaskTag {
+    void *task;
+    volatile uint8_t tag;
+};
+
+TaskTag taskTags[MAX_TAGGED_TASKS] = {};
+
+uint32_t allocations[HeapTracker::TAG_COUNT] = {};
+uint32_t allocatedBytes[HeapTracker::TAG_COUNT] = {};
+
+HeapTracker::Snapshot heap;
+
+// The task polling the spa between beginPoll() and samplePoll(), and what it allocated there.
+void *volatile pollTask = nullptr;
+uint32_t pollAllocations = 0;
+
+} // namespace
+
+HeapTracker::Scope::Scope(HeapTag tag) : _slot(currentSlot(true)), _previous(0) {
+    if (_slot == nullptr) return;
+    _previous = *_slot;
+    *_slot = static_cast<uint8_t>(tag);
+}
+
+HeapTracker::Scope::~Scope() {
+    if (_slot != nullptr) *_slot = _previous;
+}
+
+bool HeapTracker::trackingAllocations() {
+#if defined(SPA_HEAP_TRACKING)
+    return true;
+#else
+    return false;
+#endif
+}
+
+void HeapTracker::beginPoll() {
+    pollAllocations = 0;
+    pollTask = xTaskGetCurrentTaskHandle();
+}
+
+bool HeapTracker::samplePoll(bool steadyState) {
+    pollTask = nullptr;
+    heap.freeHeap = ESP.getFreeHeap();
+    heap.largestFreeBlock = ESP.getMaxAllocHeap();
+    heap.minFreeHeap = ESP.getMinFreeHeap();
+    if (heap.polls == 0 || heap.largestFreeBlock < heap.minLargestFreeBlock) {
+        heap.minLargestFreeBlock = heap.largestFreeBlock;
+    }
+    heap.polls++;
+
+    heap.lastPollAllocations = pollAllocations;
+
+    if (!trackingAllocations() || !steadyState) return true;
+
+    if (heap.lastPollAllocations > heap.maxPollAllocations) {
+        heap.maxPollAllocations = heap.lastPollAllocations;
+    }
+    if (heap.lastPollAllocations > SPA_HEAP_ALLOC_BUDGET_PER_POLL) {
+        heap.overBudgetPolls++;
+        return false;
+    }
+    return true;
+}
+
+HeapTracker::Snapshot HeapTracker::snapshot() {
+    Snapshot copy = heap;
+    for (size_t i = 0; i < TAG_COUNT; i++) {
+        copy.allocations[i] = allocations[i];
+        copy.allocatedBytes[i] = allocatedBytes[i];
+    }
+    return copy;
+}
+
+const char *HeapTracker::tagName(HeapTag tag) {
+    switch (tag) {
+        case HeapTag::SpaInterface:    return "spa_interface";
+        case HeapTag::SpaUtils:        return "spa_utils";
+        case HeapTag::WebUI:           return "web_ui";
+        case HeapTag::WebRemoteDebug:  return "web_remote_debug";
+        case HeapTag::HAAutoDiscovery: return "ha_autodiscovery";
+        default:                       return "other";
+    }
+}
+
+String HeapTracker::toJson() {
+    const Snapshot s = snapshot();
+    JsonDocument json;
+    json["freeHeap"] = s.freeHeap;
+    json["largestFreeBlock"] = s.largestFreeBlock;
+    json["minFreeHeap"] = s.minFreeHeap;
+    json["minLargestFreeBlock"] = s.minLargestFreeBlock;
+    json["polls"] = s.polls;
+    if (trackingAllocations()) {
+        json["lastPollAllocations"] = s.lastPollAllocations;
+        json["maxPollAllocations"] = s.maxPollAllocations;
+        json["overBudgetPolls"] = s.overBudgetPolls;
+        json["allocationBudget"] = SPA_HEAP_ALLOC_BUDGET_PER_POLL;
+        for (size_t i = 0; i < TAG_COUNT; i++) {
+            json["allocations"][tagName(i)] = s.allocations[i];
+            json["allocatedBytes"][tagName(i)] = s.allocatedBytes[i];
+        }
+    }
+    String output;
+    serializeJson(json, output);
+    return output;
+}
+
+void HeapTracker::countAllocation(size_t size) {
+    volatile uint8_t *slot = currentSlot(false);
+    const size_t tag = slot != nullptr ? *slot : static_cast<size_t>(HeapTag::Other);
+    __atomic_fetch_add(&allocations[tag], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&allocatedBytes[tag], (uint32_t)size, __ATOMIC_RELAXED);
+    if (tag == static_cast<size_t>(HeapTag::SpaInterface) && pollTask != nullptr && xTaskGetCurrentTaskHandle() == pollTask) {
+        pollAllocations++;
+    }
+}
+
+volatile uint8_t *HeapTracker::currentSlot(bool create) {
+    void *task = xTaskGetCurrentTaskHandle();
+    if (task == nullptr) return nullptr;
+
+    for (TaskTag &entry : taskTags) {
+        if (entry.task == task) return &entry.tag;
+    }
+    if (!create) return nullptr;
+
+    for (TaskTag &entry : taskTags) {
+        void *expected = nullptr;
+        if (__atomic_compare_exchange_n(&entry.task, &expected, task, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            return &entry.tag;
+        }
+    }
+    return nullptr;
+}
+
+#if defined(SPA_HEAP_TRACKING)
+// Linked in place of the C allocator by -Wl,--wrap=malloc etc.
+extern "C" {
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+    HeapTracker::countAllocation(size);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    HeapTracker::countAllocation(count * size);
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    // String growth goes through here; a shrink or free is not an allocation.
+    if (size > 0) HeapTracker::countAllocation(size);
+    return __real_realloc(ptr, size);
+}
+}
+#endif
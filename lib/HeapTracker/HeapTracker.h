@@ -0,0 +1,102 @@
+#ifndef HEAPTRACKER_H
+#define HEAPTRACKER_H
+
+/**
+ * @file HeapTracker.h
+ * @brief Heap level, fragmentation and per-subsystem allocation counts.
+ *
+ * HeapTracker::samplePoll() is called once per spa poll and records free heap,
+ * the largest free block and their minimums. That part is always available.
+ *
+ * Allocation counting is an instrumentation mode: build with
+ *
+ *   -D SPA_HEAP_TRACKING
+ *   -Wl,--wrap=malloc -Wl,--wrap=calloc -Wl,--wrap=realloc
+ *
+ * (see the espa-v1-heap-tracking environment). Every allocation is then
+ * charged to the subsystem tagged on the calling task with SPA_HEAP_TAG(),
+ * or to "other". Without SPA_HEAP_TRACKING the tags compile to nothing.
+ *
+ * The per-poll budget only counts SpaInterface-tagged allocations made on the
+ * polling task between beginPoll() and samplePoll(), so MQTT, web and WiFi
+ * traffic on other tasks (or under other tags) does not count against it.
+ */
+
+#include <Arduino.h>
+
+/// @brief Subsystems allocations are charged to.
+enum class HeapTag : uint8_t {
+    Other,
+    SpaInterface,
+    SpaUtils,
+    WebUI,
+    WebRemoteDebug,
+    HAAutoDiscovery,
+    Count
+};
+
+#ifndef SPA_HEAP_ALLOC_BUDGET_PER_POLL
+/// @brief SpaInterface allocations a steady state poll may make before it counts as over budget.
+#define SPA_HEAP_ALLOC_BUDGET_PER_POLL 500
+#endif
+
+class HeapTracker {
+public:
+    static constexpr size_t TAG_COUNT = static_cast<size_t>(HeapTag::Count);
+
+    struct Snapshot {
+        uint32_t freeHeap = 0;
+        uint32_t largestFreeBlock = 0;
+        uint32_t minFreeHeap = 0;           ///< Low water mark since boot, from the allocator
+        uint32_t minLargestFreeBlock = 0;   ///< Smallest largest-free-block seen at a poll
+        uint32_t polls = 0;
+        uint32_t lastPollAllocations = 0;   ///< SpaInterface allocations made by the last poll
+        uint32_t maxPollAllocations = 0;    ///< Worst steady state poll
+        uint32_t overBudgetPolls = 0;       ///< Steady state polls above SPA_HEAP_ALLOC_BUDGET_PER_POLL
+        uint32_t allocations[TAG_COUNT] = {};
+        uint32_t allocatedBytes[TAG_COUNT] = {};    ///< Wraps at 4 GB, like any counter
+    };
+
+    /// @brief Charges allocations on the current task to a tag until destroyed.
+    class Scope {
+    public:
+        explicit Scope(HeapTag tag);
+        ~Scope();
+    private:
+        volatile uint8_t *_slot;
+        uint8_t _previous;
+    };
+
+    /// @brief True when built with SPA_HEAP_TRACKING, i.e. allocation counts are live.
+    static bool trackingAllocations();
+
+    /// @brief Start counting the current task's SpaInterface allocations for the poll budget.
+    static void beginPoll();
+
+    /// @brief Sample the heap and end the poll started by beginPoll(); call once per poll.
+    /// @param steadyState The spa link was already up, so the poll is comparable to the budget.
+    /// @return false if this poll exceeded the allocation budget.
+    static bool samplePoll(bool steadyState);
+
+    static Snapshot snapshot();
+
+    static const char *tagName(HeapTag tag);
+    static const char *tagName(size_t tag) { return tagName(static_cast<HeapTag>(tag)); }
+
+    /// @brief Snapshot as a JSON object, for MQTT publishing.
+    static String toJson();
+
+    /// @brief Called by the malloc wrappers.
+    static void countAllocation(size_t size);
+
+private:
+    static volatile uint8_t *currentSlot(bool create);
+};
+
+#if defined(SPA_HEAP_TRACKING)
+#define SPA_HEAP_TAG(tag) HeapTracker::Scope spaHeapTagScope(HeapTag::tag)
+#else
+#define SPA_HEAP_TAG(tag) static_cast<void>(0)
+#endif
+
+#endif // HEAPTRACKER_H
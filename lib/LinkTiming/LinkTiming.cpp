@@ -0,0 +1,125 @@
+#include "LinkTiming.h"
+
+constexpr LinkTiming::WakeStep LinkTiming::WAKE_STEPS[];
+
+void LinkTiming::Window::record(uint32_t us) {
+    samples[next] = us;
+    next = (next + 1) % WINDOW;
+    if (count < WINDOW) count++;
+}
+
+uint32_t LinkTiming::Window::percentileUs(uint8_t percentile) const {
+    if (count == 0) return 0;
+
+    uint32_t sorted[WINDOW];
+    for (size_t i = 0; i < count; i++) {
+        size_t j = i;
+        for (; j > 0 && sorted[j - 1] > samples[i]; j--) sorted[j] = sorted[j - 1];
+        sorted[j] = samples[i];
+    }
+
+    // Nearest rank, rounded up (p95 of 16 samples is the 16th).
+    size_t rank = ((size_t)count * percentile + 99) / 100;
+    if (rank == 0) rank = 1;
+    return sorted[rank - 1];
+}
+
+uint32_t LinkTiming::responseTimeoutMs(const String &cmd) {
+    return responseTimeoutMs(entry(cmd));
+}
+
+uint32_t LinkTiming::responseTimeoutMs(const CommandTiming &command) {
+    return learnedTimeoutMs(command.latency, MIN_RESPONSE_TIMEOUT_MS, DEFAULT_RESPONSE_TIMEOUT_MS, RESPONSE_MARGIN_MS);
+}
+
+void LinkTiming::recordResponse(const String &cmd, uint32_t latencyUs) {
+    entry(cmd).latency.record(latencyUs);
+}
+
+void LinkTiming::recordNoResponse(const String &cmd, uint32_t waitedMs) {
+    CommandTiming &timing = entry(cmd);
+    timing.latency.record(waitedMs * 1000);
+    timing.timeouts++;
+}
+
+uint32_t LinkTiming::gapTimeoutMs() const {
+    return learnedTimeoutMs(_gaps, MIN_GAP_TIMEOUT_MS, DEFAULT_GAP_TIMEOUT_MS, GAP_MARGIN_MS);
+}
+
+void LinkTiming::recordGap(uint32_t gapUs) {
+    _gaps.record(gapUs);
+}
+
+void LinkTiming::recordGapTimeout(uint32_t waitedMs) {
+    _gaps.record(waitedMs * 1000);
+}
+
+uint32_t LinkTiming::learnedTimeoutMs(const Window &window, uint32_t minimumMs, uint32_t defaultMs, uint32_t marginMs) {
+    if (window.count < MIN_SAMPLES) return defaultMs;
+
+    const uint32_t learned = window.percentileUs(95) / 1000 * 3 / 2 + marginMs;
+    if (learned < minimumMs) return minimumMs;
+    if (learned > defaultMs) return defaultMs;
+    return learned;
+}
+
+bool LinkTiming::recordWakeOutcome(bool ok) {
+    if (ok) {
+        _wakeFailures = 0;
+        if (_wakeSettled || ++_wakeStreak < WAKE_PROBE_SUCCESSES) return false;
+        _wakeStreak = 0;
+        if (_wakeLevel + 1 < WAKE_STEP_COUNT) {
+            _wakeLevel++;
+            return false;
+        }
+        // Even the shortest step works.
+        _wakeSettled = true;
+        return true;
+    }
+
+    _wakeStreak = 0;
+    // Failing with the original wake-up says nothing about shorter ones.
+    if (_wakeLevel == 0) return false;
+    if (_wakeSettled && ++_wakeFailures < WAKE_SETTLED_FAILURES) return false;
+    _wakeFailures = 0;
+
+    _wakeLevel--;
+    _wakeSettled = true;
+    return true;
+}
+
+void LinkTiming::restoreWake(uint8_t level) {
+    _wakeLevel = level < WAKE_STEP_COUNT ? level : 0;
+    _wakeSettled = true;
+    _wakeStreak = 0;
+    _wakeFailures = 0;
+}
+
+LinkTiming::CommandTiming &LinkTiming::entry(const String &cmd) {
+    char code[sizeof(CommandTiming::code)];
+    size_t length = 0;
+    while (length < sizeof(code) - 1 && length < cmd.length() && cmd[length] != ':') {
+        code[length] = cmd[length];
+        length++;
+    }
+    code[length] = '\0';
+
+    const uint32_t now = millis();
+    CommandTiming *oldest = &_commands[0];
+    for (CommandTiming &timing : _commands) {
+        if (strcmp(timing.code, code) == 0) {
+            timing.lastUsedMs = now;
+            return timing;
+        }
+        if (timing.code[0] == '\0') {
+            oldest = &timing;
+            break;
+        }
+        if ((int32_t)(timing.lastUsedMs - oldest->lastUsedMs) < 0) oldest = &timing;
+    }
+
+    *oldest = CommandTiming();
+    memcpy(oldest->code, code, length + 1);
+    oldest->lastUsedMs = now;
+    return *oldest;
+}
@@ -0,0 +1,118 @@
+#ifndef LINKTIMING_H
+#define LINKTIMING_H
+
+/**
+ * @file LinkTiming.h
+ * @brief Serial link timeouts learned from observed controller latency.
+ *
+ * Each command code ("RF", "S22", "W08", ...) keeps a window of its most recent
+ * first-byte latencies. Once a code has MIN_SAMPLES of them, its response
+ * timeout becomes the 95th percentile scaled by 3/2 plus RESPONSE_MARGIN_MS,
+ * bounded by MIN_RESPONSE_TIMEOUT_MS and DEFAULT_RESPONSE_TIMEOUT_MS. A wait
+ * that times out enters the window at the timeout it used, so a timeout that
+ * was learned too tight widens by half on every miss.
+ *
+ * The gap timeout (silence that ends a response) is learned the same way from
+ * waits between chunks of a response.
+ *
+ * The wake-up newline sent before each command, and the pause after it, are
+ * calibrated from command outcomes. Starting from the original newline plus
+ * 50 ms, each WAKE_PROBE_SUCCESSES clean exchanges in a row step to the next,
+ * shorter entry of WAKE_STEPS. The first failure steps back and settles
+ * there. Once settled, WAKE_SETTLED_FAILURES failures in a row step back once
+ * more. Failures with the original wake-up are link trouble and are ignored.
+ *
+ * Recording and lookups happen on the loop task only.
+ */
+
+#include <Arduino.h>
+
+class LinkTiming {
+public:
+    static constexpr size_t MAX_COMMANDS = 16;
+    static constexpr size_t WINDOW = 16;
+    /// @brief Samples needed before a learned value replaces the default.
+    static constexpr size_t MIN_SAMPLES = 8;
+
+    static constexpr uint32_t DEFAULT_RESPONSE_TIMEOUT_MS = 1000;
+    static constexpr uint32_t MIN_RESPONSE_TIMEOUT_MS = 100;
+    static constexpr uint32_t RESPONSE_MARGIN_MS = 50;
+
+    static constexpr uint32_t DEFAULT_GAP_TIMEOUT_MS = 250;
+    static constexpr uint32_t MIN_GAP_TIMEOUT_MS = 40;
+    static constexpr uint32_t GAP_MARGIN_MS = 20;
+
+    /// @brief What precedes a command on the wire.
+    struct WakeStep {
+        bool newline;       ///< Send a bare newline first
+        uint8_t delayMs;    ///< Pause between the newline and the command
+    };
+    static constexpr WakeStep WAKE_STEPS[] = {{true, 50}, {true, 20}, {true, 5}, {false, 0}};
+    static constexpr uint8_t WAKE_STEP_COUNT = sizeof(WAKE_STEPS) / sizeof(WAKE_STEPS[0]);
+    static constexpr uint8_t WAKE_PROBE_SUCCESSES = 5;
+    static constexpr uint8_t WAKE_SETTLED_FAILURES = 2;
+
+    /// @brief The most recent WINDOW samples, in us.
+    struct Window {
+        uint32_t samples[WINDOW] = {};
+        uint8_t next = 0;
+        uint8_t count = 0;
+
+        void record(uint32_t us);
+        /// @brief Nearest-rank percentile of the window, 0 if empty.
+        uint32_t percentileUs(uint8_t percentile) const;
+    };
+
+    struct CommandTiming {
+        char code[6] = {};          ///< Command up to the ':', "" = unused entry
+        Window latency;
+        uint32_t timeouts = 0;      ///< Waits that got no response
+        uint32_t lastUsedMs = 0;
+    };
+
+    /// @brief Time to wait for the first byte of the response to cmd.
+    uint32_t responseTimeoutMs(const String &cmd);
+    void recordResponse(const String &cmd, uint32_t latencyUs);
+    void recordNoResponse(const String &cmd, uint32_t waitedMs);
+
+    /// @brief Silence after which a response is considered to have ended.
+    uint32_t gapTimeoutMs() const;
+    void recordGap(uint32_t gapUs);
+    void recordGapTimeout(uint32_t waitedMs);
+
+    /// @brief Wake-up step in force, as an index into WAKE_STEPS.
+    uint8_t wakeLevel() const { return _wakeLevel; }
+    const WakeStep &wakeStep() const { return WAKE_STEPS[_wakeLevel]; }
+    /// @brief Probing has finished; the level is only revised after failures.
+    bool wakeSettled() const { return _wakeSettled; }
+
+    /// @brief Feed back whether an exchange sent with wakeStep() worked.
+    /// @return true if a new level was settled, which is worth persisting.
+    bool recordWakeOutcome(bool ok);
+
+    /// @brief Resume from a level settled earlier (for the same firmware).
+    void restoreWake(uint8_t level);
+
+    /// @brief Entries in use come first; an unused entry has an empty code.
+    const CommandTiming *commands() const { return _commands; }
+    /// @brief Response timeout currently in force for an entry of commands().
+    static uint32_t responseTimeoutMs(const CommandTiming &command);
+    const Window &gaps() const { return _gaps; }
+
+    /// @brief Learned timeout for a window, or the default while it is still filling.
+    static uint32_t learnedTimeoutMs(const Window &window, uint32_t minimumMs, uint32_t defaultMs, uint32_t marginMs);
+
+private:
+    CommandTiming _commands[MAX_COMMANDS];
+    Window _gaps;
+
+    uint8_t _wakeLevel = 0;
+    bool _wakeSettled = false;
+    uint8_t _wakeStreak = 0;
+    uint8_t _wakeFailures = 0;
+
+    /// @brief Entry for the command code of cmd, evicting the least recently used if needed.
+    CommandTiming &entry(const String &cmd);
+};
+
+#endif // LINKTIMING_H
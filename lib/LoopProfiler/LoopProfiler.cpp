@@ -0,0 +1,80 @@
+#include "LoopProfiler.h"
+
+LoopProfiler::LoopProfiler(const char *const *names, size_t count, int enclosingPhase)
+    : _names(names), _count(count < MAX_PHASES ? count : MAX_PHASES), _enclosingPhase(enclosingPhase) {
+}
+
+void LoopProfiler::record(uint8_t phase, uint32_t durationUs) {
+    if (phase >= _count) return;
+
+    PhaseStats &stats = _stats[phase];
+    stats.count++;
+    stats.totalUs += durationUs;
+    if (durationUs > stats.maxUs) stats.maxUs = durationUs;
+
+    size_t bucket = durationUs < 2 ? 0 : 31 - __builtin_clz(durationUs);
+    if (bucket >= BUCKETS) bucket = BUCKETS - 1;
+    stats.buckets[bucket]++;
+
+    // The enclosing phase's stalls are already listed under the phase that caused them.
+    if (phase == _enclosingPhase) return;
+
+    // Stalls are sorted longest first, so most calls stop at the last entry.
+    if (durationUs <= _stalls[MAX_STALLS - 1].durationUs) return;
+    size_t i = MAX_STALLS - 1;
+    while (i > 0 && _stalls[i - 1].durationUs < durationUs) {
+        _stalls[i] = _stalls[i - 1];
+        i--;
+    }
+    _stalls[i].phase = phase;
+    _stalls[i].durationUs = durationUs;
+    _stalls[i].atMs = millis();
+}
+
+void LoopProfiler::reset() {
+    for (PhaseStats &stats : _stats) stats = PhaseStats();
+    for (Stall &stall : _stalls) stall = Stall();
+}
+
+uint32_t LoopProfiler::percentileUs(uint8_t phase, uint8_t percentile) const {
+    if (phase >= _count) return 0;
+    const PhaseStats &stats = _stats[phase];
+    if (stats.count == 0) return 0;
+
+    // Rank of the sample at the percentile, rounded up (p50 of 1 sample is that sample).
+    const uint64_t rank = ((uint64_t)stats.count * percentile + 99) / 100;
+    uint64_t seen = 0;
+    for (size_t b = 0; b < BUCKETS - 1; b++) {
+        seen += stats.buckets[b];
+        if (seen >= rank) {
+            const uint32_t bound = bucketBoundUs(b);
+            return bound < stats.maxUs ? bound : stats.maxUs;
+        }
+    }
+    return stats.maxUs;
+}
+
+uint32_t LoopProfiler::bucketBoundUs(size_t bucket) {
+    return bucket < BUCKETS - 1 ? 2UL << bucket : 0;
+}
+
+String LoopProfiler::summary() const {
+    String out;
+    for (size_t i = 0; i < _count; i++) {
+        const PhaseStats &stats = _stats[i];
+        if (stats.count == 0) continue;
+        if (!out.isEmpty()) out += "\n";
+        out += String(_names[i]);
+        out += ": n=" + String(stats.count);
+        out += ", avg=" + String((uint32_t)(stats.totalUs / stats.count)) + "us";
+        out += ", p50<=" + String(percentileUs(i, 50)) + "us";
+        out += ", p99<=" + String(percentileUs(i, 99)) + "us";
+        out += ", max=" + String(stats.maxUs) + "us";
+    }
+    for (const Stall &stall : _stalls) {
+        if (stall.durationUs == 0) break;
+        out += "\nstall " + String(_names[stall.phase]) + " " + String(stall.durationUs) + "us";
+        out += " at " + String(stall.atMs / 1000) + "." + String(stall.atMs % 1000 + 1000).substring(1) + "s";
+    }
+    return out;
+}
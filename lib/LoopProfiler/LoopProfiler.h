@@ -0,0 +1,89 @@
+#ifndef LOOPPROFILER_H
+#define LOOPPROFILER_H
+
+/**
+ * @file LoopProfiler.h
+ * @brief Per-phase timing of the main loop.
+ *
+ * Each phase of loop() is wrapped in a LoopProfiler::Scope. Its duration goes
+ * into a log2 histogram for that phase (from which p50/p99 are estimated) and,
+ * if it is among the longest seen, into a small table of worst stalls. A phase
+ * timing the whole iteration would repeat every stall of the phases inside it,
+ * so it can be named as the enclosing phase, which only gets a histogram.
+ *
+ * Recording happens on the loop task only. Readers on other tasks (web
+ * handlers) may see a histogram mid-update, which is acceptable for
+ * monitoring figures.
+ */
+
+#include <Arduino.h>
+
+class LoopProfiler {
+public:
+    static constexpr size_t MAX_PHASES = 12;
+    /// @brief Histogram bucket i counts durations below 2^(i+1) us; the last is open ended.
+    static constexpr size_t BUCKETS = 24;
+    static constexpr size_t MAX_STALLS = 8;
+
+    struct PhaseStats {
+        uint32_t count = 0;
+        uint64_t totalUs = 0;
+        uint32_t maxUs = 0;
+        uint32_t buckets[BUCKETS] = {};
+    };
+
+    struct Stall {
+        uint8_t phase = 0;
+        uint32_t durationUs = 0;    ///< 0 = unused entry
+        uint32_t atMs = 0;          ///< millis() when the phase ended
+    };
+
+    /// @brief Times one phase from construction to destruction.
+    class Scope {
+    public:
+        Scope(LoopProfiler &profiler, uint8_t phase) : _profiler(profiler), _phase(phase), _start(micros()) {}
+        ~Scope() { _profiler.record(_phase, micros() - _start); }
+    private:
+        LoopProfiler &_profiler;
+        uint8_t _phase;
+        uint32_t _start;
+    };
+
+    /// @brief No phase encloses the others.
+    static constexpr int NO_ENCLOSING_PHASE = -1;
+
+    /// @param names One name per phase, indexed by phase number; must outlive the profiler.
+    /// @param enclosingPhase Phase timing the whole iteration, kept out of the stall table.
+    LoopProfiler(const char *const *names, size_t count, int enclosingPhase = NO_ENCLOSING_PHASE);
+
+    void record(uint8_t phase, uint32_t durationUs);
+
+    /// @brief Clear all histograms and stalls.
+    void reset();
+
+    size_t phaseCount() const { return _count; }
+    const char *phaseName(uint8_t phase) const { return _names[phase]; }
+    const PhaseStats &stats(uint8_t phase) const { return _stats[phase]; }
+
+    /// @brief Worst stalls, longest first. Unused entries have durationUs 0.
+    const Stall *stalls() const { return _stalls; }
+
+    /// @brief Upper bound of the histogram bucket holding the given percentile.
+    /// @param percentile 0-100.
+    uint32_t percentileUs(uint8_t phase, uint8_t percentile) const;
+
+    /// @brief Upper bound in us of histogram bucket i, or 0 for the open ended last one.
+    static uint32_t bucketBoundUs(size_t bucket);
+
+    /// @brief One line per phase (count, avg, p50, p99, max) followed by the worst stalls.
+    String summary() const;
+
+private:
+    const char *const *_names;
+    size_t _count;
+    int _enclosingPhase;
+    PhaseStats _stats[MAX_PHASES];
+    Stall _stalls[MAX_STALLS];
+};
+
+#endif // LOOPPROFILER_H
@@ -0,0 +1,372 @@
+#include "OtaUpdater.h"
+
+#include <cctype>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(ESP_PLATFORM)
+#include <esp_timer.h>
+#else
+#include <chrono>
+#endif
+
+// Optional gzip header fields, in the order they appear after the fixed 10 bytes.
+enum : uint8_t {
+    HEADER_FIXED = 0,
+    HEADER_XLEN,
+    HEADER_EXTRA,
+    HEADER_NAME,
+    HEADER_COMMENT,
+    HEADER_HCRC,
+    HEADER_END
+};
+
+uint64_t OtaUpdater::systemClockUs() {
+#if defined(ESP_PLATFORM)
+    return (uint64_t)esp_timer_get_time();
+#else
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+OtaUpdater::OtaUpdater(OtaSink &sink, Clock clockUs) : _sink(sink), _clockUs(clockUs) {
+    mbedtls_sha256_init(&_sha);
+    _error[0] = '\0';
+    memset(_digest, 0, sizeof(_digest));
+    toHex(_digest, sizeof(_digest), _digestHex);
+}
+
+OtaUpdater::~OtaUpdater() {
+    releaseBuffers();
+    mbedtls_sha256_free(&_sha);
+}
+
+bool OtaUpdater::begin(int command, const char *expectedSha256) {
+    if (_stage != Stage::Idle) {
+        // Previous upload never finished (client went away), don't leave the sink open.
+        _sink.abort();
+        releaseBuffers();
+    }
+
+    _stage = Stage::Idle;
+    _error[0] = '\0';
+    _stats = Stats();
+    _flashWriteUs = 0;
+    _startUs = _clockUs();
+    _hdrLen = 0;
+    _headerField = HEADER_FIXED;
+    _skipRemaining = 0;
+    _crc = 0;
+    memset(_digest, 0, sizeof(_digest));
+    toHex(_digest, sizeof(_digest), _digestHex);
+
+    _verifySha = expectedSha256 != nullptr && expectedSha256[0] != '\0';
+    if (_verifySha && !parseHex(expectedSha256, _expectedSha, sizeof(_expectedSha))) {
+        return fail("Expected SHA-256 must be 64 hex characters");
+    }
+
+    mbedtls_sha256_free(&_sha);
+    mbedtls_sha256_init(&_sha);
+    mbedtls_sha256_starts(&_sha, 0);
+
+    if (!_sink.begin(UPDATE_SIZE_UNKNOWN, command)) {
+        return fail("%s", sinkError());
+    }
+
+    _stage = Stage::Detect;
+    return true;
+}
+
+bool OtaUpdater::write(uint8_t *data, size_t len) {
+    if (hasError()) return false;
+    if (_stage == Stage::Idle) return fail("Update not started");
+
+    _stats.receivedBytes += len;
+    mbedtls_sha256_update(&_sha, data, len);
+
+    while (len > 0 && !hasError()) {
+        size_t used = 0;
+        switch (_stage) {
+            case Stage::Detect:
+                _hdr[_hdrLen++] = data[0];
+                used = 1;
+                if (_hdrLen == 2) {
+                    if (_hdr[0] == 0x1f && _hdr[1] == 0x8b) {
+                        _inflator = (tinfl_decompressor *)malloc(sizeof(tinfl_decompressor));
+                        _dict = (uint8_t *)malloc(TINFL_LZ_DICT_SIZE);
+                        if (_inflator == nullptr || _dict == nullptr) {
+                            return fail("Not enough memory to inflate gzip upload");
+                        }
+                        tinfl_init(_inflator);
+                        _dictOffset = 0;
+                        _stats.compressed = true;
+                        _stage = Stage::GzipHeader;
+                    } else {
+                        _stage = Stage::Passthrough;
+                        _hdrLen = 0;
+                        sinkWrite(_hdr, 2);
+                    }
+                }
+                break;
+            case Stage::GzipHeader:
+                used = parseGzipHeader(data, len);
+                break;
+            case Stage::Inflate:
+                used = inflateChunk(data, len);
+                break;
+            case Stage::GzipTrailer:
+                used = readTrailer(data, len);
+                break;
+            case Stage::Passthrough:
+                sinkWrite(data, len);
+                used = len;
+                break;
+            case Stage::Done:
+                return fail("Unexpected data after end of gzip stream");
+            case Stage::Idle:
+                return fail("Update not started");
+        }
+        data += used;
+        len -= used;
+    }
+    return !hasError();
+}
+
+bool OtaUpdater::end() {
+    if (_stage == Stage::Idle) {
+        return hasError() ? false : fail("Update not started");
+    }
+
+    if (!hasError()) {
+        if (_stage == Stage::Detect) fail("Upload is too short");
+        else if (_stats.compressed && _stage != Stage::Done) fail("Truncated gzip stream");
+    }
+
+    mbedtls_sha256_finish(&_sha, _digest);
+    toHex(_digest, sizeof(_digest), _digestHex);
+    if (!hasError() && _verifySha && memcmp(_digest, _expectedSha, sizeof(_digest)) != 0) {
+        char expected[sizeof(_digestHex)];
+        toHex(_expectedSha, sizeof(_expectedSha), expected);
+        fail("SHA-256 mismatch, expected %s got %s", expected, _digestHex);
+    }
+
+    _stats.elapsedMs = (uint32_t)((_clockUs() - _startUs) / 1000);
+    _stage = Stage::Idle;
+    releaseBuffers();
+
+    if (hasError()) {
+        _sink.abort();
+        return false;
+    }
+    if (!_sink.end(true)) { // true to set the size to the current progress
+        return fail("%s", sinkError());
+    }
+    return true;
+}
+
+void OtaUpdater::abort() {
+    if (_stage != Stage::Idle) {
+        _sink.abort();
+        _stats.elapsedMs = (uint32_t)((_clockUs() - _startUs) / 1000);
+    }
+    _stage = Stage::Idle;
+    releaseBuffers();
+}
+
+uint32_t OtaUpdater::bytesPerSecond() const {
+    uint32_t elapsed = _stage == Stage::Idle ? _stats.elapsedMs : (uint32_t)((_clockUs() - _startUs) / 1000);
+    if (elapsed == 0) return 0;
+    return (uint32_t)((uint64_t)_stats.receivedBytes * 1000 / elapsed);
+}
+
+bool OtaUpdater::fail(const char *format, ...) {
+    if (hasError()) return false;   // the first error is the one worth reporting
+    va_list args;
+    va_start(args, format);
+    vsnprintf(_error, sizeof(_error), format, args);
+    va_end(args);
+    // A sink may have no message for its failure.
+    if (_error[0] == '\0') snprintf(_error, sizeof(_error), "Unknown error");
+    return false;
+}
+
+const char *OtaUpdater::sinkError() {
+    const char *reason = _sink.errorString();
+    return reason != nullptr ? reason : "";
+}
+
+bool OtaUpdater::sinkWrite(uint8_t *data, size_t len) {
+    uint64_t start = _clockUs();
+    size_t written = _sink.write(data, len);
+    _flashWriteUs += _clockUs() - start;
+    _stats.flashWriteMs = (uint32_t)(_flashWriteUs / 1000);
+    _stats.writtenBytes += written;
+    if (written != len) {
+        return fail("Flash write failed: %s", sinkError());
+    }
+    return true;
+}
+
+void OtaUpdater::nextHeaderField() {
+    _hdrLen = 0;
+    for (;;) {
+        _headerField++;
+        bool present = false;
+        switch (_headerField) {
+            case HEADER_XLEN:    present = _gzipFlags & GZIP_FEXTRA; break;
+            case HEADER_EXTRA:   present = (_gzipFlags & GZIP_FEXTRA) && _skipRemaining > 0; break;
+            case HEADER_NAME:    present = _gzipFlags & GZIP_FNAME; break;
+            case HEADER_COMMENT: present = _gzipFlags & GZIP_FCOMMENT; break;
+            case HEADER_HCRC:    present = _gzipFlags & GZIP_FHCRC; break;
+            default:
+                _stage = Stage::Inflate;
+                return;
+        }
+        if (present) return;
+    }
+}
+
+size_t OtaUpdater::parseGzipHeader(const uint8_t *data, size_t len) {
+    // The header is tiny and usually arrives in the first chunk, but nothing
+    // guarantees that, so it is parsed a byte at a time.
+    size_t used = 0;
+    while (used < len && _stage == Stage::GzipHeader) {
+        uint8_t b = data[used++];
+        switch (_headerField) {
+            case HEADER_FIXED:
+                _hdr[_hdrLen++] = b;
+                if (_hdrLen == 10) {
+                    if (_hdr[2] != 8) { // CM: 8 = deflate, the only method defined
+                        fail("Unsupported gzip compression method");
+                        return used;
+                    }
+                    _gzipFlags = _hdr[3];
+                    nextHeaderField();
+                }
+                break;
+            case HEADER_XLEN:
+                _hdr[_hdrLen++] = b;
+                if (_hdrLen == 2) {
+                    _skipRemaining = _hdr[0] | (_hdr[1] << 8);
+                    nextHeaderField();
+                }
+                break;
+            case HEADER_EXTRA:
+                if (--_skipRemaining == 0) nextHeaderField();
+                break;
+            case HEADER_NAME:
+            case HEADER_COMMENT:
+                if (b == 0) nextHeaderField();
+                break;
+            case HEADER_HCRC:
+                if (++_hdrLen == 2) nextHeaderField();
+                break;
+        }
+    }
+    return used;
+}
+
+size_t OtaUpdater::inflateChunk(const uint8_t *data, size_t len) {
+    size_t used = 0;
+    for (;;) {
+        size_t inBytes = len - used;
+        size_t outBytes = TINFL_LZ_DICT_SIZE - _dictOffset;
+        tinfl_status status = tinfl_decompress(_inflator, data + used, &inBytes,
+                                               _dict, _dict + _dictOffset, &outBytes,
+                                               TINFL_FLAG_HAS_MORE_INPUT);
+        used += inBytes;
+
+        if (outBytes > 0) {
+            _crc = crc32Update(_crc, _dict + _dictOffset, outBytes);
+            if (!sinkWrite(_dict + _dictOffset, outBytes)) return used;
+            _dictOffset = (_dictOffset + outBytes) & (TINFL_LZ_DICT_SIZE - 1);
+        }
+
+        if (status == TINFL_STATUS_DONE) {
+            releaseBuffers();
+            _hdrLen = 0;
+            _stage = Stage::GzipTrailer;
+            return used;
+        }
+        if (status < 0) {
+            fail("Corrupt gzip data");
+            return used;
+        }
+        if (status == TINFL_STATUS_NEEDS_MORE_INPUT && used == len) return used;
+        if (inBytes == 0 && outBytes == 0) {
+            fail("Inflate made no progress");
+            return used;
+        }
+    }
+}
+
+size_t OtaUpdater::readTrailer(const uint8_t *data, size_t len) {
+    size_t used = 0;
+    while (used < len && _hdrLen < 8) _hdr[_hdrLen++] = data[used++];
+    if (_hdrLen < 8) return used;
+
+    uint32_t crc = _hdr[0] | (_hdr[1] << 8) | (_hdr[2] << 16) | ((uint32_t)_hdr[3] << 24);
+    uint32_t isize = _hdr[4] | (_hdr[5] << 8) | (_hdr[6] << 16) | ((uint32_t)_hdr[7] << 24);
+    if (crc != _crc) {
+        fail("gzip CRC-32 mismatch");
+    } else if (isize != (uint32_t)_stats.writtenBytes) {
+        fail("gzip length mismatch");
+    }
+    _stage = Stage::Done;
+    return used;
+}
+
+void OtaUpdater::releaseBuffers() {
+    free(_inflator);
+    _inflator = nullptr;
+    free(_dict);
+    _dict = nullptr;
+    _dictOffset = 0;
+}
+
+uint32_t OtaUpdater::crc32Update(uint32_t crc, const uint8_t *data, size_t len) {
+    // Nibble-wise CRC-32 (IEEE 802.3, as used by gzip): 64 bytes of table
+    // instead of 1 KB, and still far faster than the flash writes it sits beside.
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    };
+    crc = ~crc;
+    while (len--) {
+        crc = table[(crc ^ *data) & 0x0f] ^ (crc >> 4);
+        crc = table[(crc ^ (*data >> 4)) & 0x0f] ^ (crc >> 4);
+        data++;
+    }
+    return ~crc;
+}
+
+void OtaUpdater::toHex(const uint8_t *data, size_t len, char *out) {
+    static const char hex[] = "0123456789abcdef";
+    for (size_t i = 0; i < len; i++) {
+        *out++ = hex[data[i] >> 4];
+        *out++ = hex[data[i] & 0x0f];
+    }
+    *out = '\0';
+}
+
+bool OtaUpdater::parseHex(const char *hex, uint8_t *out, size_t outLen) {
+    // Form fields and headers may carry surrounding whitespace.
+    while (isspace((unsigned char)*hex)) hex++;
+    size_t length = strlen(hex);
+    while (length > 0 && isspace((unsigned char)hex[length - 1])) length--;
+    if (length != outLen * 2) return false;
+    for (size_t i = 0; i < outLen * 2; i++) {
+        char c = hex[i];
+        uint8_t v;
+        if (c >= '0' && c <= '9') v = c - '0';
+        else if (c >= 'a' && c <= 'f') v = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') v = c - 'A' + 10;
+        else return false;
+        if (i % 2 == 0) out[i / 2] = v << 4;
+        else out[i / 2] |= v;
+    }
+    return true;
+}
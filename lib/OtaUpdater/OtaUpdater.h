@@ -0,0 +1,175 @@
+#ifndef OTAUPDATER_H
+#define OTAUPDATER_H
+
+/**
+ * @file OtaUpdater.h
+ * @brief Streaming firmware/filesystem update pipeline.
+ *
+ * Uploaded chunks are fed to OtaUpdater::write() as they arrive. If the upload
+ * starts with the gzip magic bytes it is inflated on the fly, otherwise it is
+ * passed straight through. Decoded bytes go to an OtaSink, which on the device
+ * wraps the Arduino `Update` class. The updater itself does not use Arduino: it
+ * needs only tinfl (miniz), mbedTLS SHA-256 and a microsecond clock, so the host
+ * tests in test/host drive it with a mock sink.
+ *
+ * Integrity checks performed before the sink is finalised:
+ * - optional SHA-256 of the uploaded file (compressed or not)
+ * - gzip trailer CRC-32 and length, for compressed uploads
+ */
+
+#include <cstddef>
+#include <cstdint>
+
+// tinfl lives in ROM on the ESP32 targets; newer IDF versions expose it as
+// <miniz.h>, older ones only as <rom/miniz.h>. On the host it is plain miniz.
+#if __has_include(<miniz.h>)
+    #include <miniz.h>
+#else
+    #include <rom/miniz.h>
+#endif
+#include <mbedtls/sha256.h>
+
+/// @brief Destination for decoded update bytes.
+class OtaSink {
+public:
+    virtual ~OtaSink() {}
+    virtual bool begin(size_t size, int command) = 0;
+    virtual size_t write(uint8_t *data, size_t len) = 0;
+    virtual bool end(bool evenIfRemaining) = 0;
+    virtual void abort() = 0;
+    virtual const char *errorString() = 0;
+};
+
+#if defined(ESP_PLATFORM)
+#include <Update.h>
+#else
+#define UPDATE_SIZE_UNKNOWN 0xFFFFFFFF
+#define U_FLASH 0
+#define U_SPIFFS 100
+#endif
+
+#if defined(ESP_PLATFORM)
+
+/// @brief OtaSink backed by the Arduino `Update` singleton.
+class UpdateClassSink : public OtaSink {
+public:
+    bool begin(size_t size, int command) override { return Update.begin(size, command); }
+    size_t write(uint8_t *data, size_t len) override { return Update.write(data, len); }
+    bool end(bool evenIfRemaining) override { return Update.end(evenIfRemaining); }
+    void abort() override { Update.abort(); }
+    const char *errorString() override { return Update.errorString(); }
+};
+#endif
+
+class OtaUpdater {
+public:
+    /// @brief Throughput figures for the last (or current) update.
+    struct Stats {
+        size_t receivedBytes = 0;   ///< Bytes received from the client
+        size_t writtenBytes = 0;    ///< Bytes written to the sink (after inflating)
+        uint32_t elapsedMs = 0;     ///< Time from begin() to end()
+        uint32_t flashWriteMs = 0;  ///< Time spent inside OtaSink::write()
+        bool compressed = false;    ///< Upload was gzip-compressed
+    };
+
+    /// @brief Microsecond clock used for the Stats timings.
+    using Clock = uint64_t (*)();
+
+    /// @brief esp_timer on the device, std::chrono::steady_clock on the host.
+    static uint64_t systemClockUs();
+
+    explicit OtaUpdater(OtaSink &sink, Clock clockUs = systemClockUs);
+    ~OtaUpdater();
+
+    /// @brief Start a new update.
+    /// @param command U_FLASH or U_SPIFFS.
+    /// @param expectedSha256 Hex SHA-256 of the uploaded file, or null/empty to skip the check.
+    /// @return false if the sink could not be started or the hash is malformed.
+    bool begin(int command, const char *expectedSha256 = nullptr);
+
+    /// @brief Feed the next chunk of the uploaded file.
+    /// @return false once an error has occurred; see error().
+    bool write(uint8_t *data, size_t len);
+
+    /// @brief Verify the upload and finalise the sink.
+    /// @return true if the update was verified and committed.
+    bool end();
+
+    /// @brief Abandon the update and release buffers.
+    void abort();
+
+    bool hasError() const { return _error[0] != '\0'; }
+    /// @brief First error of the current update, empty if none.
+    const char *error() const { return _error; }
+    const Stats &stats() const { return _stats; }
+
+    /// @brief SHA-256 of the uploaded file as lower case hex, valid after end().
+    const char *sha256() const { return _digestHex; }
+
+    /// @brief Average upload throughput in bytes/s since begin().
+    uint32_t bytesPerSecond() const;
+
+private:
+    enum class Stage : uint8_t {
+        Idle,
+        Detect,         // waiting for the first two bytes
+        GzipHeader,     // parsing the gzip member header
+        Inflate,        // raw deflate stream
+        GzipTrailer,    // CRC-32 + ISIZE
+        Passthrough,    // uncompressed image
+        Done
+    };
+
+    // gzip header flag bits (RFC 1952)
+    static constexpr uint8_t GZIP_FHCRC = 0x02;
+    static constexpr uint8_t GZIP_FEXTRA = 0x04;
+    static constexpr uint8_t GZIP_FNAME = 0x08;
+    static constexpr uint8_t GZIP_FCOMMENT = 0x10;
+
+    /// @brief Longest error message kept, e.g. a SHA-256 mismatch with both hashes.
+    static constexpr size_t ERROR_LENGTH = 192;
+
+    OtaSink &_sink;
+    Clock _clockUs;
+    Stage _stage = Stage::Idle;
+    char _error[ERROR_LENGTH];
+    Stats _stats;
+    uint64_t _startUs = 0;
+
+    uint64_t _flashWriteUs = 0;
+
+    bool _verifySha = false;
+    uint8_t _expectedSha[32];
+    uint8_t _digest[32];
+    char _digestHex[65];
+    mbedtls_sha256_context _sha;
+
+    // Inflate state, allocated only for compressed uploads.
+    tinfl_decompressor *_inflator = nullptr;
+    uint8_t *_dict = nullptr;
+    size_t _dictOffset = 0;
+    uint32_t _crc = 0;
+
+    // Small fixed buffer for header/trailer bytes that may straddle chunks.
+    uint8_t _hdr[10];
+    size_t _hdrLen = 0;
+    uint8_t _gzipFlags = 0;
+    uint8_t _headerField = 0;       // index into the optional gzip header fields
+    uint16_t _skipRemaining = 0;    // FEXTRA payload still to skip
+
+    bool fail(const char *format, ...) __attribute__((format(printf, 2, 3)));
+    const char *sinkError();
+    bool sinkWrite(uint8_t *data, size_t len);
+    size_t parseGzipHeader(const uint8_t *data, size_t len);
+    void nextHeaderField();
+    size_t inflateChunk(const uint8_t *data, size_t len);
+    size_t readTrailer(const uint8_t *data, size_t len);
+    void releaseBuffers();
+
+    static uint32_t crc32Update(uint32_t crc, const uint8_t *data, size_t len);
+    /// @brief Lower case hex of data into out, which holds len * 2 + 1 chars.
+    static void toHex(const uint8_t *data, size_t len, char *out);
+    static bool parseHex(const char *hex, uint8_t *out, size_t outLen);
+};
+
+#endif // OTAUPDATER_H
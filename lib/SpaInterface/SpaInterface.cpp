@@ -1,4 +1,8 @@
 #include "SpaInterface.h"
+#include <Preferences.h>
+
+#undef SPA_LOG_MODULE_LEVEL
+#define SPA_LOG_MODULE_LEVEL SPA_LOG_LEVEL_SERIAL
 
 #define BAUD_RATE 38400
 
@@ -22,12 +26,19 @@ SpaInterface::SpaInterface() : port(SPA_SERIAL) {}
  * @note On ESP32-C6, SPA_SERIAL is Serial1 (UART1). On ESP32-S3, it's Serial2.
  */
 void SpaInterface::begin() {
+    _instance = this;
+
+    // The UART driver's event task calls this when bytes arrive (FIFO threshold
+    // or RX idle timeout), so readers can block instead of polling available().
+    _rxReady = xSemaphoreCreateBinary();
+    SPA_SERIAL.onReceive([]() {
+        if (_instance != nullptr && _instance->_rxReady != nullptr) xSemaphoreGive(_instance->_rxReady);
+    });
+
     SPA_SERIAL.setRxBufferSize(1024);  //required for unit testing
     SPA_SERIAL.setTxBufferSize(1024);  //required for unit testing
     SPA_SERIAL.begin(BAUD_RATE, SERIAL_8N1, RX_PIN, TX_PIN);
-    SPA_SERIAL.setTimeout(250);
-
-    _instance = this;
+    SPA_SERIAL.setTimeout(LinkTiming::DEFAULT_GAP_TIMEOUT_MS);
 }
 
 SpaInterface::~SpaInterface() {}
@@ -38,19 +49,38 @@ void SpaInterface::setSpaPollFrequency(int updateFrequency) {
 
 String SpaInterface::flushSerialReadBuffer(bool returnData) {
     int x = 0;
+    uint32_t flushed = 0;
     String flushedData;
 
+    // Bytes already pulled from the UART come first. They arrived while a
+    // response was being read, so they are not stray.
+    while (_rxHead < _rxLength) {
+        const uint8_t byte = _rx[_rxHead++];
+        if (returnData) {
+            flushedData += (char)byte;
+        }
+    }
+    _rxHead = _rxLength = 0;
+
     debugV("Flushing serial stream - %i bytes in the buffer", port.available());
     while (port.available() > 0 && x++ < 5120) {
         int byte = port.read();
+        flushed++;
         if (returnData) {
             flushedData += (char)byte; // Append to buffer
         }
-        debugV("%02X,", byte); // Log each byte
+        debugDeferredV("%02X,", byte); // Log each byte
     }
 
     debugD("Flushed serial stream - %i bytes remaining in the buffer", port.available());
 
+    // Without returnData this is the pre-command flush, so anything still in
+    // the UART arrived when no response was expected.
+    if (!returnData && flushed > 0) {
+        _link.strayBytes += flushed;
+        _link.strayFlushes++;
+    }
+
     if (returnData && !flushedData.isEmpty()) {
         debugV("Flushed data (%i bytes): %s", flushedData.length(), flushedData.c_str());
     }
@@ -59,39 +89,160 @@ String SpaInterface::flushSerialReadBuffer(bool returnData) {
 }
 
 
-void SpaInterface::sendCommand(String cmd) {
+void SpaInterface::sendCommand(String cmd, bool calibrated, bool mayProbe) {
+
+    // Property writes are synchronous; a raw console command still on the link gives way.
+    if (_rawState != RawState::Idle) finishRawCommand(true);
+    if (_macroState != MacroState::Idle) finishKeypadMacro("interrupted by a spa write");
 
     flushSerialReadBuffer();
+    if (cmd != "RF") _lastCommandMs = millis();
 
     debugV("Sending - '%s'",cmd.c_str());
-    port.print('\n');
-    port.flush();
-    delay(50); // **TODO** is this needed?
+    const LinkTiming::WakeStep &wake = calibrated ? wakeStepFor(mayProbe) : LinkTiming::WAKE_STEPS[0];
+    const uint32_t wakeStart = micros();
+    if (wake.newline) {
+        port.print('\n');
+        port.flush();
+    }
+    if (wake.delayMs > 0) delay(wake.delayMs);
+    _link.wakeUs.record(micros() - wakeStart);
     port.printf("%s\n", cmd.c_str());
     port.flush();
 
-    ulong timeout = millis() + 1000; // wait up to 1 sec for a response
+    const uint32_t sent = micros();
+    _link.commands++;
 
-    debugV("Start waiting for a response");
-    while (port.available()==0 and millis()<timeout) {}
+    const uint32_t timeoutMs = calibrated ? _timing.responseTimeoutMs(cmd) : LinkTiming::DEFAULT_RESPONSE_TIMEOUT_MS;
+    debugV("Start waiting for a response (%u ms)", timeoutMs);
+    const bool responded = waitForRx(timeoutMs);
     debugV("Finish waiting");
 
-    _resultRegistersDirty = true; // we're trying to write to the registers so we can assume that they will now be dirty
+    if (responded) {
+        const uint32_t latency = micros() - sent;
+        _link.firstByteUs.record(latency);
+        _timing.recordResponse(cmd, latency);
+    } else {
+        _link.noResponse++;
+        _timing.recordNoResponse(cmd, timeoutMs);
+    }
 }
 
-String SpaInterface::sendCommandReturnResult(String cmd) {
-    sendCommand(cmd);
-    String result = port.readStringUntil('\r');
-    port.read(); // get rid of the trailing LF char
+String SpaInterface::sendCommandReturnResult(String cmd, bool calibrated, bool mayProbe) {
+    SPA_HEAP_TAG(SpaInterface);
+    const uint32_t start = micros();
+    sendCommand(cmd, calibrated, mayProbe);
+    String result = readResponseUntil('\r');
+    readResponseByte(); // get rid of the trailing LF char
+    _link.commandFrameUs.record(micros() - start);
     debugV("Read - '%s'",result.c_str());
     return result;
 }
 
-bool SpaInterface::sendCommandCheckResult(String cmd, String expected){
-    String result = sendCommandReturnResult(cmd);
-    bool outcome = result == expected;
-    debugD("Sent command '%s', expected '%s', got '%s'",cmd.c_str(),expected.c_str(),result.c_str());
-    return outcome;
+void SpaInterface::loadWakeCalibration() {
+    Preferences prefs;
+    if (prefs.begin("eSpa-link", true)) {
+        if (prefs.getString("wakeSver") == SVER.get()) {
+            _timing.restoreWake(prefs.getInt("wakeLevel"));
+            debugI("Wake-up calibration for '%s' restored: level %u", SVER.get().c_str(), _timing.wakeLevel());
+        }
+        prefs.end();
+    }
+    _wakeCalibrationReady = true;
+}
+
+bool SpaInterface::wakeCalibrated(bool mayProbe) const {
+    return _wakeCalibrationReady && (mayProbe || _timing.wakeSettled());
+}
+
+const LinkTiming::WakeStep &SpaInterface::wakeStepFor(bool mayProbe) const {
+    return wakeCalibrated(mayProbe) ? _timing.wakeStep() : LinkTiming::WAKE_STEPS[0];
+}
+
+void SpaInterface::recordWakeOutcome(bool ok) {
+    if (!_wakeCalibrationReady || !_timing.recordWakeOutcome(ok)) return;
+
+    const LinkTiming::WakeStep &wake = _timing.wakeStep();
+    debugI("Wake-up calibrated for '%s': level %u, newline %s, pause %u ms", SVER.get().c_str(), _timing.wakeLevel(), wake.newline ? "yes" : "no", wake.delayMs);
+    Preferences prefs;
+    if (prefs.begin("eSpa-link", false)) {
+        prefs.putString("wakeSver", SVER.get());
+        prefs.putInt("wakeLevel", _timing.wakeLevel());
+        prefs.end();
+    } else {
+        debugE("Failed to open Preferences for writing");
+    }
+}
+
+bool SpaInterface::waitForRx(uint32_t timeoutMs) {
+    const uint32_t start = millis();
+    while (port.available() == 0) {
+        const uint32_t waited = millis() - start;
+        if (waited >= timeoutMs) return false;
+        if (_rxReady != nullptr) {
+            // A stale give from data that has since been read just costs one more pass.
+            xSemaphoreTake(_rxReady, pdMS_TO_TICKS(timeoutMs - waited));
+        } else {
+            delay(1);
+        }
+    }
+    return true;
+}
+
+int SpaInterface::readResponseByte() {
+    if (_rxHead == _rxLength) {
+        if (port.available() == 0) {
+            const uint32_t gapTimeoutMs = _timing.gapTimeoutMs();
+            const uint32_t waitStart = micros();
+            const bool received = waitForRx(gapTimeoutMs);
+            const uint32_t waited = micros() - waitStart;
+            _rxWaitMicros += waited;
+            if (!received) {
+                _timing.recordGapTimeout(gapTimeoutMs);
+                return -1;
+            }
+            _timing.recordGap(waited);
+        }
+        size_t available = port.available();
+        if (available > RX_CHUNK_LENGTH) available = RX_CHUNK_LENGTH;
+        _rxLength = port.readBytes(_rx, available);
+        _rxHead = 0;
+        if (_rxLength == 0) return -1;
+    }
+    return _rx[_rxHead++];
+}
+
+String SpaInterface::readResponseUntil(char terminator) {
+    String result;
+    int c;
+    while ((c = readResponseByte()) >= 0 && c != terminator) {
+        result += (char)c;
+    }
+    return result;
+}
+
+bool SpaInterface::sendCommandCheckResult(String cmd, String expected, uint8_t retries){
+    // Without a retry a failed wake-up probe would lose the write (a key press), so only probe with one left.
+    const bool mayProbe = retries > 0;
+    for (uint8_t attempt = 0; attempt <= retries; attempt++) {
+        if (attempt > 0) {
+            _link.commandRetries++;
+            delay(COMMAND_RETRY_BACKOFF_MS << (attempt - 1));
+        }
+        // A retry goes back to the original wake-up and timeout in case the calibrated ones are too tight.
+        String result = sendCommandReturnResult(cmd, attempt == 0, mayProbe);
+        debugD("Sent command '%s', expected '%s', got '%s'",cmd.c_str(),expected.c_str(),result.c_str());
+        if (attempt == 0 && wakeCalibrated(mayProbe)) recordWakeOutcome(result == expected);
+        if (result == expected) {
+            if (attempt > 0) _link.retryRecoveries++;
+            return true;
+        }
+        _link.echoMismatches++;
+        if (attempt < retries) debugW("Command '%s' got '%s' instead of '%s', retrying", cmd.c_str(), result.c_str(), expected.c_str());
+    }
+    // Without a confirmation the controller state is unknown, so read it back soon.
+    _resultRegistersDirty = true;
+    return false;
 }
 
 void SpaInterface::_processDebugCommand() {
@@ -101,36 +252,104 @@ void SpaInterface::_processDebugCommand() {
     if (!cmd.startsWith("ss ") && !cmd.startsWith("SS ")) return;
 
     String payload = cmd.substring(3);
-    debugI("TX: %s", payload.c_str());
-
-    _instance->flushSerialReadBuffer();
-    _instance->port.print('\n');
-    _instance->port.flush();
-    delay(50);
-    _instance->port.printf("%s\n", payload.c_str());
-    _instance->port.flush();
-
-    // Wait up to 2s for first byte, then collect until 500ms gap
-    String response = "";
-    unsigned long start = millis();
-    while (!_instance->port.available() && millis() - start < 2000) {}
-    if (_instance->port.available()) {
-        unsigned long lastByte = millis();
-        while (millis() - lastByte < 500) {
-            while (_instance->port.available()) {
-                response += (char)_instance->port.read();
-                lastByte = millis();
+    if (_instance->queueRawCommand(payload, [](const char *line) { Debug.printf("%s\n", line); })) {
+        debugI("TX: %s", payload.c_str());
+    } else {
+        debugW("Raw command queue full, dropped: %s", payload.c_str());
+    }
+}
+
+bool SpaInterface::queueRawCommand(const String &payload, std::function<void(const char *)> sink) {
+    // Called from the telnet callback (loop task) and WebSocket handlers (async TCP task).
+    std::lock_guard<std::mutex> lock(_rawQueueMutex);
+    if (_rawQueueCount >= RAW_QUEUE_LENGTH) return false;
+    RawCommand &command = _rawQueue[(_rawQueueHead + _rawQueueCount) % RAW_QUEUE_LENGTH];
+    command.payload = payload;
+    command.sink = std::move(sink);
+    _rawQueueCount++;
+    return true;
+}
+
+bool SpaInterface::serviceRawCommand() {
+    const uint32_t now = millis();
+
+    switch (_rawState) {
+        case RawState::Idle: {
+            {
+                std::lock_guard<std::mutex> lock(_rawQueueMutex);
+                if (_rawQueueCount == 0) return false;
+                _rawActive = std::move(_rawQueue[_rawQueueHead]);
+                _rawQueue[_rawQueueHead] = RawCommand();
+                _rawQueueHead = (_rawQueueHead + 1) % RAW_QUEUE_LENGTH;
+                _rawQueueCount--;
             }
+            flushSerialReadBuffer();
+            port.print('\n');
+            _rawBytes = 0;
+            _rawLineLength = 0;
+            _rawState = RawState::Waking;
+            _rawStateSince = now;
+            return true;
         }
+
+        case RawState::Waking:
+            if (now - _rawStateSince < RAW_WAKE_DELAY_MS) return true;
+            port.printf("%s\n", _rawActive.payload.c_str());
+            _rawState = RawState::AwaitingResponse;
+            _rawStateSince = now;
+            return true;
+
+        case RawState::AwaitingResponse:
+            if (port.available() == 0) {
+                if (now - _rawStateSince >= RAW_FIRST_BYTE_TIMEOUT_MS) finishRawCommand(false);
+                return true;
+            }
+            _rawState = RawState::Receiving;
+            _rawLastByte = now;
+            [[fallthrough]];
+
+        case RawState::Receiving:
+            while (port.available() > 0) {
+                const int c = port.read();
+                _rawBytes++;
+                _rawLastByte = now;
+                if (c == '\r') continue;
+                if (c == '\n') {
+                    emitRawLine();
+                    continue;
+                }
+                _rawLine[_rawLineLength++] = (char)c;
+                if (_rawLineLength == RAW_LINE_LENGTH) emitRawLine();
+            }
+            if (now - _rawLastByte >= RAW_IDLE_GAP_MS) finishRawCommand(false);
+            return true;
     }
+    return false;
+}
+
+void SpaInterface::emitRawLine() {
+    char line[RAW_LINE_LENGTH + 8];
+    snprintf(line, sizeof(line), "RX: %.*s", (int)_rawLineLength, _rawLine);
+    _rawLineLength = 0;
+    if (_rawActive.sink) _rawActive.sink(line);
+}
+
+void SpaInterface::finishRawCommand(bool interrupted) {
+    if (_rawLineLength > 0) emitRawLine();
 
-    if (response.length() > 0) {
-        debugI("RX:\n%s", response.c_str());
+    char summary[64];
+    if (interrupted) {
+        snprintf(summary, sizeof(summary), "RX: interrupted by a spa write after %u bytes", (unsigned)_rawBytes);
+    } else if (_rawBytes == 0) {
+        snprintf(summary, sizeof(summary), "RX: (no response)");
     } else {
-        debugI("RX: (no response)");
+        snprintf(summary, sizeof(summary), "RX: done, %u bytes", (unsigned)_rawBytes);
     }
+    if (_rawActive.sink) _rawActive.sink(summary);
 
-    _instance->_resultRegistersDirty = true;
+    _rawActive = RawCommand();
+    _rawState = RawState::Idle;
+    _resultRegistersDirty = true;
 }
 
 bool SpaInterface::setRB_TP_Pump1(int mode){
@@ -229,11 +448,12 @@ bool SpaInterface::setRB_TP_Light(int mode){
         debugD("No RB_TP_Light change detected - current %i, new %i", RB_TP_Light.get(), mode);
         return true;
     }
-    if (sendCommandCheckResult("W14", "W14")) {
-        RB_TP_Light.update(mode);
-        return true;
-    }
-    return false;
+    // W14 toggles, so a retry after a lost echo could switch the light back. Read
+    // the registers back instead, whatever the outcome.
+    const bool outcome = sendCommandCheckResult("W14", "W14", 0);
+    _resultRegistersDirty = true;
+    if (outcome) RB_TP_Light.update(mode);
+    return outcome;
 }
 
 bool SpaInterface::setHELE(bool mode){
@@ -353,17 +573,205 @@ bool SpaInterface::setVMAX(int mode){
 }
 
 
-bool SpaInterface::sendKey(SpaKey key) {
-    String cmd;
-    String expected;
-    switch (key) {
-        case SpaKey::Up:     cmd = "W08"; expected = "W8";  break;
-        case SpaKey::Ok:     cmd = "W09"; expected = "W9";  break;
-        case SpaKey::Down:   cmd = "W10"; expected = "W10"; break;
-        case SpaKey::Invert: cmd = "W11"; expected = "W11"; break;
+bool SpaInterface::keyCommand(uint8_t key, const char *&cmd, const char *&expected) {
+    switch ((SpaKey)key) {
+        case SpaKey::Up:     cmd = "W08"; expected = "W8";  return true;
+        case SpaKey::Ok:     cmd = "W09"; expected = "W9";  return true;
+        case SpaKey::Down:   cmd = "W10"; expected = "W10"; return true;
+        case SpaKey::Invert: cmd = "W11"; expected = "W11"; return true;
         default: return false;
     }
-    return sendCommandCheckResult(cmd, expected);
+}
+
+bool SpaInterface::sendKey(SpaKey key) {
+    const char *cmd;
+    const char *expected;
+    if (!keyCommand((uint8_t)key, cmd, expected)) return false;
+    // A repeated key press is a second press, so no retries. What it changed is
+    // only known from the registers, so always read them back.
+    const bool outcome = sendCommandCheckResult(cmd, expected, 0);
+    _resultRegistersDirty = true;
+    return outcome;
+}
+
+bool SpaInterface::startKeypadMacro(const String &macro, std::function<void(const KeypadMacroProgress &)> progress) {
+    if (_macroState != MacroState::Idle) return false;
+
+    static const char *const KEY_NAMES[] = {"up", "ok", "down", "invert"};
+    MacroStep steps[MACRO_MAX_STEPS];
+    size_t length = 0;
+    int pauseMs = -1;
+
+    size_t start = 0;
+    while (start < macro.length()) {
+        int end = start;
+        while (end < (int)macro.length() && macro[end] != ',' && macro[end] != ' ') end++;
+        String token = macro.substring(start, end);
+        start = end + 1;
+        if (token.isEmpty()) continue;
+        token.toLowerCase();
+
+        if (isdigit((unsigned char)token[0])) {
+            pauseMs = token.toInt();
+            if (pauseMs > MACRO_MAX_PAUSE_MS) throw std::invalid_argument("Keypad macro pause too long");
+            continue;
+        }
+
+        int repeat = 1;
+        const int star = token.indexOf('*');
+        if (star >= 0) {
+            repeat = token.substring(star + 1).toInt();
+            if (repeat < 1) throw std::invalid_argument((String("Keypad key repeat '") + token + "' must be 1 or more").c_str());
+            token = token.substring(0, star);
+        }
+        int key = -1;
+        for (size_t k = 0; k < array_count(KEY_NAMES); k++) {
+            if (token == KEY_NAMES[k]) key = k;
+        }
+        if (key < 0) throw std::invalid_argument((String("Unknown keypad key '") + token + "'").c_str());
+        if (length + repeat > MACRO_MAX_STEPS) throw std::invalid_argument("Keypad macro too long");
+
+        for (int i = 0; i < repeat; i++) {
+            const uint16_t gap = pauseMs >= 0 ? pauseMs : (length == 0 ? 0 : MACRO_KEY_GAP_MS);
+            steps[length++] = {(uint8_t)key, gap};
+            pauseMs = -1;
+        }
+    }
+    if (length == 0) throw std::invalid_argument("Keypad macro has no keys");
+    // A pause delays the key after it, so a trailing one would do nothing.
+    if (pauseMs >= 0) throw std::invalid_argument("Keypad macro ends with a pause, which has no key to delay");
+
+    // Macros go ahead of raw console commands, like property writes.
+    if (_rawState != RawState::Idle) finishRawCommand(true);
+
+    memcpy(_macroSteps, steps, sizeof(MacroStep) * length);
+    _macroLength = length;
+    _macroStep = 0;
+    _macroSink = std::move(progress);
+    _macroProgress.state = KeypadMacroProgress::State::Running;
+    _macroProgress.id++;
+    _macroProgress.confirmed = 0;
+    _macroProgress.steps = length;
+    _macroProgress.error = "";
+    debugI("Keypad macro %u: %u keys", _macroProgress.id, (unsigned)length);
+
+    // Flush once; each key still gets the wake-up the link needs.
+    flushSerialReadBuffer();
+    _macroState = MacroState::Gap;
+    _macroStateSince = millis();
+    return true;
+}
+
+bool SpaInterface::serviceKeypadMacro() {
+    const uint32_t now = millis();
+
+    switch (_macroState) {
+        case MacroState::Idle:
+            return false;
+
+        case MacroState::Gap: {
+            if (now - _macroStateSince < _macroSteps[_macroStep].gapMs) return true;
+            // Keys are never retried, so they never probe: only a settled level that needs no wake-up lets them go straight out.
+            const LinkTiming::WakeStep &wake = wakeStepFor(false);
+            if (wake.newline || wake.delayMs > 0) {
+                if (wake.newline) {
+                    port.print('\n');
+                    port.flush();
+                }
+                _macroDeadlineMs = wake.delayMs;
+                _macroState = MacroState::Waking;
+                _macroStateSince = now;
+                return true;
+            }
+            sendMacroKey();
+            return true;
+        }
+
+        case MacroState::Waking:
+            if (now - _macroStateSince < _macroDeadlineMs) return true;
+            sendMacroKey();
+            return true;
+
+        case MacroState::AwaitingEcho: {
+            const char *cmd;
+            const char *expected;
+            keyCommand(_macroSteps[_macroStep].key, cmd, expected);
+
+            while (port.available() > 0) {
+                const int c = port.read();
+                if (c != '\r' && c != '\n') {
+                    if (_macroEchoLength < sizeof(_macroEcho) - 1) _macroEcho[_macroEchoLength++] = (char)c;
+                    continue;
+                }
+                if (_macroEchoLength == 0) continue;    // end of the previous echo line
+
+                _macroEcho[_macroEchoLength] = '\0';
+                _timing.recordResponse(cmd, micros() - _macroSentUs);
+                const bool ok = strcmp(_macroEcho, expected) == 0;
+                if (wakeCalibrated(false)) recordWakeOutcome(ok);
+                if (!ok) {
+                    _link.echoMismatches++;
+                    char error[48];
+                    snprintf(error, sizeof(error), "key %u (%s) echoed '%s'", _macroStep + 1, cmd, _macroEcho);
+                    finishKeypadMacro(error);
+                    return true;
+                }
+
+                _macroProgress.confirmed = ++_macroStep;
+                if (_macroStep == _macroLength) {
+                    finishKeypadMacro(nullptr);
+                } else {
+                    if (_macroSink) _macroSink(_macroProgress);
+                    _macroState = MacroState::Gap;
+                    _macroStateSince = now;
+                }
+                return true;
+            }
+
+            if (now - _macroStateSince >= _macroDeadlineMs) {
+                _link.noResponse++;
+                _timing.recordNoResponse(cmd, _macroDeadlineMs);
+                if (wakeCalibrated(false)) recordWakeOutcome(false);
+                char error[48];
+                snprintf(error, sizeof(error), "key %u (%s) not echoed", _macroStep + 1, cmd);
+                finishKeypadMacro(error);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+void SpaInterface::sendMacroKey() {
+    const char *cmd;
+    const char *expected;
+    keyCommand(_macroSteps[_macroStep].key, cmd, expected);
+
+    port.printf("%s\n", cmd);
+    port.flush();
+    _link.commands++;
+    _lastCommandMs = millis();
+    _macroSentUs = micros();
+    _macroEchoLength = 0;
+    // The echo is short: the first byte's timeout plus one gap covers the whole line.
+    _macroDeadlineMs = _timing.responseTimeoutMs(cmd) + _timing.gapTimeoutMs();
+    _macroState = MacroState::AwaitingEcho;
+    _macroStateSince = millis();
+}
+
+void SpaInterface::finishKeypadMacro(const char *error) {
+    _macroState = MacroState::Idle;
+    _macroProgress.state = error == nullptr ? KeypadMacroProgress::State::Done : KeypadMacroProgress::State::Aborted;
+    _macroProgress.error = error == nullptr ? "" : error;
+    if (error != nullptr) {
+        debugW("Keypad macro %u aborted after %u of %u keys: %s", _macroProgress.id, _macroProgress.confirmed, _macroProgress.steps, error);
+    } else {
+        debugI("Keypad macro %u done", _macroProgress.id);
+    }
+    // Whatever the keys changed is only known from the registers.
+    _resultRegistersDirty = true;
+    if (_macroSink) _macroSink(_macroProgress);
+    _macroSink = nullptr;
 }
 
 /// @brief Set the water temperature set point * 10 (380 = 38.0)
@@ -653,37 +1061,83 @@ bool SpaInterface::setSpaDayOfWeek(int d){
 bool SpaInterface::setSpaTime(time_t t){
     debugD("setSpaTime");
 
-    String tmp;
-    bool outcome;
-
-    tmp = String(year(t) % 100);
-    outcome = sendCommandCheckResult("S01:"+tmp, tmp);
-    delay(100);
-
-    tmp = String(month(t));
-    outcome = outcome && sendCommandCheckResult("S02:"+tmp,tmp);
-    delay(100);
-
-    tmp = String(day(t));
-    outcome = outcome && sendCommandCheckResult("S03:"+tmp,tmp);
-    delay(100);
-
-    tmp = String(hour(t));
-    outcome = outcome && sendCommandCheckResult("S04:"+tmp,tmp);
-    delay(100);
-
-    tmp = String(minute(t));
-    outcome = outcome && sendCommandCheckResult("S05:"+tmp,tmp);
-    delay(100);
+    const bool outcome = writeSpaTime(t, ClockSync::ALL_FIELDS);
+    if (outcome) SpaTime.update(t);
+    return outcome;
+}
 
+bool SpaInterface::writeSpaTime(time_t t, uint8_t fields) {
+    struct ClockWrite {
+        uint8_t field;
+        const char *command;
+        int value;
+    };
+    const ClockWrite writes[] = {
+        {ClockSync::YEAR, "S01:", year(t) % 100},
+        {ClockSync::MONTH, "S02:", month(t)},
+        {ClockSync::DAY, "S03:", day(t)},
+        {ClockSync::HOUR, "S04:", hour(t)},
+        {ClockSync::MINUTE, "S05:", minute(t)},
+    };
+
+    // The controller needs a moment between writes. This is a pause between
+    // commands, not the learned gap that ends a response.
+    bool sent = false;
+    for (const ClockWrite &write : writes) {
+        if (!(fields & write.field)) continue;
+        if (sent) delay(CLOCK_WRITE_SETTLE_MS);
+        const String value = String(write.value);
+        if (!sendCommandCheckResult(String(write.command) + value, value)) return false;
+        sent = true;
+    }
+
+    if (!(fields & ClockSync::WEEKDAY)) return true;
+    if (sent) delay(CLOCK_WRITE_SETTLE_MS);
     int weekDay = weekday(t); // day of the week (1-7), Sunday is day 1 (Arduino Time Library)
     // Convert to the format required by Spa: day of the week (0-6), Monday is day 0
     if (weekDay == 1) weekDay = 6;
     else weekDay -= 2;
-    outcome = outcome && setSpaDayOfWeek(weekDay);
+    return setSpaDayOfWeek(weekDay);
+}
 
-    if (outcome) SpaTime.update(t);
-    return outcome;
+void SpaInterface::serviceClockSync() {
+    // R2 carries the clock; if it was carried over, this frame says nothing new.
+    if (_staleRegisters & 1) return;
+
+    const time_t now = time(nullptr);
+    struct tm local;
+    if (now < CLOCK_VALID_AFTER || localtime_r(&now, &local) == nullptr) return;
+
+    tmElements_t tm;
+    tm.Year = CalendarYrToTm(local.tm_year + 1900);
+    tm.Month = local.tm_mon + 1;
+    tm.Day = local.tm_mday;
+    tm.Hour = local.tm_hour;
+    tm.Minute = local.tm_min;
+    tm.Second = local.tm_sec;
+    const time_t spaTime = SpaTime.get();
+    _clock.recordSample(spaTime, makeTime(tm));
+
+    const int32_t correction = _clock.correctionS();
+    if (!_clockCorrection || correction == 0) return;
+
+    // Wait for a quiet link, and stay clear of the controller's minute
+    // rolling over between the writes.
+    if (millis() - _lastCommandMs < CLOCK_QUIET_MS || (long)(millis() - _nextClockCorrection) < 0) return;
+    if (second(spaTime) < 5 || second(spaTime) > 50) return;
+
+    const time_t target = spaTime + correction;
+    const uint8_t fields = ClockSync::differingFields(spaTime, target);
+    debugI("Spa clock is %i s off (drift %.1f ppm), moving it %i min (fields 0x%02x)", _clock.offsetS(), _clock.driftPpm(), correction / 60, fields);
+    if (writeSpaTime(target, fields)) {
+        SpaTime.update(target);
+        _statusVersion++;
+        _clock.recordCorrection();
+    } else {
+        debugW("Spa clock correction failed, retrying in %lu min", CLOCK_RETRY_MS / 60000);
+        _nextClockCorrection = millis() + CLOCK_RETRY_MS;
+        _resultRegistersDirty = true;
+    }
 }
 
 bool SpaInterface::setOutlet_Blower(int mode){
@@ -799,33 +1253,58 @@ bool SpaInterface::readStatus() {
     // 250ms (or whatever the timeout is) delay penality.  This in turn,
     // along with the other unavoidable delays can cause the status of
     // properties to bounce in certain UI's (apple devices, home assistant, etc)
-
-    debugD("Reading registers -");
-
+    // Bytes come from readResponseByte(), which pulls whatever the UART holds
+    // in one read and sleeps on the receive event in between.
+    //
+    // Fields are collected one register line at a time. Until a firmware
+    // profile has been resolved, lines are stored in the order read and the
+    // frame is validated against the generic minimums; a valid frame becomes
+    // the profile (where each register lives, how many fields it has, which
+    // one ends the frame). After that a line is matched by its header and only
+    // stored if it has the profile's number of fields, so a corrupt line (or a
+    // frame that does not start with RF:) only loses the registers it touched.
+    // The others keep their values from the last good frame and are reported
+    // by getStaleRegisters().
+
+    debugDeferredD("Reading registers -");
+    const uint32_t parseStart = micros();
+    const uint32_t rxWaitStart = _rxWaitMicros;
+
+    const bool profiled = _profile.valid;
+    FirmwareProfile detected;
     int field = 0;
+    int storeField = 0;
     int registerCounter = 0;
-    int currentRegisterSize = 0;
     int registerError = 0;
+    uint16_t freshRegisters = 0;
+    uint32_t fingerprint = 0;
+    bool wellFormed = true;     // every line so far has a known header and its minimum fields
     validStatusResponse = false;
     String statusResponseTmp = "";
-    int majorFirmwarwVersion = 0;
 
-    if (_initialised) {
-        uint spaceIndex = SVER.get().indexOf(' ', 4);
-        if (spaceIndex != -1) {
-            majorFirmwarwVersion = SVER.get().substring(4, spaceIndex).toInt(); // Skip the 'V' character
-        }
-        debugV("Firmware: %s, majorFirmwareVersion: %i", SVER.get().c_str(), majorFirmwarwVersion);
-    }
+    String line[LINE_MAX_FIELDS];
+    size_t lineLength = 0;
+    int lineRegister = -1;
+    bool lineOverflow = false;
 
     // read the first field and validate the response
-    statusResponseRaw[field] = port.readStringUntil(',');
-    debugV("(%i,%s)",field,statusResponseRaw[field].c_str());
-    if (field == 0 && !statusResponseRaw[field].startsWith("RF:")) { // If the first field is not "RF:" stop we don't have the start of the register
-        debugE("Throwing exception - field: %i, value: %s", field, statusResponseRaw[field].c_str());
+    String firstField = readResponseUntil(',');
+    debugDeferredV("(%i,%s)",field,firstField);
+    statusResponseTmp = firstField+",";
+    if (firstField.startsWith("RF:")) {
+        statusResponseRaw[storeField++] = firstField;
+    } else if (!profiled) { // If the first field is not "RF:" stop we don't have the start of the register
+        _link.statusFrameBytes.record(firstField.length());
+        debugE("Throwing exception - field: %i, value: %s", field, firstField.c_str());
         return false;
+    } else {
+        // Positions are known, so pick up whole registers from here on. Unless it
+        // is empty or ends a line, this field starts a line with no valid header,
+        // which is dropped.
+        debugW("Frame does not start with RF: ('%s'), resynchronising on register headers", firstField.c_str());
+        wellFormed = false;
+        if (!firstField.isEmpty() && firstField.indexOf('\n') < 0) line[lineLength++] = firstField;
     }
-    statusResponseTmp = statusResponseRaw[field]+",";
     field++;
 
     bool lastByteWasColon = false;
@@ -836,127 +1315,247 @@ bool SpaInterface::readStatus() {
         bool isEndOfData = false;
 
         // This block is based on port.readStringUntil(',') but adds handling for ':' and '\n' characters
-        char bytes[1];
-        if (port.readBytes(bytes, 1) != 1) {
-            bytes[0] = -1;
-        }
-        while(bytes[0] >= 0 && bytes[0] != ',') {
+        int c = readResponseByte();
+        while (c >= 0 && c != ',') {
             if (lastByteWasColon) {
                 registerData += ':'; // Add the colon to the buffer'
             }
-            if (bytes[0] == ':' && registerData.length() > 0) {
-                debugV("Read \":\", at end of field: %s, register number: %i, number: %i, total fields counted: %i, minimum fields: %i", statusResponseRaw[field-currentRegisterSize], field, registerCounter, currentRegisterSize, registerMinSize[registerCounter]);
+            if (c == ':' && registerData.length() > 0) {
+                debugDeferredV("Read \":\", at end of field: %s, register field: %i, line: %i", registerData, (int)lineLength, registerCounter);
                 lastByteWasColon = true;
                 break; // If we reach a colon and we have data in the buffer, we have reached the end of the current field
             } else {
                 lastByteWasColon = false;
             }
-            registerData += bytes[0]; // Append to buffer
-            if (bytes[0] == '\n') {
+            registerData += (char)c; // Append to buffer
+            if (c == '\n') {
                 isEndOfLine = true;
-                if (registerCounter >= 11 || (majorFirmwarwVersion < 3 && registerCounter >= 10)) {
-                    debugV("Read \"\\n\", at end of final register: %s, register number: %i, number: %i, total fields counted: %i, minimum fields: %i", statusResponseRaw[field-currentRegisterSize], field, registerCounter, currentRegisterSize, registerMinSize[registerCounter]);
+                const bool finalRegister = profiled
+                    ? lineRegister == _profile.finalRegister
+                    : registerCounter >= 11 || (detected.majorVersion < 3 && registerCounter >= 10);
+                if (finalRegister) {
+                    debugDeferredV("Read \"\\n\", at end of final register, line: %i", registerCounter);
                     isEndOfData = true;
                     break; // If we reach the last register we have finished reading...
                 }
             }
-            if (port.readBytes(bytes, 1) != 1) {
-                bytes[0] = -1;
-            }
+            c = readResponseByte();
         }
 
-        statusResponseRaw[field] = registerData;
-        debugV("(%i,%s)",field,statusResponseRaw[field].c_str());
+        debugDeferredV("(%i,%s)",field,registerData);
+        statusResponseTmp += registerData;
+        if (!isEndOfData && c >= 0) statusResponseTmp += ",";
+
+        if (lineLength == 0) lineRegister = registerIndex(registerData);
+        if (lineLength < LINE_MAX_FIELDS) {
+            line[lineLength++] = registerData;
+        } else {
+            lineOverflow = true;
+        }
 
         // if we have reached an end of line, we are at the end of the current register
         if (isEndOfLine) {
-            debugV("Completed reading register: %s, number: %i, total fields counted: %i, minimum fields: %i", statusResponseRaw[field-currentRegisterSize], registerCounter, currentRegisterSize, registerMinSize[registerCounter]);
-            if (registerMinSize[registerCounter] > currentRegisterSize) {
-                debugE("Throwing exception - not enough fields in register: %s number: %i, total fields counted: %i, minimum fields: %i", statusResponseRaw[field-currentRegisterSize], registerCounter, currentRegisterSize, registerMinSize[registerCounter]);
-                registerError++; // Instead of returning false, I want to read the complete response so it is available in the webinterface for debugging
+            const int reg = lineOverflow ? -1 : lineRegister;
+            const int currentRegisterSize = lineLength - 1; // fields before the line terminator
+            debugDeferredV("Completed reading register: %s, number: %i, total fields counted: %i", line[0], registerCounter, currentRegisterSize);
+
+            const bool shortRegister = registerCounter < (int)registerMinSize.size() && registerMinSize[registerCounter] > currentRegisterSize;
+            if (reg < 0 || shortRegister) wellFormed = false;
+            fingerprint = fingerprintLine(fingerprint, reg, lineLength);
+
+            if (!profiled) {
+                // In order, as read: this frame decides where each register lives.
+                if (shortRegister) {
+                    debugE("Throwing exception - not enough fields in register: %s number: %i, total fields counted: %i, minimum fields: %i", line[0].c_str(), registerCounter, currentRegisterSize, registerMinSize[registerCounter]);
+                    registerError++; // Instead of returning false, I want to read the complete response so it is available in the webinterface for debugging
+                }
+                if (reg >= 0) {
+                    detected.positions[reg] = storeField;
+                    detected.fields[reg] = lineLength;
+                    detected.finalRegister = reg;
+                }
+                if (reg == 1 && lineLength > 6) { // R3 carries the firmware version
+                    int spaceIndex = line[6].indexOf(' ', 4);
+                    if (spaceIndex != -1) {
+                        detected.majorVersion = line[6].substring(4, spaceIndex).toInt(); // Skip the 'V' character
+                    }
+                    debugV("Firmware: %s, majorFirmwarwVersion: %i", line[6].c_str(), detected.majorVersion);
+                }
+                for (size_t i = 0; i < lineLength && storeField < statusResponseMaxFields; i++) {
+                    statusResponseRaw[storeField++] = line[i];
+                }
+            } else if (reg >= 0 && _profile.positions[reg] >= 0 && lineLength == _profile.fields[reg]) {
+                const int position = _profile.positions[reg];
+                for (size_t i = 0; i < lineLength; i++) {
+                    statusResponseRaw[position + i] = line[i];
+                }
+                freshRegisters |= 1 << reg;
+            } else if (reg >= 0) {
+                debugE("Register %s has %i fields, expected %i - keeping its previous values", line[0].c_str(), (int)lineLength, _profile.fields[reg]);
+                registerError++;
+            } else {
+                debugD("Dropping a line without a register header ('%s', %i fields)", line[0].c_str(), (int)lineLength);
             }
+
             registerCounter++;
-            currentRegisterSize = 0;
-        } else {
-            currentRegisterSize++;
+            lineLength = 0;
+            lineOverflow = false;
         }
 
         if (isEndOfData) {
-            debugD("Reached end of data");
-            statusResponseTmp += statusResponseRaw[field];
+            debugDeferredD("Reached end of data");
             break;
         }
 
-        if (bytes[0] == -1) {
-            debugD("Reached end of stream");
-            statusResponseTmp += statusResponseRaw[field];
+        if (c < 0) {
+            debugDeferredD("Reached end of stream");
             break;
         }
 
-        statusResponseTmp = statusResponseTmp + statusResponseRaw[field]+",";
-
-        if (!_initialised) { // We only have to set these on the first read, they never change after that.
-            if (statusResponseRaw[field] == "R2") R2 = field;
-            else if (statusResponseRaw[field] == "R3") R3 = field;
-            else if (statusResponseRaw[field] == "R4") R4 = field;
-            else if (statusResponseRaw[field] == "R5") R5 = field;
-            else if (statusResponseRaw[field] == "R6") R6 = field;
-            else if (statusResponseRaw[field] == "R7") R7 = field;
-            else if (statusResponseRaw[field] == "R9") R9 = field;
-            else if (statusResponseRaw[field] == "RA") RA = field;
-            else if (statusResponseRaw[field] == "RB") RB = field;
-            else if (statusResponseRaw[field] == "RC") RC = field;
-            else if (statusResponseRaw[field] == "RE") RE = field;
-            else if (statusResponseRaw[field] == "RG") RG = field;
-
-            if (registerCounter == 1 && R3 > 0 && currentRegisterSize == 7) {
-                uint spaceIndex = statusResponseRaw[R3+6].indexOf(' ', 4);
-                if (spaceIndex != -1) {
-                    majorFirmwarwVersion = statusResponseRaw[R3+6].substring(4, spaceIndex).toInt(); // Skip the 'V' character
-                }
-                debugV("Firmware: %s, majorFirmwarwVersion: %i", statusResponseRaw[R3+6].c_str(), majorFirmwarwVersion);
-            }
-        }
-
         field++;
     }
 
     //Flush the remaining data from the buffer as the last field is meaningless
     statusResponseTmp = statusResponseTmp + flushSerialReadBuffer(true);
+    _link.statusFrameBytes.record(statusResponseTmp.length());
+    _link.registerErrors += registerError;
   
-    debugD("Response String: %s", statusResponseTmp.c_str());
+    debugDeferredD("Response String: %s", statusResponseTmp);
 
     statusResponse.update(statusResponseTmp);
-
-    if ((majorFirmwarwVersion > 2 && registerCounter < 12) || (majorFirmwarwVersion < 3 && registerCounter < 11)) {
-        debugE("Throwing exception - not enough registers, we only read: %i", registerCounter);
-        return false;
+    {
+        auto snapshot = std::make_shared<const String>(statusResponseTmp);
+        std::lock_guard<std::mutex> lock(_statusSnapshotMutex);
+        _statusSnapshot = std::move(snapshot);
     }
 
-    if (registerError > 0) {
-        debugE("Throwing exception - not enough fields in %i registers", registerError);
-        return false;
-    }
+    if (!profiled) {
+        const bool v2 = detected.majorVersion < 3;
+        detected.registerCount = v2 ? 11 : 12;
+        detected.minFields = v2 ? statusResponseV2MinFields : statusResponseMinFields;
 
-    if ((majorFirmwarwVersion > 2 && field < statusResponseMinFields) || (majorFirmwarwVersion < 3 && field < statusResponseV2MinFields)) {
-        debugE("Throwing exception - %i fields read expecting at least %i",field, statusResponseMinFields);
-        return false;
+        if (registerCounter < detected.registerCount) {
+            debugE("Throwing exception - not enough registers, we only read: %i", registerCounter);
+            return false;
+        }
+
+        if (registerError > 0) {
+            debugE("Throwing exception - not enough fields in %i registers", registerError);
+            return false;
+        }
+
+        if (field < detected.minFields) {
+            debugE("Throwing exception - %i fields read expecting at least %i",field, detected.minFields);
+            return false;
+        }
+
+        detected.fingerprint = fingerprint;
+        detected.valid = true;
+        _profile = detected;
+        _profileMismatches = 0;
+        _staleRegisters = 0;
+        debugI("Firmware profile: V%i, %u registers, final %s, fingerprint %08x", _profile.majorVersion, _profile.registerCount, registerName(_profile.finalRegister), _profile.fingerprint);
+    } else {
+        // A frame that is complete and sound but laid out differently means the
+        // controller changed (e.g. a firmware update); start again from scratch.
+        if (wellFormed && registerCounter >= _profile.registerCount && fingerprint != _profile.fingerprint) {
+            if (++_profileMismatches >= PROFILE_REDETECT_FRAMES) {
+                debugW("RF frame layout changed (fingerprint %08x, profile %08x) - re-detecting the firmware profile", fingerprint, _profile.fingerprint);
+                _profile.valid = false;
+                _profileMismatches = 0;
+                _link.profileRedetections++;
+                return false;
+            }
+        } else if (fingerprint == _profile.fingerprint) {
+            _profileMismatches = 0;
+        }
+
+        uint16_t expectedRegisters = 0;
+        for (size_t r = 0; r < REGISTER_COUNT; r++) {
+            if (_profile.positions[r] >= 0) expectedRegisters |= 1 << r;
+        }
+        if ((freshRegisters & expectedRegisters) == 0) {
+            debugE("Throwing exception - no complete register in the frame");
+            return false;
+        }
+        _staleRegisters = expectedRegisters & ~freshRegisters;
+        if (_staleRegisters != 0) {
+            _link.salvagedFrames++;
+            debugW("Frame salvaged, stale registers: %s", staleRegisterNames().c_str());
+        }
     }
 
     updateMeasures();
+    _statusVersion++;
     _resultRegistersDirty = false;
     validStatusResponse = true;
+    _lastParseMicros = (micros() - parseStart) - (_rxWaitMicros - rxWaitStart);
 
-    debugD("Reading registers - finish");
+    debugD("Reading registers - finish (%u us)", _lastParseMicros);
     return true;
 }
 
+int SpaInterface::registerIndex(const String &header) {
+    for (size_t r = 0; r < REGISTER_COUNT; r++) {
+        if (header == REGISTER_NAMES[r]) return r;
+    }
+    return -1;
+}
+
+SpaInterface::PumpCapabilities SpaInterface::PumpCapabilities::decode(const String &installState) {
+    PumpCapabilities capabilities;
+    const char *text = installState.c_str();
+    const char *firstDash = strchr(text, '-');
+    const char *lastDash = strrchr(text, '-');
+
+    capabilities.installed = text[0] == '1';
+    if (firstDash != nullptr && lastDash > firstDash) capabilities.speedType = atoi(firstDash + 1);
+
+    for (const char *c = lastDash != nullptr ? lastDash + 1 : text; *c != '\0'; c++) {
+        const int state = *c - '0';
+        if (state < 0 || state > 4 || capabilities.allows(state)) continue;
+        capabilities.states |= 1 << state;
+        capabilities.stateCount++;
+        if (state >= 1 && state <= 3) {
+            if (capabilities.minSpeed == 0 || state < capabilities.minSpeed) capabilities.minSpeed = state;
+            if (state > capabilities.maxSpeed) capabilities.maxSpeed = state;
+        }
+    }
+    capabilities.autoCapable = capabilities.allows(4);
+    return capabilities;
+}
+
+const SpaInterface::PumpCapabilities &SpaInterface::getPumpCapabilities(int pumpNumber) const {
+    static const PumpCapabilities none;
+    if (pumpNumber < 1 || pumpNumber > (int)PUMP_COUNT) return none;
+    return _pumpCapabilities[pumpNumber - 1];
+}
+
+uint32_t SpaInterface::fingerprintLine(uint32_t hash, int reg, size_t fields) {
+    if (hash == 0) hash = 2166136261u;
+    hash = (hash ^ (uint8_t)reg) * 16777619u;
+    hash = (hash ^ (uint8_t)fields) * 16777619u;
+    return hash;
+}
+
+String SpaInterface::staleRegisterNames() const {
+    String names;
+    for (size_t r = 0; r < REGISTER_COUNT; r++) {
+        if (!(_staleRegisters & (1 << r))) continue;
+        if (!names.isEmpty()) names += ",";
+        names += REGISTER_NAMES[r];
+    }
+    return names;
+}
+
 bool SpaInterface::isInitialised() { 
     return _initialised; 
 }
 
 
 void SpaInterface::updateStatus() {
+    SPA_HEAP_TAG(SpaInterface);
+    HeapTracker::beginPoll();
 
     flushSerialReadBuffer();
 
@@ -964,16 +1563,39 @@ void SpaInterface::updateStatus() {
     sendCommand("RF");
 
     _nextUpdateDue = millis() + FAILEDREADFREQUENCY;    
-    if (readStatus()) {
+    const bool steadyState = _initialised;
+    _link.polls++;
+    const uint32_t frameStart = micros();
+    const bool ok = readStatus();
+    _link.statusFrameUs.record(micros() - frameStart);
+
+    recordWakeOutcome(ok);
+
+    if (ok) {
         debugD("readStatus returned true");
-        _nextUpdateDue = millis() + (_updateFrequency * 1000);
+        // Stale registers are retried like a failed read; the rest of the frame is already in use.
+        _nextUpdateDue = millis() + (_staleRegisters != 0 ? FAILEDREADFREQUENCY : _updateFrequency * 1000);
         _initialised = true;
-        if (updateCallback != nullptr) { updateCallback(); }
+        if (!_wakeCalibrationReady) loadWakeCalibration();
+        serviceClockSync();
+        if (updateCallback != nullptr) {
+            // Publishing is not the poll's own work, so keep it out of the poll budget.
+            SPA_HEAP_TAG(Other);
+            updateCallback();
+        }
+    } else {
+        _link.pollRetries++;
+    }
+
+    if (!HeapTracker::samplePoll(steadyState)) {
+        debugW("Poll made %u allocations, budget is %u", HeapTracker::snapshot().lastPollAllocations, SPA_HEAP_ALLOC_BUDGET_PER_POLL);
     }
 }
 
 
 void SpaInterface::loop(){
+    SPA_HEAP_TAG(SpaInterface);
+
     if (!_debugInitialised) {
         Debug.setHelpProjectsCmds("ss <cmd> - Send raw command to spa serial and print response");
         Debug.setCallBackProjectCmds(&SpaInterface::_processDebugCommand);
@@ -985,6 +1607,20 @@ void SpaInterface::loop(){
         _lastWaitMessage = millis();
     }
 
+    if (_publishPending) {
+        _publishPending = false;
+        if (updateCallback != nullptr) { updateCallback(); }
+    }
+
+    // A keypad macro holds the link until its last key, then queued writes go
+    // ahead of raw console commands and polls, one per pass so their outcome is
+    // published before the next.
+    if (serviceKeypadMacro()) return;
+    if (serviceAsyncWrites()) return;
+
+    // The link is shared: polls wait until a raw console command has gone quiet.
+    if (serviceRawCommand()) return;
+
     if (_resultRegistersDirty) {
         _nextUpdateDue = millis() + 500;  // if we need to read the registers, pause a bit to see if there are more commands coming.
         _resultRegistersDirty = false;
@@ -996,6 +1632,115 @@ void SpaInterface::loop(){
 }
 
 
+uint32_t SpaInterface::queueWrite(const void *property, std::function<void()> commit, const String &key, const String &requested) {
+    const uint32_t ticket = ++_lastTicket;
+    _link.asyncWrites++;
+
+    if (!commit) {
+        recordWriteOutcome(ticket, (uint8_t)WriteState::Confirmed);
+        return ticket;
+    }
+
+    AsyncWrite *slot = nullptr;
+    for (AsyncWrite &write : _asyncWrites) {
+        if (write.ticket != 0 && write.property == property) {
+            debugD("Write %u to %s replaced by %u", write.ticket, write.key.c_str(), ticket);
+            recordWriteOutcome(write.ticket, (uint8_t)WriteState::Superseded);
+            _link.collapsedWrites++;
+            slot = &write;
+            break;
+        }
+        if (write.ticket == 0 && slot == nullptr) slot = &write;
+    }
+    if (slot == nullptr) {
+        recordWriteOutcome(ticket, (uint8_t)WriteState::Failed);
+        throw std::runtime_error("Write queue full");
+    }
+
+    slot->ticket = ticket;
+    slot->property = property;
+    slot->commit = std::move(commit);
+    slot->key = key;
+    slot->requested = requested;
+    slot->queuedMs = millis();
+
+    // Publish the pending value straight away.
+    pendingWritesChanged();
+    return ticket;
+}
+
+void SpaInterface::pendingWritesChanged() {
+    _statusVersion++;
+    _publishPending = true;
+
+    auto pending = std::make_shared<PendingWrites>();
+    for (const AsyncWrite &write : _asyncWrites) {
+        if (write.ticket != 0 && !write.key.isEmpty()) pending->emplace_back(write.key, write.requested);
+    }
+    std::lock_guard<std::mutex> lock(_pendingWritesMutex);
+    _pendingWrites = std::move(pending);
+}
+
+void SpaInterface::cancelWrite(const void *property) {
+    for (AsyncWrite &write : _asyncWrites) {
+        if (write.ticket == 0 || write.property != property) continue;
+        recordWriteOutcome(write.ticket, (uint8_t)WriteState::Superseded);
+        _link.collapsedWrites++;
+        write = AsyncWrite();
+        pendingWritesChanged();
+    }
+}
+
+bool SpaInterface::writeQueued(const void *property) const {
+    for (const AsyncWrite &write : _asyncWrites) {
+        if (write.ticket != 0 && write.property == property) return true;
+    }
+    return false;
+}
+
+void SpaInterface::recordWriteOutcome(uint32_t ticket, uint8_t state) {
+    _writeOutcomes[_nextWriteOutcome] = {ticket, state};
+    _nextWriteOutcome = (_nextWriteOutcome + 1) % WRITE_OUTCOMES;
+}
+
+SpaInterface::WriteState SpaInterface::getWriteState(uint32_t ticket) const {
+    if (ticket == 0) return WriteState::Unknown;
+    for (const AsyncWrite &write : _asyncWrites) {
+        if (write.ticket == ticket) return WriteState::Pending;
+    }
+    for (const WriteOutcome &outcome : _writeOutcomes) {
+        if (outcome.ticket == ticket) return (WriteState)outcome.state;
+    }
+    return WriteState::Unknown;
+}
+
+bool SpaInterface::serviceAsyncWrites() {
+    AsyncWrite *next = nullptr;
+    for (AsyncWrite &write : _asyncWrites) {
+        if (write.ticket == 0 || millis() - write.queuedMs < ASYNC_WRITE_SETTLE_MS) continue;
+        if (next == nullptr || (int32_t)(write.ticket - next->ticket) < 0) next = &write;
+    }
+    if (next == nullptr) return false;
+
+    // Out of the queue first: the commit goes through RWProperty::set(), which
+    // cancels anything queued for the property.
+    AsyncWrite write = std::move(*next);
+    *next = AsyncWrite();
+    // Republish without it even if the commit turns out to change nothing.
+    pendingWritesChanged();
+
+    WriteState state = WriteState::Confirmed;
+    try {
+        write.commit();
+    } catch (const std::exception &ex) {
+        debugE("Write %u to %s = '%s' failed, rolling back: %s", write.ticket, write.key.c_str(), write.requested.c_str(), ex.what());
+        state = WriteState::Failed;
+        _link.rolledBackWrites++;
+    }
+    recordWriteOutcome(write.ticket, (uint8_t)state);
+    return true;
+}
+
 void SpaInterface::setUpdateCallback(void (*f)()) {
     updateCallback = f;
 }
@@ -1008,6 +1753,7 @@ void SpaInterface::clearUpdateCallback() {
 
 void SpaInterface::updateMeasures() {
     #pragma region R2
+    _updatingRegister = 0;
     MainsCurrent.update(statusResponseRaw[R2+1].toInt());
     MainsVoltage.update(statusResponseRaw[R2+2].toInt());
     CaseTemperature.update(statusResponseRaw[R2+3].toInt());
@@ -1052,6 +1798,7 @@ void SpaInterface::updateMeasures() {
     Relay9.update(statusResponseRaw[R2+29].toInt());
     #pragma endregion
     #pragma region R3
+    _updatingRegister = 1;
     CLMT.update(statusResponseRaw[R3+1].toInt());
     PHSE.update(statusResponseRaw[R3+2].toInt());
     LLM1.update(statusResponseRaw[R3+3].toInt());
@@ -1079,6 +1826,7 @@ void SpaInterface::updateMeasures() {
     // update_HV_2(statusResponseRaw[R3+25]);
     #pragma endregion
     #pragma region R4
+    _updatingRegister = 2;
     try { Mode.updateFromLabel(statusResponseRaw[R4+1].c_str()); } catch (const std::exception& ex) { debugE("Mode update failed: %s", ex.what()); }
     Ser1_Timer.update(statusResponseRaw[R4+2].toInt());
     Ser2_Timer.update(statusResponseRaw[R4+3].toInt());
@@ -1106,6 +1854,7 @@ void SpaInterface::updateMeasures() {
     Vari_Mode.update(statusResponseRaw[R4+23].toInt());
     #pragma endregion
     #pragma region R5
+    _updatingRegister = 3;
     //R5
     // Unknown encoding - TouchPad2.updateValue();
     // Unknown encoding - TouchPad1.updateValue();
@@ -1124,6 +1873,7 @@ void SpaInterface::updateMeasures() {
     RB_TP_Pump5.update(statusResponseRaw[R5 + 22].toInt());
     #pragma endregion
     #pragma region R6
+    _updatingRegister = 4;
     VARIValue.update(statusResponseRaw[R6 + 1].toInt());
     LBRTValue.update(statusResponseRaw[R6 + 2].toInt());
     CurrClr.update(statusResponseRaw[R6 + 3].toInt());
@@ -1156,6 +1906,7 @@ void SpaInterface::updateMeasures() {
     }
     #pragma endregion
     #pragma region R7
+    _updatingRegister = 5;
     WCLNTime.update(statusResponseRaw[R7 + 1].toInt());
     // The following 2 may be reversed
     TemperatureUnits.update(statusResponseRaw[R7 + 3] == "1");
@@ -1190,6 +1941,7 @@ void SpaInterface::updateMeasures() {
     PMAX.update(statusResponseRaw[R7 + 30].toInt());
     #pragma endregion
     #pragma region R9
+    _updatingRegister = 6;
     F1_HR.update(statusResponseRaw[R9 + 2].toInt());
     F1_Time.update(statusResponseRaw[R9 + 3].toInt());
     F1_ER.update(statusResponseRaw[R9 + 4].toInt());
@@ -1203,6 +1955,7 @@ void SpaInterface::updateMeasures() {
     F1_ST.update(statusResponseRaw[R9 + 12].toInt());
     #pragma endregion
     #pragma region RA
+    _updatingRegister = 7;
     F2_HR.update(statusResponseRaw[RA + 2].toInt());
     F2_Time.update(statusResponseRaw[RA + 3].toInt());
     F2_ER.update(statusResponseRaw[RA + 4].toInt());
@@ -1216,6 +1969,7 @@ void SpaInterface::updateMeasures() {
     F2_ST.update(statusResponseRaw[RA + 12].toInt());
     #pragma endregion
     #pragma region RB
+    _updatingRegister = 8;
     F3_HR.update(statusResponseRaw[RB + 2].toInt());
     F3_Time.update(statusResponseRaw[RB + 3].toInt());
     F3_ER.update(statusResponseRaw[RB + 4].toInt());
@@ -1229,6 +1983,7 @@ void SpaInterface::updateMeasures() {
     F3_ST.update(statusResponseRaw[RB + 12].toInt());
     #pragma endregion
     #pragma region RC
+    _updatingRegister = 9;
     //Outlet_Heater.updateValue(statusResponseRaw[]);
     //Outlet_Circ.updateValue(statusResponseRaw[]);
     //Outlet_Sanitise.updateValue(statusResponseRaw[]);
@@ -1239,6 +1994,7 @@ void SpaInterface::updateMeasures() {
     Outlet_Blower.update(statusResponseRaw[RC + 10].toInt());
     #pragma endregion
     #pragma region RE
+    _updatingRegister = 10;
     HP_Present.update(statusResponseRaw[RE + 1].toInt());
     //HP_FlowSwitch.updateValue(statusResponseRaw[]);
     //HP_HighSwitch.updateValue(statusResponseRaw[]);
@@ -1276,14 +2032,22 @@ void SpaInterface::updateMeasures() {
     #pragma endregion
 
     // There is no RG register in V2 firmware
-    if (RG < 0) return;
+    if (RG < 0) {
+        _updatingRegister = -1;
+        return;
+    }
 
     #pragma region RG
-    Pump1InstallState.update(statusResponseRaw[RG + 7]);
-    Pump2InstallState.update(statusResponseRaw[RG + 8]);
-    Pump3InstallState.update(statusResponseRaw[RG + 9]);
-    Pump4InstallState.update(statusResponseRaw[RG + 10]);
-    Pump5InstallState.update(statusResponseRaw[RG + 11]);
+    _updatingRegister = 11;
+    for (size_t pump = 0; pump < PUMP_COUNT; pump++) {
+        ROProperty<String> &installState = this->*pumpInstallStateFunctions[pump];
+        const String &raw = statusResponseRaw[RG + 7 + pump];
+        // Install states are fixed by the controller's configuration, so this almost never decodes.
+        if (!installState._hasValue || installState.getRef() != raw) {
+            _pumpCapabilities[pump] = PumpCapabilities::decode(raw);
+        }
+        installState.update(raw);
+    }
     Pump1OkToRun.update(statusResponseRaw[RG + 1] == "1");
     Pump2OkToRun.update(statusResponseRaw[RG + 2] == "1");
     Pump3OkToRun.update(statusResponseRaw[RG + 3] == "1");
@@ -1292,4 +2056,5 @@ void SpaInterface::updateMeasures() {
     LockMode.update(statusResponseRaw[RG + 12].toInt());
     #pragma endregion
 
+    _updatingRegister = -1;
 };
@@ -3,9 +3,14 @@
 
 #include <Arduino.h>
 #include <functional>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <vector>
 #include "WebRemoteDebug.h"
+#include "HeapTracker.h"
+#include "LinkTiming.h"
+#include "ClockSync.h"
 #include <time.h>
 #include <TimeLib.h>
 
@@ -29,18 +34,90 @@ class SpaInterface {
         /// @brief Each field of the RF cmd response as seperate elements.
         String statusResponseRaw[statusResponseMaxFields];
 
-        int R2=-1;
-        int R3=-1;
-        int R4=-1;
-        int R5=-1;
-        int R6=-1;
-        int R7=-1;
-        int R9=-1;
-        int RA=-1;
-        int RB=-1;
-        int RC=-1;
-        int RE=-1;
-        int RG=-1;
+        /// @brief Register headers in frame order; bit i of the register masks is REGISTER_NAMES[i].
+        static constexpr size_t REGISTER_COUNT = 12;
+        static constexpr const char *REGISTER_NAMES[REGISTER_COUNT] = {
+            "R2", "R3", "R4", "R5", "R6", "R7", "R9", "RA", "RB", "RC", "RE", "RG"
+        };
+
+    public:
+        /// @brief RF frame layout of the connected controller, resolved once from the first
+        /// valid frame and used to parse every frame after it.
+        struct FirmwareProfile {
+            bool valid = false;
+            int majorVersion = 0;               ///< From SVER, e.g. 6 for "SW V6 19 11 12"
+            uint8_t registerCount = 0;          ///< Registers in a frame (12, or 11 on V2 firmware)
+            int minFields = 0;                  ///< Fields a complete frame has at least
+            int finalRegister = -1;             ///< Register whose line ends the frame
+            int positions[REGISTER_COUNT];      ///< Field index of each register header, -1 if absent
+            uint8_t fields[REGISTER_COUNT];     ///< Fields of each register line, header and terminator included
+            uint32_t fingerprint = 0;           ///< Hash of the register order and field counts
+
+            FirmwareProfile() {
+                for (size_t r = 0; r < REGISTER_COUNT; r++) {
+                    positions[r] = -1;
+                    fields[r] = 0;
+                }
+            }
+        };
+
+        static constexpr size_t PUMP_COUNT = 5;
+
+        /// @brief What a pump supports, decoded from its PumpNInstallState string whenever that changes.
+        struct PumpCapabilities {
+            bool installed = false;
+            uint8_t speedType = 0;      ///< 1 = single speed, 2 = dual speed
+            uint8_t states = 0;         ///< Bit n set if pump state n is allowed (0 OFF, 1 ON, 2 LOW, 3 HIGH, 4 AUTO)
+            uint8_t stateCount = 0;     ///< Number of bits set in states
+            uint8_t minSpeed = 0;       ///< Lowest running state (1-3), 0 if none
+            uint8_t maxSpeed = 0;       ///< Highest running state (1-3), 0 if none
+            bool autoCapable = false;   ///< AUTO is one of the allowed states
+
+            bool allows(int state) const { return state >= 0 && state < 8 && (states >> state) & 1; }
+
+            /// @brief Decode an "I-S-PPP" install state, e.g. "1-1-014".
+            static PumpCapabilities decode(const String &installState);
+        };
+
+    private:
+        FirmwareProfile _profile;
+
+        /// @brief Field index of each register header, as used by updateMeasures().
+        const int &R2 = _profile.positions[0];
+        const int &R3 = _profile.positions[1];
+        const int &R4 = _profile.positions[2];
+        const int &R5 = _profile.positions[3];
+        const int &R6 = _profile.positions[4];
+        const int &R7 = _profile.positions[5];
+        const int &R9 = _profile.positions[6];
+        const int &RA = _profile.positions[7];
+        const int &RB = _profile.positions[8];
+        const int &RC = _profile.positions[9];
+        const int &RE = _profile.positions[10];
+        const int &RG = _profile.positions[11];
+
+        /// @brief Consecutive well-formed frames whose layout differed from the profile.
+        uint8_t _profileMismatches = 0;
+
+        PumpCapabilities _pumpCapabilities[PUMP_COUNT];
+        /// @brief Well-formed frames with a different layout before the profile is re-detected.
+        static const uint8_t PROFILE_REDETECT_FRAMES = 2;
+
+        /// @brief FNV-1a step adding one register line (index, field count) to a layout fingerprint.
+        static uint32_t fingerprintLine(uint32_t hash, int reg, size_t fields);
+
+        /// @brief Registers the last read carried over from an earlier frame.
+        uint16_t _staleRegisters = 0;
+        /// @brief Register (bit index of the register masks) whose fields updateMeasures() is
+        /// applying, or -1 outside it.
+        int8_t _updatingRegister = -1;
+        /// @brief The register being applied by updateMeasures() was carried over from an earlier frame.
+        bool updatingStaleRegister() const { return _updatingRegister >= 0 && (_staleRegisters & (1 << _updatingRegister)); }
+        /// @brief Longest register line that is buffered; longer ones are dropped.
+        static const size_t LINE_MAX_FIELDS = 48;
+
+        /// @brief Index into REGISTER_NAMES of a line header, or -1.
+        static int registerIndex(const String &header);
 
         // Register minimum sizes aligned with data read in updateMeasures()
         const std::array <int, 12> registerMinSize = {
@@ -73,18 +150,30 @@ class SpaInterface {
         /// @brief Sends command to SpaNet controller.  Result must be read by some other method.
         /// Used for the 'RF' command so that we can do a optomised read of the return array.
         /// @param cmd - cmd to be executed.
-        void sendCommand(String cmd);
+        /// @param calibrated - use the calibrated wake-up and learned response time of cmd; false
+        /// falls back to the original newline, 50 ms pause and 1 s timeout.
+        /// @param mayProbe - the exchange can afford a failed wake-up (an RF poll, or a write with a
+        /// retry left), so an unsettled calibration level may be tried; see wakeStepFor().
+        void sendCommand(String cmd, bool calibrated = true, bool mayProbe = true);
 
         /// @brief Sends a command to the SpanNet controller and returns the result string
         /// @param cmd - cmd to be executed
+        /// @param calibrated, mayProbe - see sendCommand()
         /// @return String - result string
-        String sendCommandReturnResult(String cmd);
+        String sendCommandReturnResult(String cmd, bool calibrated = true, bool mayProbe = true);
+
+        /// @brief Retries of a write whose echo did not match; each waits twice as long as the last.
+        static const uint8_t COMMAND_RETRIES = 2;
+        static const uint32_t COMMAND_RETRY_BACKOFF_MS = 100;
+        /// @brief Pause the controller needs between consecutive clock writes.
+        static const uint32_t CLOCK_WRITE_SETTLE_MS = 100;
 
         /// @brief Sends the command and checks the result against the expected outcome
         /// @param cmd command to send
         /// @param expected expected string response
+        /// @param retries attempts after the first; 0 for commands that are not idempotent (key presses)
         /// @return result
-        bool sendCommandCheckResult(String cmd, String expected);
+        bool sendCommandCheckResult(String cmd, String expected, uint8_t retries = COMMAND_RETRIES);
 
         /// @brief Updates the attributes by sending the RF command and parsing the result.
         void updateStatus();
@@ -92,14 +181,162 @@ class SpaInterface {
         void flushSerialReadBuffer() { flushSerialReadBuffer(false); };
         String flushSerialReadBuffer(bool returnData);
 
+        /// @brief Bytes pulled from the UART in one read while parsing a response.
+        static const size_t RX_CHUNK_LENGTH = 256;
+
+        /// @brief Response bytes read from the UART but not yet parsed.
+        /// Anything left over is drained by the next flushSerialReadBuffer().
+        uint8_t _rx[RX_CHUNK_LENGTH];
+        size_t _rxHead = 0;
+        size_t _rxLength = 0;
+
+        /// @brief Given by the UART driver's receive event, taken by a reader waiting for data.
+        SemaphoreHandle_t _rxReady = nullptr;
+
+        /// @brief Block until the UART has data or the timeout expires, without spinning.
+        /// @return true if data is available.
+        bool waitForRx(uint32_t timeoutMs);
+
+        /// @brief Next response byte, refilling _rx in bulk from the UART when empty.
+        /// @return the byte, or -1 after the learned gap timeout of silence.
+        int readResponseByte();
+
+        /// @brief Response bytes up to (not including) the terminator, or up to a timeout.
+        String readResponseUntil(char terminator);
+
+        /// @brief Set once the firmware version is known and any wake-up level saved for it is loaded.
+        bool _wakeCalibrationReady = false;
+
+        /// @brief Resume the wake-up level settled for this SVER, if any, and start calibrating.
+        void loadWakeCalibration();
+
+        /// @brief True when wakeStepFor(mayProbe) is the calibration level, so the outcome counts towards it.
+        bool wakeCalibrated(bool mayProbe) const;
+
+        /// @brief Wake-up for the next exchange: the calibration level when settled or when the
+        /// exchange may probe, otherwise the original newline and 50 ms pause.
+        const LinkTiming::WakeStep &wakeStepFor(bool mayProbe) const;
+
+        /// @brief Feed an exchange outcome to the wake-up calibration, saving a newly settled level.
+        /// Only for exchanges that used the calibration level (see wakeCalibrated()).
+        void recordWakeOutcome(bool ok);
+
+        /// @brief Commands other than RF wait this long before the spa clock is corrected.
+        static constexpr unsigned long CLOCK_QUIET_MS = 60000;
+        /// @brief Wait before trying again after a correction failed.
+        static constexpr unsigned long CLOCK_RETRY_MS = 3600000;
+        /// @brief The system clock is taken as set (by SNTP) once it is past 2024-01-01.
+        static constexpr time_t CLOCK_VALID_AFTER = 1704067200;
+
+        ClockSync _clock;
+        bool _clockCorrection = false;
+        unsigned long _lastCommandMs = 0;
+        unsigned long _nextClockCorrection = 0;
+
+        /// @brief Sample the spa clock from the frame just read and correct it if due and the link is quiet.
+        void serviceClockSync();
+
+        /// @brief Write the given ClockSync::Field components of t to the spa clock.
+        bool writeSpaTime(time_t t, uint8_t fields);
+
         /// @brief Singleton pointer used by the static RemoteDebug callback.
         static SpaInterface* _instance;
 
         /// @brief Static callback registered with RemoteDebug.
-        /// Handles the `s <cmd>` project command: sends the payload to the spa
-        /// serial port and prints the response via RemoteDebug.
+        /// Handles the `ss <cmd>` project command: queues the payload as a raw
+        /// console command and prints the response via RemoteDebug.
         static void _processDebugCommand();
 
+        /// @brief Raw console commands waiting for the serial link.
+        static const size_t RAW_QUEUE_LENGTH = 4;
+        /// @brief Gap between the wake-up newline and the command; the uncalibrated sendCommand() value.
+        static const uint32_t RAW_WAKE_DELAY_MS = 50;
+        /// @brief How long to wait for the first response byte.
+        static const uint32_t RAW_FIRST_BYTE_TIMEOUT_MS = 2000;
+        /// @brief Silence after which the response is considered complete.
+        static const uint32_t RAW_IDLE_GAP_MS = 500;
+        /// @brief Longest response line passed to the sink in one piece.
+        static const size_t RAW_LINE_LENGTH = 160;
+
+        struct RawCommand {
+            String payload;
+            std::function<void(const char *)> sink;
+        };
+
+        enum class RawState : uint8_t {
+            Idle,
+            Waking,             // wake-up newline sent, waiting RAW_WAKE_DELAY_MS
+            AwaitingResponse,   // command sent, no byte yet
+            Receiving           // streaming until RAW_IDLE_GAP_MS of silence
+        };
+
+        std::mutex _rawQueueMutex;
+        RawCommand _rawQueue[RAW_QUEUE_LENGTH];
+        size_t _rawQueueHead = 0;
+        size_t _rawQueueCount = 0;
+
+        RawCommand _rawActive;
+        RawState _rawState = RawState::Idle;
+        uint32_t _rawStateSince = 0;
+        uint32_t _rawLastByte = 0;
+        uint32_t _rawBytes = 0;
+        char _rawLine[RAW_LINE_LENGTH + 1];
+        size_t _rawLineLength = 0;
+
+        /// @brief Advance the active raw command, or start the next queued one.
+        /// @return true while the serial link is in use by a raw command.
+        bool serviceRawCommand();
+
+        /// @brief Pass the buffered response line to the sink.
+        void emitRawLine();
+
+        /// @brief Report the outcome to the sink and free the link.
+        /// @param interrupted A spa write needed the link before the response went quiet.
+        void finishRawCommand(bool interrupted);
+
+        /// @brief Keys in one keypad macro, repeats included.
+        static const size_t MACRO_MAX_STEPS = 32;
+        /// @brief Pause before each key after the first, unless the macro gives one.
+        static const uint16_t MACRO_KEY_GAP_MS = 150;
+        /// @brief Longest pause a macro may ask for.
+        static const uint16_t MACRO_MAX_PAUSE_MS = 10000;
+
+        struct MacroStep {
+            uint8_t key;        ///< SpaKey
+            uint16_t gapMs;     ///< Pause after the previous key's echo
+        };
+
+        enum class MacroState : uint8_t {
+            Idle,
+            Gap,                // previous key confirmed (or link flushed), waiting gapMs
+            Waking,             // wake-up newline sent, waiting out the wake pause
+            AwaitingEcho        // key sent, reading its echo line
+        };
+
+        MacroStep _macroSteps[MACRO_MAX_STEPS];
+        uint8_t _macroLength = 0;
+        uint8_t _macroStep = 0;
+        MacroState _macroState = MacroState::Idle;
+        uint32_t _macroStateSince = 0;
+        uint32_t _macroDeadlineMs = 0;
+        uint32_t _macroSentUs = 0;
+        char _macroEcho[8];
+        uint8_t _macroEchoLength = 0;
+
+        /// @brief Advance the running keypad macro.
+        /// @return true while the serial link is in use by a macro.
+        bool serviceKeypadMacro();
+
+        /// @brief Send the current macro key without the flush of sendCommand().
+        void sendMacroKey();
+
+        /// @brief Stop the macro, report the outcome and have the registers read back.
+        /// @param error nullptr when every key was confirmed.
+        void finishKeypadMacro(const char *error);
+
+        /// @brief Command and expected echo for a key.
+        static bool keyCommand(uint8_t key, const char *&cmd, const char *&expected);
+
         /// @brief Stores millis time at which next update should occur
         unsigned long _nextUpdateDue = 0;
 
@@ -109,6 +346,62 @@ class SpaInterface {
         /// @brief If the result registers have been modified locally, need to do a fress pull from the controller
         bool _resultRegistersDirty = true;
 
+        /// @brief Property values changed outside a poll (a confirmed write, or an async write
+        /// queued or rolled back); loop() notifies the update callback once for the batch.
+        bool _publishPending = false;
+
+        /// @brief A write queued by RWProperty::setAsync(), committed later by loop().
+        struct AsyncWrite {
+            uint32_t ticket = 0;                ///< 0 = free slot
+            const void *property = nullptr;     ///< Writes to the same property collapse into one slot
+            std::function<void()> commit;       ///< Performs the write; throws on failure
+            String key;
+            String requested;
+            unsigned long queuedMs = 0;
+        };
+        static constexpr size_t ASYNC_WRITE_SLOTS = 8;
+        /// @brief Quiet time after the latest write to a property before it is sent, so a burst collapses.
+        static constexpr unsigned long ASYNC_WRITE_SETTLE_MS = 100;
+        AsyncWrite _asyncWrites[ASYNC_WRITE_SLOTS];
+        uint32_t _lastTicket = 0;
+
+        /// @brief Outcomes of recent tickets, for getWriteState().
+        static constexpr size_t WRITE_OUTCOMES = 16;
+        struct WriteOutcome {
+            uint32_t ticket;
+            uint8_t state;
+        };
+        WriteOutcome _writeOutcomes[WRITE_OUTCOMES] = {};
+        uint8_t _nextWriteOutcome = 0;
+
+        /// @brief Queue a write, replacing one queued for the same property.
+        /// @throws std::runtime_error if every slot holds a write to another property.
+        uint32_t queueWrite(const void *property, std::function<void()> commit, const String &key, const String &requested);
+        /// @brief Drop a write queued for the property (superseded), if there is one.
+        void cancelWrite(const void *property);
+        bool writeQueued(const void *property) const;
+        void recordWriteOutcome(uint32_t ticket, uint8_t state);
+
+        /// @brief Pending writes as (key, requested), rebuilt on the loop task whenever the
+        /// queue changes so the web task never reads the slots' Strings.
+        using PendingWrites = std::vector<std::pair<String, String>>;
+        mutable std::mutex _pendingWritesMutex;
+        std::shared_ptr<const PendingWrites> _pendingWrites;
+        /// @brief The queue changed: republish the status and rebuild the pending writes snapshot.
+        void pendingWritesChanged();
+
+        /// @brief Send the oldest settled queued write.
+        /// @return true if a write used the link.
+        bool serviceAsyncWrites();
+
+        /// @brief Bumped every time cached property values may have changed (successful read or write).
+        uint32_t _statusVersion = 0;
+
+        /// @brief Time taken to parse the last successful RF response, less the waits for bytes (microseconds).
+        uint32_t _lastParseMicros = 0;
+        /// @brief Time readResponseByte() has spent waiting for the UART since boot (microseconds, wraps).
+        uint32_t _rxWaitMicros = 0;
+
         /// @brief True once RemoteDebug project commands have been registered (deferred to first loop() call).
         bool _debugInitialised = false;
 
@@ -257,7 +550,7 @@ class SpaInterface {
         /// the cached property value when the command succeeds.
         bool setVMAX(int mode);
         /// @brief Internal writer used by `SpaTime` RWProperty.
-        /// @details Sends S01..S05 + S06 (via setSpaDayOfWeek) to the controller.
+        /// @details Sends S01..S05 + S06 (via setSpaDayOfWeek) to the controller, see writeSpaTime().
         bool setSpaTime(time_t t);
         /// @brief Internal writer used by `RB_TP_Light` RWProperty.
         /// @details Sends `W14` to toggle the light; updates cached value to `mode`.
@@ -304,6 +597,8 @@ class SpaInterface {
                 : _map(map), _mapSize(N) {}
 
             T get() const { return _value; }
+            /// @brief Read the cached value without copying it (useful for large Strings).
+            const T& getRef() const { return _value; }
             operator T() const { return _value; }
             void setCallback(void (*c)(T)) { _callback = c; }
             void clearCallback() { _callback = nullptr; }
@@ -374,13 +669,17 @@ class SpaInterface {
             // Reverse-lookup by label string; throws std::invalid_argument if the label
             // is not found in the map or if no map is configured.
             void updateFromLabel(const char* label) {
+                update(polledLabelValue(label));
+            }
+
+            // Value of a label polled from the spa, for updateFromLabel().
+            T polledLabelValue(const char* label) const {
                 if (!label || !this->_map || this->_mapSize == 0) {
                     throw std::invalid_argument("updateFromLabel: no label map configured");
                 }
                 for (size_t i = 0; i < this->_mapSize; i++) {
                     if (strcmp(this->_map[i].label, label) == 0) {
-                        update(this->_map[i].value);
-                        return;
+                        return this->_map[i].value;
                     }
                 }
                 throw std::invalid_argument((String("updateFromLabel: unknown label '") + label + "'").c_str());
@@ -400,6 +699,10 @@ class SpaInterface {
             // Basic RW property with owner/writer only.
             RWProperty(SpaInterface* owner, WriteFunction writer)
                 : _owner(owner), _writer(writer) {}
+            // RW property whose polled value is not expected to read back as written
+            // (e.g. a clock), so confirmed writes are not checked against the next poll.
+            RWProperty(SpaInterface* owner, WriteFunction writer, bool verifyWrites)
+                : _owner(owner), _writer(writer), _verifyWrites(verifyWrites) {}
             // RW property with label/value map for setLabel/getLabel.
             template <size_t N>
             RWProperty(SpaInterface* owner, WriteFunction writer,
@@ -410,7 +713,10 @@ class SpaInterface {
 
             // Sends the value to the spa first; caches it only on success.
             // Validation is performed by the writer and any exception is propagated.
+            // The controller's echo confirms the write, so subscribers are notified
+            // straight away and the next scheduled poll verifies the value.
             void set(T newValue) {
+                if (_owner) _owner->cancelWrite(this);
                 if (this->_hasValue && newValue == this->_value) {
                     return;
                 }
@@ -419,11 +725,16 @@ class SpaInterface {
                     throw std::invalid_argument("RWProperty has no owner/writer");
                 }
 
+                _awaitingVerify = false;
                 if (!(_owner->*_writer)(newValue)) {
                     throw std::runtime_error("RWProperty write failed");
                 }
 
                 this->update(newValue);
+                _owner->_statusVersion++;
+                _owner->_publishPending = true;
+                _owner->_link.confirmedWrites++;
+                _awaitingVerify = _verifyWrites;
             }
 
             RWProperty& operator=(T newValue) {
@@ -433,22 +744,70 @@ class SpaInterface {
 
             // Set by label, throws if map is not configured or label is unknown.
             void setLabel(const char* label) {
-                if (!label || !this->_map || this->_mapSize == 0) {
-                    throw std::invalid_argument("RWProperty label map not configured");
+                set(valueForLabel(label));
+            }
+
+            // Queues the write for loop() and returns its ticket straight away; see
+            // SpaInterface::getWriteState(). Until it is sent, another setAsync()
+            // replaces it. key and requested name the write in the status JSON's
+            // pendingWrites (e.g. "temperatures_setPoint": "38.5"). Throws if the
+            // queue is full.
+            uint32_t setAsync(T newValue, const String &key = String(), const String &requested = String()) {
+                if (!_owner || !_writer) {
+                    throw std::invalid_argument("RWProperty has no owner/writer");
                 }
-                for (size_t i = 0; i < this->_mapSize; i++) {
-                    if (strcmp(this->_map[i].label, label) == 0) {
-                        set(this->_map[i].value);
-                        return;
-                    }
+                if (this->_hasValue && newValue == this->_value) {
+                    // Nothing to send, though it may undo a write still queued.
+                    _owner->cancelWrite(this);
+                    return _owner->queueWrite(this, nullptr, key, requested);
                 }
-                throw std::out_of_range("RWProperty label not found");
+                return _owner->queueWrite(this, [this, newValue]() { set(newValue); }, key, requested);
             }
 
+            uint32_t setLabelAsync(const char* label, const String &key = String(), const String &requested = String()) {
+                return setAsync(valueForLabel(label), key, requested);
+            }
+
+            /// @brief A setAsync() for this property is waiting to be sent.
+            bool isPending() const { return _owner && _owner->writeQueued(this); }
+
         private:
             // Owner + writer are required to commit changes to the spa.
             SpaInterface* _owner = nullptr;
             WriteFunction _writer = nullptr;
+            bool _verifyWrites = true;
+            // A confirmed write has not been read back by a poll yet.
+            bool _awaitingVerify = false;
+
+            T valueForLabel(const char* label) const {
+                if (!label || !this->_map || this->_mapSize == 0) {
+                    throw std::invalid_argument("RWProperty label map not configured");
+                }
+                for (size_t i = 0; i < this->_mapSize; i++) {
+                    if (strcmp(this->_map[i].label, label) == 0) return this->_map[i].value;
+                }
+                throw std::out_of_range("RWProperty label not found");
+            }
+
+            // Hides ROProperty::update() so the first value polled after a confirmed
+            // write is compared with it.
+            void update(T newValue) {
+                if (_awaitingVerify) {
+                    // A salvaged frame may hold this property's register from before the write.
+                    if (_owner->updatingStaleRegister()) return;
+                    _awaitingVerify = false;
+                    if (newValue != this->_value) _owner->_link.writeDivergences++;
+                }
+                ROProperty<T>::update(newValue);
+            }
+
+            // Hides ROProperty::updateFromLabel(), which would call ROProperty::update()
+            // and skip the verification above.
+            void updateFromLabel(const char* label) {
+                update(this->polledLabelValue(label));
+            }
+
+            friend class SpaInterface;
         };
 
     private:
@@ -573,9 +932,55 @@ class SpaInterface {
         /// @return true if the command was acknowledged.
         bool sendKey(SpaKey key);
 
+        /// @brief Where a keypad macro has got to.
+        struct KeypadMacroProgress {
+            enum class State : uint8_t { Idle, Running, Done, Aborted };
+            State state = State::Idle;
+            uint32_t id = 0;            ///< Increments with every macro started
+            uint8_t confirmed = 0;      ///< Keys echoed so far
+            uint8_t steps = 0;
+            String error;               ///< Why it was aborted
+        };
+
+        /// @brief Run a sequence of keypad presses as one command.
+        /// @details The macro is a list of steps separated by spaces or commas: a key
+        /// (`up`, `ok`, `down`, `invert`), optionally repeated (`down*3`), or a pause in
+        /// ms before the next key (`800`). Without a pause keys are MACRO_KEY_GAP_MS
+        /// apart. loop() flushes the link once and sends the keys one after another,
+        /// each with the calibrated wake-up (none once calibration settles on no
+        /// newline), checking each echo, and aborts on the first key that is not
+        /// confirmed. `progress` is
+        /// called on the loop task after every key and when the macro ends.
+        /// @return false if another macro is still running.
+        /// @throws std::invalid_argument if the macro does not parse, including a repeat
+        /// below 1 (`up*0`) and a pause with no key after it.
+        bool startKeypadMacro(const String &macro, std::function<void(const KeypadMacroProgress &)> progress = nullptr);
+
+        /// @brief The running macro, or the last one.
+        const KeypadMacroProgress &getKeypadMacroProgress() const { return _macroProgress; }
+
+    private:
+        KeypadMacroProgress _macroProgress;
+        std::function<void(const KeypadMacroProgress &)> _macroSink;
+
+    public:
+
         /// @brief Complete RF command response in a single string
         RWProperty<String> statusResponse{this, &SpaInterface::setStatusResponse};
 
+        /// @brief The last complete RF response, safe to hold and read from another task.
+        /// @details statusResponse is reassigned on every poll, so the web task must not read it directly.
+        std::shared_ptr<const String> getStatusResponseSnapshot() const {
+            std::lock_guard<std::mutex> lock(_statusSnapshotMutex);
+            return _statusSnapshot;
+        }
+
+    private:
+        mutable std::mutex _statusSnapshotMutex;
+        std::shared_ptr<const String> _statusSnapshot;
+
+    public:
+
         const std::array<String, 2> autoPumpOptions = {"Manual", "Auto"};
 
         /// @brief Mains voltage (V).
@@ -596,7 +1001,7 @@ class SpaInterface {
         RWProperty<int> SpaDayOfWeek{this, &SpaInterface::setSpaDayOfWeek, SpaDayOfWeek_Map};
         /// @brief Spa RTC clock value.
         /// @details Read/write. Writing sends S01..S05 + S06 to the controller.
-        RWProperty<time_t> SpaTime{this, &SpaInterface::setSpaTime};
+        RWProperty<time_t> SpaTime{this, &SpaInterface::setSpaTime, false};
         /// @brief Heater element temperature x10 (°C).
         ROProperty<int> HeaterTemperature;
         /// @brief Pool temperature x10 (°C). Note: often returns unreliable values; use WTMP for actual water temperature.
@@ -1039,10 +1444,135 @@ class SpaInterface {
         /// @brief To be called by loop function of main sketch.  Does regular updates, etc.
         void loop();
 
+        /// @brief Queue a raw command for the spa serial link (the `ss` debug console command).
+        /// @details Never blocks: loop() sends the command when the link is free and passes each
+        /// response line to `sink` as it arrives ("RX: ..."), followed by a closing summary line.
+        /// Polls wait while a raw command is in flight; a property write ends it early.
+        /// @param payload Command to send, e.g. "RF".
+        /// @param sink Called on the loop task with each NUL-terminated output line.
+        /// @return false if the queue is full.
+        bool queueRawCommand(const String &payload, std::function<void(const char *)> sink);
+
         /// @brief Have we sucessfuly read the registers from the SpaNet controller.
         /// @return
         bool isInitialised();
 
+        /// @brief Counter that changes whenever property values may have changed.
+        /// @details Lets callers cache anything derived from the properties (e.g. status JSON)
+        /// until the next successful read or write.
+        uint32_t getStatusVersion() const { return _statusVersion; }
+
+        /// @brief CPU time taken to parse the last successful RF response, in microseconds.
+        /// @details Time spent waiting for bytes at 38400 baud is left out, so this is the
+        /// tokenizer plus any logging done while parsing, and builds with different
+        /// `SPA_LOG_LEVEL_SERIAL` ceilings can be compared.
+        uint32_t getLastParseMicros() const { return _lastParseMicros; }
+
+        /// @brief Registers whose values in the last read came from an earlier frame, because
+        /// their line was missing or corrupt. Bit i is registerName(i); 0 after a complete frame.
+        uint16_t getStaleRegisters() const { return _staleRegisters; }
+        /// @brief Comma separated names of getStaleRegisters(), e.g. "R4,RC".
+        String staleRegisterNames() const;
+        static const char *registerName(size_t index) { return index < REGISTER_COUNT ? REGISTER_NAMES[index] : ""; }
+        static constexpr size_t registerCount() { return REGISTER_COUNT; }
+
+        /// @brief Frame layout in use; valid is false until the first good frame (or after a layout change).
+        const FirmwareProfile &getFirmwareProfile() const { return _profile; }
+
+        /// @brief Capabilities of pump 1-5; a pump out of range reports nothing installed.
+        const PumpCapabilities &getPumpCapabilities(int pumpNumber) const;
+
+        /// @brief Log2 histogram: bucket i counts values below 2^(i+1), the last is open ended.
+        struct LinkHistogram {
+            static constexpr size_t BUCKETS = 22;
+            uint32_t count = 0;
+            uint64_t sum = 0;
+            uint32_t max = 0;
+            uint32_t buckets[BUCKETS] = {};
+
+            void record(uint32_t value) {
+                count++;
+                sum += value;
+                if (value > max) max = value;
+                size_t bucket = value < 2 ? 0 : 31 - __builtin_clz(value);
+                buckets[bucket < BUCKETS ? bucket : BUCKETS - 1]++;
+            }
+
+            /// @brief Upper bound of bucket i, or 0 for the open ended last one.
+            static uint32_t bound(size_t bucket) { return bucket < BUCKETS - 1 ? 2UL << bucket : 0; }
+        };
+
+        /// @brief Serial link quality figures since boot.
+        struct LinkMetrics {
+            LinkHistogram firstByteUs;      ///< Command sent to first response byte (sendCommand)
+            LinkHistogram commandFrameUs;   ///< Whole command/response exchange (sendCommandReturnResult)
+            LinkHistogram statusFrameUs;    ///< Reading one RF status frame (readStatus)
+            LinkHistogram statusFrameBytes; ///< Size of each RF status frame
+            uint32_t commands = 0;          ///< Commands sent, including RF
+            uint32_t noResponse = 0;        ///< Commands that got no byte within the timeout
+            uint32_t strayBytes = 0;        ///< Unexpected bytes flushed before a command
+            uint32_t strayFlushes = 0;      ///< Flushes that found stray bytes
+            uint32_t registerErrors = 0;    ///< Registers shorter than their minimum size
+            uint32_t echoMismatches = 0;    ///< Writes whose response did not echo the expected value
+            uint32_t polls = 0;             ///< RF polls attempted
+            uint32_t pollRetries = 0;       ///< Failed polls, retried after FAILEDREADFREQUENCY
+            uint32_t commandRetries = 0;    ///< Write attempts repeated after an echo mismatch
+            uint32_t retryRecoveries = 0;   ///< Writes that succeeded on a retry
+            LinkHistogram wakeUs;           ///< Wake-up newline and pause before each command
+            uint32_t confirmedWrites = 0;   ///< Property writes confirmed by their echo, without a re-read
+            uint32_t writeDivergences = 0;  ///< Confirmed writes the next poll read back differently
+            uint32_t salvagedFrames = 0;    ///< RF frames used with some registers carried over from an earlier frame
+            uint32_t profileRedetections = 0; ///< Firmware profiles dropped because the frame layout changed
+            uint32_t asyncWrites = 0;       ///< Writes queued with RWProperty::setAsync()
+            uint32_t collapsedWrites = 0;   ///< Queued writes replaced by a newer one before they were sent
+            uint32_t rolledBackWrites = 0;  ///< Queued writes the controller did not confirm
+        };
+
+        /// @brief Serial link metrics; updated on the loop task, readers may see a poll mid-update.
+        const LinkMetrics &getLinkMetrics() const { return _link; }
+
+        /// @brief Response and gap timeouts learned from the controller, same threading as getLinkMetrics().
+        const LinkTiming &getLinkTiming() const { return _timing; }
+
+        /// @brief Spa clock offset and drift against the system (NTP) clock, same threading as getLinkMetrics().
+        const ClockSync &getClockSync() const { return _clock; }
+
+        /// @brief Let the spa clock be corrected from the system clock.
+        /// @details Only enable once the system clock's time zone matches the spa's; drift
+        /// is estimated either way.
+        void setClockCorrection(bool enabled) { _clockCorrection = enabled; }
+
+    private:
+        LinkMetrics _link;
+        LinkTiming _timing;
+
+    public:
+
+        /// @brief Progress of a write queued with RWProperty::setAsync().
+        enum class WriteState : uint8_t {
+            Unknown,        ///< Not a recent ticket
+            Pending,        ///< Queued, not sent yet
+            Confirmed,      ///< The controller echoed it (or there was nothing to change)
+            Failed,         ///< Rejected or not confirmed; the property kept its previous value
+            Superseded,     ///< Replaced by a newer write to the same property before it was sent
+        };
+
+        /// @brief State of a ticket returned by RWProperty::setAsync(). Loop task only.
+        WriteState getWriteState(uint32_t ticket) const;
+
+        /// @brief Writes still queued, as property key to requested value (keys given to setAsync()).
+        /// @details Visits a snapshot, so it may be called from any task.
+        template <typename F>
+        void forEachPendingWrite(F visit) const {
+            std::shared_ptr<const PendingWrites> pending;
+            {
+                std::lock_guard<std::mutex> lock(_pendingWritesMutex);
+                pending = _pendingWrites;
+            }
+            if (!pending) return;
+            for (const auto &write : *pending) visit(write.first, write.second);
+        }
+
         /// @brief Set the function to be called when properties have been updated.
         /// @param f
         void setUpdateCallback(void (*f)());
@@ -50,37 +50,23 @@ bool getPumpModesJson(SpaInterface &si, int pumpNumber, JsonObject pumps) {
     return false;
   }
 
-  // Retrieve the pump install state dynamically
-  String pumpInstallState = (si.*(SpaInterface::pumpInstallStateFunctions[pumpNumber - 1])).get();
+  const SpaInterface::PumpCapabilities &capabilities = si.getPumpCapabilities(pumpNumber);
 
   char pumpKey[6] = "pump";  // Start with "pump"
   pumpKey[4] = '0' + pumpNumber;  // Append the pump number as a character
   pumpKey[5] = '\0';  // Null-terminate the string
 
-  pumps[pumpKey]["installed"] = getPumpInstalledState(pumpInstallState);
-  String speedType = getPumpSpeedType(pumpInstallState);
-  pumps[pumpKey]["speedType"] = speedType;
-
-  String possibleStates = getPumpPossibleStates(pumpInstallState);
-  // Convert possibleStates into words and store them in a JSON array
-  for (uint i = 0; i < possibleStates.length(); i++) {
-    char stateChar = possibleStates.charAt(i);
-    if (stateChar == '0') {
-      pumps[pumpKey]["possibleStates"].add("OFF");
-    } else if (stateChar == '1') {
-      pumps[pumpKey]["possibleStates"].add("ON");
-    } else if (stateChar == '2') {
-      pumps[pumpKey]["possibleStates"].add("LOW");
-    } else if (stateChar == '3') {
-      pumps[pumpKey]["possibleStates"].add("HIGH");
-    } else if (stateChar == '4') {
-      pumps[pumpKey]["possibleStates"].add("AUTO");
-    }
+  pumps[pumpKey]["installed"] = capabilities.installed;
+  pumps[pumpKey]["speedType"] = String(capabilities.speedType);
+
+  static const char *const stateNames[] = {"OFF", "ON", "LOW", "HIGH", "AUTO"};
+  for (uint i = 0; i < array_count(stateNames); i++) {
+    if (capabilities.allows(i)) pumps[pumpKey]["possibleStates"].add(stateNames[i]);
   }
 
   int pumpState = (pumpNumber - 1 < array_count(SpaInterface::pumpStatuses))
       ? (si.*(SpaInterface::pumpStatuses[pumpNumber - 1])).get() : 0;
-  if (pumpInstallState.endsWith("4") && possibleStates.length() > 1) {
+  if (capabilities.autoCapable && capabilities.stateCount > 1) {
     if (pumpState == 4) pumps[pumpKey]["mode"] = "Auto";
     else pumps[pumpKey]["mode"] = "Manual";
   }
@@ -91,43 +77,8 @@ bool getPumpModesJson(SpaInterface &si, int pumpNumber, JsonObject pumps) {
   return true;
 }
 
-bool getPumpInstalledState(String pumpInstallState) {
-  return pumpInstallState.startsWith("1");
-}
-
-String getPumpSpeedType(String pumpInstallState) {
-  int firstDash = pumpInstallState.indexOf("-");
-  int secondDash = pumpInstallState.lastIndexOf("-");
-  return pumpInstallState.substring(firstDash + 1, secondDash);
-}
-
-String getPumpPossibleStates(String pumpInstallState) {
-  int secondDash = pumpInstallState.lastIndexOf("-");
-  return pumpInstallState.substring(secondDash + 1);
-}
-
-int getPumpSpeedMax(String pumpInstallState) {
-  String possibleStates = getPumpPossibleStates(pumpInstallState);
-  uint max = 0;
-  for (uint i = 0; i < possibleStates.length(); i++) {
-    int pumpMode = possibleStates.charAt(i)  - '0';
-    if (pumpMode > 0 && pumpMode < 4 && pumpMode > max) max = pumpMode;
-  }
-  return max;
-}
-
-int getPumpSpeedMin(String pumpInstallState) {
-  String possibleStates = getPumpPossibleStates(pumpInstallState);
-  uint min = UINT_MAX;
-  for (uint i = 0; i < possibleStates.length(); i++) {
-    int pumpMode = possibleStates.charAt(i)  - '0';
-    if (pumpMode > 0 && pumpMode < 4 && pumpMode < min) min = pumpMode;
-  }
-  if (min == UINT_MAX) min = 0;
-  return min;
-}
-
 bool generateStatusJson(SpaInterface &si, MQTTClientWrapper &mqttClient, String &output, bool prettyJson) {
+  SPA_HEAP_TAG(SpaUtils);
   JsonDocument json;
 
   json["temperatures"]["setPoint"] = si.STMP.get() / 10.0;
@@ -224,6 +175,12 @@ bool generateStatusJson(SpaInterface &si, MQTTClientWrapper &mqttClient, String
   }
   json["lights"]["color_mode"] = "hs";
 
+  // Writes accepted but not yet confirmed by the controller, keyed like the set topics.
+  JsonObject pendingWrites = json["pendingWrites"].to<JsonObject>();
+  si.forEachPendingWrite([&pendingWrites](const String &key, const String &requested) {
+    pendingWrites[key] = requested;
+  });
+
   int jsonSize;
   if (prettyJson) {
     jsonSize = serializeJsonPretty(json, output);
@@ -234,3 +191,83 @@ bool generateStatusJson(SpaInterface &si, MQTTClientWrapper &mqttClient, String
   return (jsonSize > 0);
 }
 
+
+bool generateLinkMetricsJson(const SpaInterface &si, String &output) {
+  SPA_HEAP_TAG(SpaUtils);
+  const SpaInterface::LinkMetrics &link = si.getLinkMetrics();
+  JsonDocument json;
+
+  auto histogram = [](JsonObject out, const SpaInterface::LinkHistogram &h) {
+    out["count"] = h.count;
+    out["avg"] = h.count > 0 ? (uint32_t)(h.sum / h.count) : 0;
+    out["max"] = h.max;
+  };
+  histogram(json["firstByteUs"].to<JsonObject>(), link.firstByteUs);
+  histogram(json["commandFrameUs"].to<JsonObject>(), link.commandFrameUs);
+  histogram(json["statusFrameUs"].to<JsonObject>(), link.statusFrameUs);
+  histogram(json["statusFrameBytes"].to<JsonObject>(), link.statusFrameBytes);
+  histogram(json["wakeUs"].to<JsonObject>(), link.wakeUs);
+
+  json["commands"] = link.commands;
+  json["noResponse"] = link.noResponse;
+  json["strayBytes"] = link.strayBytes;
+  json["strayFlushes"] = link.strayFlushes;
+  json["registerErrors"] = link.registerErrors;
+  json["echoMismatches"] = link.echoMismatches;
+  json["polls"] = link.polls;
+  json["pollRetries"] = link.pollRetries;
+  json["commandRetries"] = link.commandRetries;
+  json["retryRecoveries"] = link.retryRecoveries;
+  json["confirmedWrites"] = link.confirmedWrites;
+  json["writeDivergences"] = link.writeDivergences;
+  json["salvagedFrames"] = link.salvagedFrames;
+  json["staleRegisters"] = si.staleRegisterNames();
+  json["profileRedetections"] = link.profileRedetections;
+  json["asyncWrites"] = link.asyncWrites;
+  json["collapsedWrites"] = link.collapsedWrites;
+  json["rolledBackWrites"] = link.rolledBackWrites;
+
+  const SpaInterface::FirmwareProfile &profile = si.getFirmwareProfile();
+  JsonObject firmware = json["firmwareProfile"].to<JsonObject>();
+  firmware["valid"] = profile.valid;
+  firmware["majorVersion"] = profile.majorVersion;
+  firmware["registers"] = profile.registerCount;
+  firmware["fingerprint"] = String(profile.fingerprint, HEX);
+
+  const ClockSync &clock = si.getClockSync();
+  JsonObject spaClock = json["spaClock"].to<JsonObject>();
+  if (clock.hasOffset()) spaClock["offsetS"] = clock.offsetS();
+  if (clock.driftKnown()) {
+    spaClock["driftPpm"] = clock.driftPpm();
+    spaClock["secondsUntilCorrection"] = clock.secondsUntilCorrection();
+  }
+  spaClock["corrections"] = clock.corrections();
+
+  const LinkTiming &timing = si.getLinkTiming();
+  json["gapTimeoutMs"] = timing.gapTimeoutMs();
+  json["wakeLevel"] = timing.wakeLevel();
+  json["wakeSettled"] = timing.wakeSettled();
+  json["wakeNewline"] = timing.wakeStep().newline;
+  json["wakeDelayMs"] = timing.wakeStep().delayMs;
+  JsonObject commands = json["responseTimeoutMs"].to<JsonObject>();
+  for (size_t i = 0; i < LinkTiming::MAX_COMMANDS; i++) {
+    const LinkTiming::CommandTiming &command = timing.commands()[i];
+    if (command.code[0] == '\0') break;
+    commands[command.code] = LinkTiming::responseTimeoutMs(command);
+  }
+
+  return serializeJson(json, output) > 0;
+}
+
+bool generateKeypadMacroJson(const SpaInterface::KeypadMacroProgress &progress, String &output) {
+  SPA_HEAP_TAG(SpaUtils);
+  JsonDocument json;
+  static const char *const STATES[] = {"idle", "running", "done", "aborted"};
+  json["id"] = progress.id;
+  json["state"] = STATES[(int)progress.state];
+  json["confirmed"] = progress.confirmed;
+  json["steps"] = progress.steps;
+  if (!progress.error.isEmpty()) json["error"] = progress.error;
+
+  return serializeJson(json, output) > 0;
+}
@@ -10,6 +10,7 @@
 #include "Config.h"
 #include <PubSubClient.h>
 #include "MQTTClientWrapper.h"
+#include "HeapTracker.h"
 
 //define stringify function
 #define xstr(a) str(a)
@@ -21,12 +22,12 @@ String convertToTime(int data);
 int convertToInteger(String &timeStr);
 bool getPumpModesJson(SpaInterface &si, int pumpNumber, JsonObject pumps);
 
-bool getPumpInstalledState(String pumpState);
-String getPumpSpeedType(String pumpState);
-String getPumpPossibleStates(String pumpState);
-int getPumpSpeedMax(String pumpState);
-int getPumpSpeedMin(String pumpState);
-
 bool generateStatusJson(SpaInterface &si, MQTTClientWrapper &mqttClient, String &output, bool prettyJson=false);
 
+/// @brief Serial link metrics (counters, averages and maxima) as compact JSON, for the MQTT diagnostics topic.
+bool generateLinkMetricsJson(const SpaInterface &si, String &output);
+
+/// @brief Progress of a keypad macro, for the MQTT keypad/macro topic.
+bool generateKeypadMacroJson(const SpaInterface::KeypadMacroProgress &progress, String &output);
+
 #endif // SPAUTILS_H
@@ -3,8 +3,15 @@
 
 #include <Arduino.h>
 #include <Print.h>
+#include <stdarg.h>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
 #include <RemoteDebug.h>
 #include <ESPAsyncWebServer.h>
+#include "CrashLog.h"
+#include "HeapTracker.h"
 
 class WebRemoteDebug : public Print {
 public:
@@ -46,13 +53,42 @@ public:
      */
     void attachWebSocket(AsyncWebSocket* webSocket) {
         _webSocket = webSocket;
+    }
 
-        /*
-         * Reserve these buffers once to reduce repeated heap allocations
-         * and fragmentation during bursts of verbose logging.
-         */
-        _webLine.reserve(MAX_WEB_LINE_LENGTH);
-        _webBatch.reserve(MAX_WEB_BATCH_LENGTH);
+    /**
+     * Copy WARNING and ERROR lines into a CrashLog as well, whether or not
+     * any client is connected.
+     */
+    void attachCrashLog(CrashLog* crashLog) {
+        _crashLog = crashLog;
+    }
+
+    /**
+     * Register a newly connected debug WebSocket client.
+     *
+     * @return false if all client slots are in use; the caller should
+     * close the connection.
+     */
+    bool addWebClient(uint32_t id) {
+        std::lock_guard<std::mutex> lock(_webClientsMutex);
+        for (WebClientState& state : _webClients) {
+            if (state.id == 0) {
+                state = WebClientState();
+                state.id = id;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void removeWebClient(uint32_t id) {
+        std::lock_guard<std::mutex> lock(_webClientsMutex);
+        for (WebClientState& state : _webClients) {
+            if (state.id == id) {
+                state = WebClientState();
+            }
+        }
     }
 
     void detachWebSocket() {
@@ -67,8 +103,21 @@ public:
      * Call regularly from loop().
      */
     void handle() {
+        SPA_HEAP_TAG(WebRemoteDebug);
+
         _remote.handle();
 
+        drainDeferred();
+
+        /*
+         * A message repeating forever would otherwise never be reported;
+         * summarise the run so far and keep collapsing.
+         */
+        if (_repeatCount > 0 &&
+            millis() - _repeatSince >= REPEAT_SUMMARY_INTERVAL_MS) {
+            flushRepeatSummary();
+        }
+
         if (_webSocket == nullptr) {
             return;
         }
@@ -79,7 +128,7 @@ public:
 
         if (now - _lastCleanup >= CLEANUP_INTERVAL_MS) {
             _lastCleanup = now;
-            _webSocket->cleanupClients();
+            _webSocket->cleanupClients(MAX_WEB_CLIENTS);
         }
     }
 
@@ -98,14 +147,88 @@ public:
             hasWebClients() &&
             levelIsEnabled(level, _webLevel) &&
             !_webSilenced;
+        _currentCrashActive =
+            _crashLog != nullptr &&
+            (level == RemoteDebug::WARNING || level == RemoteDebug::ERROR);
 
-        return _currentRemoteActive || _currentWebActive;
+        return _currentRemoteActive || _currentWebActive || _currentCrashActive;
     }
 
     size_t write(uint8_t value) override {
         return write(&value, 1);
     }
 
+    /**
+     * Hides Print::printf() so the debug macros format into a fixed
+     * buffer instead of Print's heap fallback for lines over 64 bytes.
+     * Only output longer than the buffer falls back to Print::vprintf().
+     *
+     * Output from the debug macros is also rate limited per call site
+     * (the format string pointer identifies it) and identical consecutive
+     * lines are collapsed; see callSiteBucket() and isRepeatedLine().
+     */
+    size_t printf(const char* format, ...)
+        __attribute__((format(printf, 2, 3))) {
+        SPA_HEAP_TAG(WebRemoteDebug);
+
+        const bool limited =
+            _rateLimiting && _levelCheckPending && !_rateLimitExempt;
+        CallSiteBucket* bucket = limited ? callSiteBucket(format) : nullptr;
+
+        /*
+         * Repeats are counted rather than rate limited, so only a line
+         * from the same call site as the last one needs formatting to
+         * find out; anything else out of tokens costs a table lookup.
+         */
+        if (bucket != nullptr &&
+            bucket->tokens == 0 &&
+            format != _lastLineFormat) {
+            suppressLine(bucket);
+            return 0;
+        }
+
+        char buffer[PRINTF_BUFFER_LENGTH];
+
+        va_list arguments;
+        va_start(arguments, format);
+        const int length = vsnprintf(
+            buffer,
+            sizeof(buffer),
+            format,
+            arguments
+        );
+        va_end(arguments);
+
+        if (length < 0) {
+            return 0;
+        }
+
+        if (static_cast<size_t>(length) < sizeof(buffer)) {
+            if (limited && isRepeatedLine(format, buffer, length)) {
+                resetRoutingState();
+                return length;
+            }
+        }
+
+        if (bucket != nullptr && !spendLogToken(bucket)) {
+            suppressLine(bucket);
+            return 0;
+        }
+
+        if (static_cast<size_t>(length) < sizeof(buffer)) {
+            return write(
+                reinterpret_cast<const uint8_t*>(buffer),
+                length
+            );
+        }
+
+        va_start(arguments, format);
+        const size_t written = Print::vprintf(format, arguments);
+        va_end(arguments);
+
+        return written;
+    }
+
     size_t write(
         const uint8_t* buffer,
         size_t size
@@ -134,6 +257,10 @@ public:
             appendWebSocketData(buffer, size);
         }
 
+        if (_levelCheckPending && _currentCrashActive) {
+            _crashLog->append(_currentLevel, buffer, size);
+        }
+
         /*
          * A newline completes the current logging operation and resets the
          * routing state for the next message.
@@ -188,7 +315,7 @@ public:
     }
 
     size_t webBatchLength() const {
-        return _webBatch.length();
+        return (_ringAEnd - _ringAStart) + (_ringBActive ? _ringBEnd : 0);
     }
 
     size_t webBatchCapacity() const {
@@ -203,6 +330,118 @@ public:
         return _droppedWebBytes;
     }
 
+    /**
+     * Lines withheld from individual clients whose send queue was full,
+     * summed over all clients since boot.
+     */
+    uint32_t slowClientDroppedLines() const {
+        return _slowClientDroppedLines;
+    }
+
+    /**
+     * Record a log line without formatting it.
+     *
+     * Only the format pointer, function name, a microsecond timestamp and
+     * the raw arguments are stored; handle() formats the record later.
+     * Integer and enum arguments are stored as machine words, strings
+     * (const char* or String) are copied at their own length into a text
+     * area shared by all queued records. Floating point is not supported.
+     *
+     * With deferred logging switched off, or if the ring could not be
+     * allocated, the line is formatted straight away. Must be called from
+     * the loop task, like handle().
+     */
+    template<typename... Args>
+    void logDeferred(
+        uint8_t level,
+        const char* function,
+        const char* format,
+        const Args&... args
+    ) {
+        static_assert(
+            sizeof...(Args) <= DEFERRED_MAX_ARGS,
+            "too many arguments for a deferred log record"
+        );
+
+        if (!_deferredLogging || !allocateDeferred()) {
+            /*
+             * Strings go through the text area, so format from a scratch
+             * record before anything queued there is released.
+             */
+            DeferredRecord record{};
+            const size_t textUsed = _deferredTextUsed;
+            fillDeferred(record, level, function, format, args...);
+            formatDeferred(record);
+            _deferredTextUsed = textUsed;
+            return;
+        }
+
+        if (_deferredCount >= DEFERRED_CAPACITY) {
+            ++_deferredDropped;
+            return;
+        }
+
+        fillDeferred(_deferred[_deferredCount], level, function, format, args...);
+        ++_deferredCount;
+    }
+
+    /**
+     * Level check for the deferred macros. Unlike isActive() it does not
+     * arm write() routing, as nothing is written until handle().
+     */
+    bool isLevelActive(uint8_t level) {
+        return _remote.isActive(level) || (
+            hasWebClients() &&
+            levelIsEnabled(level, _webLevel) &&
+            !_webSilenced
+        );
+    }
+
+    /**
+     * On by default. The ring holds DEFERRED_CAPACITY records, a verbose
+     * trace of a whole RF frame, and handle() drains all of it on every
+     * pass. It is allocated the first time a record is queued, so it costs
+     * no heap until something traces at a deferred level. Records already
+     * queued are still formatted by handle() after it is switched off.
+     */
+    void setDeferredLogging(bool enabled) {
+        _deferredLogging = enabled;
+    }
+
+    bool isDeferredLogging() const {
+        return _deferredLogging;
+    }
+
+    size_t deferredPending() const {
+        return _deferredCount;
+    }
+
+    uint32_t deferredDropped() const {
+        return _deferredDroppedTotal + _deferredDropped;
+    }
+
+    /**
+     * Enable or disable per-call-site rate limiting and collapsing of
+     * repeated lines. Enabled by default.
+     */
+    void setRateLimiting(bool enabled) {
+        _rateLimiting = enabled;
+    }
+
+    bool isRateLimiting() const {
+        return _rateLimiting;
+    }
+
+    /// Lines dropped because their call site ran out of tokens.
+    uint32_t rateLimitedLines() const {
+        return _rateLimitedLines;
+    }
+
+    /// Lines folded into a "repeated N times" summary.
+    uint32_t collapsedRepeats() const {
+        return _collapsedRepeats;
+    }
+
     /**
      * Send a message to all connected WebSocket clients.
      *
@@ -438,8 +677,34 @@ public:
     }
 
 private:
+    /*
+     * Debug page connections are limited so the per-client send queues,
+     * and therefore heap, stay bounded.
+     */
+    static constexpr size_t MAX_WEB_CLIENTS = 4;
+
     static constexpr size_t MAX_WEB_LINE_LENGTH = 1024;
     static constexpr size_t MAX_WEB_BATCH_LENGTH = 16384;
+    static constexpr size_t PRINTF_BUFFER_LENGTH = 256;
+    static constexpr size_t MAX_WEB_PREFIX_LENGTH = 24;
+
+    /*
+     * A verbose RF frame is roughly 300 records (one per field and a few
+     * per register) carrying about 1.2 KB of field text.
+     */
+    static constexpr size_t DEFERRED_CAPACITY = 384;
+    static constexpr size_t DEFERRED_MAX_ARGS = 6;
+    static constexpr size_t DEFERRED_TEXT_CAPACITY = 2048;
+
+    /*
+     * Per-call-site token buckets: a site may log LOG_TOKEN_BURST lines at
+     * once, then one line per LOG_TOKEN_INTERVAL_MS. Only INFO and above
+     * are limited; VERBOSE and DEBUG are opt-in and wanted in full.
+     */
+    static constexpr size_t CALL_SITE_SLOTS = 16;
+    static constexpr uint8_t LOG_TOKEN_BURST = 5;
+    static constexpr uint32_t LOG_TOKEN_INTERVAL_MS = 10000;
+    static constexpr uint32_t REPEAT_SUMMARY_INTERVAL_MS = 60000;
 
     static constexpr uint32_t WEB_BATCH_INTERVAL_MS = 25;
     static constexpr uint32_t CLEANUP_INTERVAL_MS = 1000;
@@ -453,9 +718,73 @@ private:
     bool _levelCheckPending = false;
     bool _currentRemoteActive = false;
     bool _currentWebActive = false;
+    bool _currentCrashActive = false;
+
+    CrashLog* _crashLog = nullptr;
+
+    struct CallSiteBucket {
+        const char* format = nullptr;   // nullptr = slot free
+        uint32_t lastRefill = 0;
+        uint32_t lastUse = 0;
+        uint32_t suppressed = 0;        // lines dropped since the last one sent
+        uint8_t tokens = 0;
+    };
+
+    CallSiteBucket _callSites[CALL_SITE_SLOTS];
+    bool _rateLimiting = true;
+    bool _rateLimitExempt = false;
+    uint32_t _rateLimitedLines = 0;
+
+    /*
+     * Last line sent through the limited path and how often it has been
+     * repeated since, for "repeated N times" summaries.
+     */
+    const char* _lastLineFormat = nullptr;
+    uint32_t _lastLineHash = 0;
+    uint8_t _lastLineLevel = RemoteDebug::ANY;
+    uint32_t _repeatCount = 0;
+    uint32_t _repeatSince = 0;
+    uint32_t _collapsedRepeats = 0;
 
-    String _webLine;
-    String _webBatch;
+    /*
+     * Web output ring, used as a bip buffer so a batch is always one or
+     * two contiguous runs of complete, newline-terminated lines that can be
+     * handed to textAll() in place:
+     *
+     * - region A [_ringAStart, _ringAEnd) holds the oldest unsent lines;
+     * - once writing reaches the end of the array, new lines continue in
+     *   region B [0, _ringBEnd) until A has been sent;
+     * - the line being built sits at the end of the active region, up to
+     *   _ringWrite, and becomes part of it when its newline arrives.
+     */
+    char _webRing[MAX_WEB_BATCH_LENGTH];
+    size_t _ringAStart = 0;
+    size_t _ringAEnd = 0;
+    size_t _ringBEnd = 0;
+    size_t _ringWrite = 0;
+    bool _ringBActive = false;
+
+    /*
+     * Per-client backpressure. A client whose AsyncWebSocket queue is full
+     * is skipped for that batch and its loss is reported to it alone once
+     * it catches up, so one slow browser does not cost the others lines.
+     */
+    struct WebClientState {
+        uint32_t id = 0;                // 0 = slot free
+        uint32_t droppedLines = 0;
+        uint32_t droppedBytes = 0;
+    };
+
+    /*
+     * Slots are claimed and freed by the WebSocket event handler on the
+     * async TCP task and walked by sendToWebClients() on the loop task.
+     */
+    std::mutex _webClientsMutex;
+    WebClientState _webClients[MAX_WEB_CLIENTS];
+    uint32_t _slowClientDroppedLines = 0;
+
+    bool _webLineOpen = false;      // prefix written, line not yet terminated
+    bool _webLineDropped = false;   // rest of the current line is discarded
 
     uint32_t _lastWebBatchSend = 0;
     uint32_t _lastCleanup = 0;
@@ -470,6 +799,207 @@ private:
     bool _webShowDebugLevel = true;
     bool _webShowProfiler = true;
 
+    struct DeferredRecord {
+        const char* function;
+        const char* format;
+        uint32_t timestamp;             // micros()
+        uint8_t level;
+        uint8_t stringMask;             // bit n set: args[n] is an offset into _deferredText
+        uintptr_t args[DEFERRED_MAX_ARGS];
+    };
+
+    /*
+     * Filled on the loop task between two handle() calls and emptied by
+     * each of them, so both arrays are used from the start every time and
+     * need no locking. The last text byte always stays a terminator.
+     */
+    std::unique_ptr<DeferredRecord[]> _deferred;
+    std::unique_ptr<char[]> _deferredText;
+    size_t _deferredCount = 0;
+    size_t _deferredTextUsed = 0;
+    uint32_t _deferredDropped = 0;      // not yet reported
+    uint32_t _deferredDroppedTotal = 0;
+    bool _deferredAllocationFailed = false;
+    bool _deferredLogging = true;
+
+    bool allocateDeferred() {
+        if (_deferred) {
+            return true;
+        }
+
+        if (_deferredAllocationFailed) {
+            return false;
+        }
+
+        _deferred.reset(new (std::nothrow) DeferredRecord[DEFERRED_CAPACITY]);
+        _deferredText.reset(new (std::nothrow) char[DEFERRED_TEXT_CAPACITY]);
+
+        if (!_deferred || !_deferredText) {
+            _deferred.reset();
+            _deferredText.reset();
+            _deferredAllocationFailed = true;
+            return false;
+        }
+
+        _deferredText[DEFERRED_TEXT_CAPACITY - 1] = '\0';
+        return true;
+    }
+
+    template<typename... Args>
+    void fillDeferred(
+        DeferredRecord& record,
+        uint8_t level,
+        const char* function,
+        const char* format,
+        const Args&... args
+    ) {
+        record.function = function;
+        record.format = format;
+        record.timestamp = micros();
+        record.level = level;
+        record.stringMask = 0;
+
+        size_t index = 0;
+        (captureDeferredArg(record, index++, args), ...);
+    }
+
+    void captureDeferredArg(
+        DeferredRecord& record,
+        size_t index,
+        const char* text
+    ) {
+        if (text == nullptr) {
+            text = "(null)";
+        }
+
+        /*
+         * Without a text area (formatting straight away before the first
+         * allocation) the caller's string is still alive, so point at it.
+         */
+        if (!_deferredText) {
+            record.args[index] = reinterpret_cast<uintptr_t>(text);
+            return;
+        }
+
+        /*
+         * No formatted line is longer than PRINTF_BUFFER_LENGTH, so nothing
+         * past that is kept. A string that does not fit is truncated; once
+         * the area is full it points at the final terminator and formats
+         * as "".
+         */
+        size_t offset = _deferredTextUsed;
+        if (offset >= DEFERRED_TEXT_CAPACITY - 1) {
+            offset = DEFERRED_TEXT_CAPACITY - 1;
+        } else {
+            const size_t room = DEFERRED_TEXT_CAPACITY - 1 - offset;
+            size_t length = strnlen(text, PRINTF_BUFFER_LENGTH - 1);
+            if (length > room) {
+                length = room;
+            }
+            memcpy(&_deferredText[offset], text, length);
+            _deferredText[offset + length] = '\0';
+            _deferredTextUsed = offset + length + 1;
+        }
+
+        record.args[index] = offset;
+        record.stringMask |= static_cast<uint8_t>(1u << index);
+    }
+
+    void captureDeferredArg(
+        DeferredRecord& record,
+        size_t index,
+        char* text
+    ) {
+        captureDeferredArg(record, index, static_cast<const char*>(text));
+    }
+
+    void captureDeferredArg(
+        DeferredRecord& record,
+        size_t index,
+        const String& text
+    ) {
+        captureDeferredArg(record, index, text.c_str());
+    }
+
+    template<typename T>
+    void captureDeferredArg(
+        DeferredRecord& record,
+        size_t index,
+        const T& value
+    ) {
+        static_assert(
+            std::is_integral<T>::value ||
+            std::is_enum<T>::value ||
+            std::is_pointer<T>::value,
+            "deferred log arguments must be integers, enums, pointers or strings"
+        );
+        static_assert(
+            sizeof(T) <= sizeof(uintptr_t),
+            "deferred log arguments must fit in a machine word"
+        );
+
+        record.args[index] = (uintptr_t)value;
+    }
+
+    void formatDeferred(const DeferredRecord& record) {
+        uintptr_t args[DEFERRED_MAX_ARGS];
+
+        for (size_t i = 0; i < DEFERRED_MAX_ARGS; ++i) {
+            args[i] = (record.stringMask & (1u << i))
+                ? reinterpret_cast<uintptr_t>(&_deferredText[record.args[i]])
+                : record.args[i];
+        }
+
+        /*
+         * Every argument was widened to a machine word, which is what
+         * integer and pointer varargs occupy on the ESP32.
+         */
+        char message[PRINTF_BUFFER_LENGTH];
+        snprintf(
+            message,
+            sizeof(message),
+            record.format,
+            args[0], args[1], args[2], args[3], args[4], args[5]
+        );
+
+        if (!isActive(record.level)) {
+            resetRoutingState();
+            return;
+        }
+
+        /*
+         * All records share this format string, so they must not share a
+         * call-site bucket; their rate is bounded by the deferred ring.
+         */
+        _rateLimitExempt = true;
+        printf(
+            "(%s)(T%lu.%03lu) %s\n",
+            record.function,
+            static_cast<unsigned long>(record.timestamp / 1000),
+            static_cast<unsigned long>(record.timestamp % 1000),
+            message
+        );
+        _rateLimitExempt = false;
+    }
+
+    void drainDeferred() {
+        for (size_t i = 0; i < _deferredCount; ++i) {
+            formatDeferred(_deferred[i]);
+        }
+        _deferredCount = 0;
+        _deferredTextUsed = 0;
+
+        if (_deferredDropped > 0) {
+            isActive(RemoteDebug::WARNING);
+            printf(
+                "[Deferred log dropped %u records because the ring was full]\n",
+                static_cast<unsigned>(_deferredDropped)
+            );
+            _deferredDroppedTotal += _deferredDropped;
+            _deferredDropped = 0;
+        }
+    }
+
     void appendWebSocketData(
         const uint8_t* buffer,
         size_t size
@@ -487,46 +1017,111 @@ private:
                 continue;
             }
 
+            if (!_webLineOpen) {
+                beginWebLine();
+            }
+
             /*
              * Bound individual line growth. If one log line exceeds the
              * limit, flush it as a partial line and continue.
              */
-            if (_webLine.length() >= MAX_WEB_LINE_LENGTH) {
+            if (currentWebLineLength() >= MAX_WEB_LINE_LENGTH) {
                 flushWebSocketLine();
+                beginWebLine();
             }
 
-            _webLine += character;
+            putWebCharacter(character);
         }
     }
 
-    void flushWebSocketLine() {
-        if (_webLine.isEmpty()) {
+    size_t activeRegionEnd() const {
+        return _ringBActive ? _ringBEnd : _ringAEnd;
+    }
+
+    size_t currentWebLineLength() const {
+        return _ringWrite - activeRegionEnd();
+    }
+
+    void beginWebLine() {
+        _webLineOpen = true;
+        _webLineDropped = false;
+        _ringWrite = activeRegionEnd();
+
+        char prefix[MAX_WEB_PREFIX_LENGTH];
+        const size_t length = makeWebPrefix(
+            _currentLevel,
+            prefix,
+            sizeof(prefix)
+        );
+
+        for (size_t i = 0; i < length; ++i) {
+            putWebCharacter(prefix[i]);
+        }
+    }
+
+    /*
+     * Append one byte to the line being built, moving the line to the
+     * start of the ring when it reaches the end of the array. If there is
+     * no room the whole line is dropped.
+     */
+    void putWebCharacter(char character) {
+        if (_webLineDropped) {
+            ++_droppedWebBytes;
             return;
         }
 
-        String formattedLine;
-        formattedLine.reserve(
-            _webLine.length() + 24
-        );
+        const size_t limit = _ringBActive
+            ? _ringAStart
+            : MAX_WEB_BATCH_LENGTH;
+
+        if (_ringWrite >= limit) {
+            const size_t lineStart = activeRegionEnd();
+            const size_t lineLength = _ringWrite - lineStart;
 
-        formattedLine = makeWebPrefix(_currentLevel);
-        formattedLine += _webLine;
+            /*
+             * Keep one byte between B and A so a full ring is never
+             * mistaken for an empty one.
+             */
+            if (!_ringBActive && lineLength + 1 < _ringAStart) {
+                memmove(_webRing, _webRing + lineStart, lineLength);
+                _ringBActive = true;
+                _ringBEnd = 0;
+                _ringWrite = lineLength;
+            } else {
+                dropWebLine();
+                ++_droppedWebBytes;
+                return;
+            }
+        }
 
-        const size_t lineLength =
-            formattedLine.length() + 1;
+        _webRing[_ringWrite++] = character;
+    }
 
-        const size_t requiredLength =
-            _webBatch.length() + lineLength;
+    void dropWebLine() {
+        ++_droppedWebLines;
+        _droppedWebBytes += currentWebLineLength();
+        _ringWrite = activeRegionEnd();
+        _webLineDropped = true;
+    }
 
-        if (requiredLength <= MAX_WEB_BATCH_LENGTH) {
-            _webBatch += formattedLine;
-            _webBatch += '\n';
-        } else {
-            ++_droppedWebLines;
-            _droppedWebBytes += lineLength;
+    void flushWebSocketLine() {
+        if (!_webLineOpen) {
+            return;
         }
 
-        _webLine = "";
+        putWebCharacter('\n');
+
+        if (!_webLineDropped) {
+            if (_ringBActive) {
+                _ringBEnd = _ringWrite;
+            } else {
+                _ringAEnd = _ringWrite;
+            }
+        }
+
+        _ringWrite = activeRegionEnd();
+        _webLineOpen = false;
+        _webLineDropped = false;
     }
 
     void sendPendingWebBatch(bool force = false) {
@@ -549,16 +1144,41 @@ private:
             return;
         }
 
-        if (_webBatch.isEmpty() && _droppedWebLines == 0) {
+        if (webBatchLength() == 0 && _droppedWebLines == 0) {
             return;
         }
 
         /*
-         * Send the accumulated log batch first.
+         * Send the accumulated log batch first, straight out of the ring:
+         * region A, then region B, which then becomes the new region A.
+         */
+        if (_ringAEnd > _ringAStart) {
+            sendToWebClients(
+                _webRing + _ringAStart,
+                _ringAEnd - _ringAStart
+            );
+        }
+
+        if (_ringBActive) {
+            if (_ringBEnd > 0) {
+                sendToWebClients(_webRing, _ringBEnd);
+            }
+
+            _ringBActive = false;
+            _ringAEnd = _ringBEnd;
+            _ringBEnd = 0;
+        }
+
+        _ringAStart = _ringAEnd;
+
+        /*
+         * With nothing pending, restart at the beginning of the ring so
+         * region A has the whole array again.
          */
-        if (!_webBatch.isEmpty()) {
-            _webSocket->textAll(_webBatch);
-            _webBatch = "";
+        if (!_webLineOpen) {
+            _ringAStart = 0;
+            _ringAEnd = 0;
+            _ringWrite = 0;
         }
 
         /*
@@ -566,17 +1186,24 @@ private:
          * prevented by a full log batch.
          */
         if (_droppedWebLines > 0) {
-            String droppedMessage;
-            droppedMessage.reserve(112);
-
-            droppedMessage = "[Web debug dropped ";
-            droppedMessage += String(_droppedWebLines);
-            droppedMessage += " lines / ";
-            droppedMessage += String(_droppedWebBytes);
-            droppedMessage +=
-                " bytes because the output buffer was full]";
-
-            _webSocket->textAll(droppedMessage);
+            char droppedMessage[112];
+
+            const int length = snprintf(
+                droppedMessage,
+                sizeof(droppedMessage),
+                "[Web debug dropped %u lines / %u bytes because the output buffer was full]",
+                static_cast<unsigned>(_droppedWebLines),
+                static_cast<unsigned>(_droppedWebBytes)
+            );
+
+            if (length > 0) {
+                _webSocket->textAll(
+                    droppedMessage,
+                    static_cast<size_t>(length) < sizeof(droppedMessage)
+                        ? length
+                        : sizeof(droppedMessage) - 1
+                );
+            }
 
             _droppedWebLines = 0;
             _droppedWebBytes = 0;
@@ -585,17 +1212,237 @@ private:
         _lastWebBatchSend = now;
     }
 
+    void sendToWebClients(
+        const char* data,
+        size_t length
+    ) {
+        /*
+         * Each client gets its own copy through the public per-client
+         * call; sharing an AsyncWebSocketMessageBuffer works differently
+         * in each library major version, and there are at most
+         * MAX_WEB_CLIENTS copies.
+         */
+        std::lock_guard<std::mutex> lock(_webClientsMutex);
+        for (WebClientState& state : _webClients) {
+            if (state.id == 0) {
+                continue;
+            }
+
+            AsyncWebSocketClient* client = _webSocket->client(state.id);
+
+            if (client == nullptr) {
+                state = WebClientState();
+                continue;
+            }
+
+            if (client->queueIsFull()) {
+                size_t lines = 0;
+                for (size_t i = 0; i < length; ++i) {
+                    if (data[i] == '\n') {
+                        ++lines;
+                    }
+                }
+
+                state.droppedLines += lines;
+                state.droppedBytes += length;
+                _slowClientDroppedLines += lines;
+                continue;
+            }
+
+            if (state.droppedLines > 0) {
+                char notice[112];
+
+                const int noticeLength = snprintf(
+                    notice,
+                    sizeof(notice),
+                    "[Web debug skipped %u lines / %u bytes because this connection could not keep up]",
+                    static_cast<unsigned>(state.droppedLines),
+                    static_cast<unsigned>(state.droppedBytes)
+                );
+
+                if (noticeLength > 0) {
+                    client->text(
+                        notice,
+                        static_cast<size_t>(noticeLength) < sizeof(notice)
+                            ? noticeLength
+                            : sizeof(notice) - 1
+                    );
+                }
+
+                state.droppedLines = 0;
+                state.droppedBytes = 0;
+            }
+
+            client->text(data, length);
+        }
+    }
+
     void clearWebBuffers() {
-        _webLine = "";
-        _webBatch = "";
+        _ringAStart = 0;
+        _ringAEnd = 0;
+        _ringBEnd = 0;
+        _ringWrite = 0;
+        _ringBActive = false;
+        _webLineOpen = false;
+        _webLineDropped = false;
         _droppedWebLines = 0;
         _droppedWebBytes = 0;
     }
 
+    /**
+     * Token bucket of the call site using this format string, refilled
+     * up to now. nullptr for levels that are not rate limited.
+     */
+    CallSiteBucket* callSiteBucket(const char* format) {
+        if (_currentLevel < RemoteDebug::INFO ||
+            _currentLevel == RemoteDebug::ANY) {
+            return nullptr;
+        }
+
+        const uint32_t now = millis();
+        CallSiteBucket* bucket = nullptr;
+        CallSiteBucket* victim = &_callSites[0];
+
+        for (CallSiteBucket& candidate : _callSites) {
+            if (candidate.format == format) {
+                bucket = &candidate;
+                break;
+            }
+            if (victim->format != nullptr && (
+                    candidate.format == nullptr ||
+                    now - candidate.lastUse > now - victim->lastUse)) {
+                victim = &candidate;
+            }
+        }
+
+        if (bucket == nullptr) {
+            bucket = victim;
+            *bucket = CallSiteBucket();
+            bucket->format = format;
+            bucket->tokens = LOG_TOKEN_BURST;
+            bucket->lastRefill = now;
+        }
+        bucket->lastUse = now;
+
+        const uint32_t refill =
+            (now - bucket->lastRefill) / LOG_TOKEN_INTERVAL_MS;
+        if (refill > 0) {
+            const uint32_t missing = LOG_TOKEN_BURST - bucket->tokens;
+            bucket->tokens = refill >= missing
+                ? LOG_TOKEN_BURST
+                : bucket->tokens + refill;
+            bucket->lastRefill += refill * LOG_TOKEN_INTERVAL_MS;
+        }
+        if (bucket->tokens == LOG_TOKEN_BURST) {
+            bucket->lastRefill = now;
+        }
+
+        return bucket;
+    }
+
+    /**
+     * Spend a token for the line about to be written. Sends a
+     * "suppressed" notice ahead of it if the site had lines dropped.
+     */
+    bool spendLogToken(CallSiteBucket* bucket) {
+        if (bucket->tokens == 0) {
+            return false;
+        }
+        --bucket->tokens;
+
+        if (bucket->suppressed > 0) {
+            char notice[64];
+            const int length = snprintf(
+                notice,
+                sizeof(notice),
+                "[%lu similar messages suppressed]\n",
+                static_cast<unsigned long>(bucket->suppressed)
+            );
+            bucket->suppressed = 0;
+            writeNotice(_currentLevel, notice, length);
+        }
+
+        return true;
+    }
+
+    void suppressLine(CallSiteBucket* bucket) {
+        ++bucket->suppressed;
+        ++_rateLimitedLines;
+        resetRoutingState();
+    }
+
+    /**
+     * True if this line is identical to the previous limited line, in
+     * which case it is only counted. Otherwise any pending repeat
+     * summary is sent first.
+     */
+    bool isRepeatedLine(
+        const char* format,
+        const char* line,
+        size_t length
+    ) {
+        // FNV-1a
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < length; ++i) {
+            hash = (hash ^ static_cast<uint8_t>(line[i])) * 16777619u;
+        }
+
+        if (format == _lastLineFormat &&
+            hash == _lastLineHash &&
+            _currentLevel == _lastLineLevel) {
+            if (_repeatCount++ == 0) {
+                _repeatSince = millis();
+            }
+            ++_collapsedRepeats;
+            return true;
+        }
+
+        flushRepeatSummary();
+        _lastLineFormat = format;
+        _lastLineHash = hash;
+        _lastLineLevel = _currentLevel;
+        return false;
+    }
+
+    void flushRepeatSummary() {
+        if (_repeatCount == 0) {
+            return;
+        }
+
+        char summary[64];
+        const int length = snprintf(
+            summary,
+            sizeof(summary),
+            "[previous message repeated %lu times]\n",
+            static_cast<unsigned long>(_repeatCount)
+        );
+        _repeatCount = 0;
+        writeNotice(_lastLineLevel, summary, length);
+    }
+
+    /**
+     * Write a complete line at the given level without disturbing the
+     * routing of a message that is about to be written.
+     */
+    void writeNotice(uint8_t level, const char* text, int length) {
+        const bool pending = _levelCheckPending;
+        const uint8_t current = _currentLevel;
+
+        if (length > 0 && isActive(level)) {
+            write(reinterpret_cast<const uint8_t*>(text), length);
+        }
+        resetRoutingState();
+
+        if (pending) {
+            isActive(current);
+        }
+    }
+
     void resetRoutingState() {
         _levelCheckPending = false;
         _currentRemoteActive = false;
         _currentWebActive = false;
+        _currentCrashActive = false;
         _currentLevel = RemoteDebug::ANY;
     }
 
@@ -651,23 +1498,16 @@ private:
         }
     }
 
-    String makeWebPrefix(uint8_t level) {
+    size_t makeWebPrefix(
+        uint8_t level,
+        char* prefix,
+        size_t capacity
+    ) {
         if (!_webShowDebugLevel && !_webShowProfiler) {
-            return "";
-        }
-
-        String prefix;
-        prefix.reserve(24);
-
-        prefix += '(';
-
-        if (_webShowDebugLevel) {
-            prefix += levelCharacter(level);
+            return 0;
         }
 
-        if (_webShowDebugLevel && _webShowProfiler) {
-            prefix += ' ';
-        }
+        int length = 0;
 
         if (_webShowProfiler) {
             const uint32_t now = millis();
@@ -680,8 +1520,6 @@ private:
 
             _lastWebLogTime = now;
 
-            prefix += "p:^";
-
             /*
             * Match RemoteDebug's four-digit minimum formatting:
             *
@@ -690,26 +1528,97 @@ private:
             * 830  -> 0830
             * 1002 -> 1002
             */
-            if (elapsed < 1000) {
-                prefix += '0';
+            if (_webShowDebugLevel) {
+                length = snprintf(
+                    prefix,
+                    capacity,
+                    "(%c p:^%04ums) ",
+                    levelCharacter(level),
+                    static_cast<unsigned>(elapsed)
+                );
+            } else {
+                length = snprintf(
+                    prefix,
+                    capacity,
+                    "(p:^%04ums) ",
+                    static_cast<unsigned>(elapsed)
+                );
             }
-
-            if (elapsed < 100) {
-                prefix += '0';
-            }
-
-            if (elapsed < 10) {
-                prefix += '0';
-            }
-
-            prefix += String(elapsed);
-            prefix += "ms";
+        } else {
+            length = snprintf(
+                prefix,
+                capacity,
+                "(%c) ",
+                levelCharacter(level)
+            );
         }
 
-        prefix += ") ";
+        if (length < 0) {
+            return 0;
+        }
 
-        return prefix;
+        return static_cast<size_t>(length) < capacity
+            ? length
+            : capacity - 1;
     }
 };
 
+/*
+ * Compile-time log ceilings.
+ *
+ * Each module may strip debug calls below a level at compile time, so they
+ * cost nothing at runtime (not even the Debug.isActive() check). Set them
+ * with build_flags, e.g.
+ *
+ *   -D SPA_LOG_LEVEL_SERIAL=SPA_LOG_DEBUG   ; drop byte-level serial tracing
+ *   -D SPA_LOG_LEVEL_MQTT=SPA_LOG_INFO
+ *
+ * A source file selects its ceiling after its includes:
+ *
+ *   #undef SPA_LOG_MODULE_LEVEL
+ *   #define SPA_LOG_MODULE_LEVEL SPA_LOG_LEVEL_SERIAL
+ *
+ * ERROR and ANY output is never stripped.
+ */
+#define SPA_LOG_VERBOSE 1
+#define SPA_LOG_DEBUG   2
+#define SPA_LOG_INFO    3
+#define SPA_LOG_WARNING 4
+#define SPA_LOG_ERROR   5
+
+#ifndef SPA_LOG_LEVEL_DEFAULT
+#define SPA_LOG_LEVEL_DEFAULT SPA_LOG_VERBOSE
+#endif
+#ifndef SPA_LOG_LEVEL_SERIAL
+#define SPA_LOG_LEVEL_SERIAL SPA_LOG_LEVEL_DEFAULT
+#endif
+#ifndef SPA_LOG_LEVEL_MQTT
+#define SPA_LOG_LEVEL_MQTT SPA_LOG_LEVEL_DEFAULT
+#endif
+#ifndef SPA_LOG_LEVEL_WEB
+#define SPA_LOG_LEVEL_WEB SPA_LOG_LEVEL_DEFAULT
+#endif
+
+#define SPA_LOG_MODULE_LEVEL SPA_LOG_LEVEL_DEFAULT
+
+#define SPA_LOG_ALLOWED(level) ((level) >= SPA_LOG_MODULE_LEVEL)
+
+#undef debugV
+#undef debugD
+#undef debugI
+#undef debugW
+#define debugV(fmt, ...) if (SPA_LOG_ALLOWED(SPA_LOG_VERBOSE)) rdebugVln(fmt, ##__VA_ARGS__)
+#define debugD(fmt, ...) if (SPA_LOG_ALLOWED(SPA_LOG_DEBUG)) rdebugDln(fmt, ##__VA_ARGS__)
+#define debugI(fmt, ...) if (SPA_LOG_ALLOWED(SPA_LOG_INFO)) rdebugIln(fmt, ##__VA_ARGS__)
+#define debugW(fmt, ...) if (SPA_LOG_ALLOWED(SPA_LOG_WARNING)) rdebugWln(fmt, ##__VA_ARGS__)
+
+/*
+ * Deferred counterparts of the RemoteDebug macros for hot paths (per-byte
+ * and per-field parsing). See WebRemoteDebug::logDeferred() for the
+ * argument rules.
+ */
+#define debugDeferredV(fmt, ...) do { if (SPA_LOG_ALLOWED(SPA_LOG_VERBOSE) && Debug.isLevelActive(Debug.VERBOSE)) Debug.logDeferred(Debug.VERBOSE, __func__, fmt, ##__VA_ARGS__); } while (0)
+#define debugDeferredD(fmt, ...) do { if (SPA_LOG_ALLOWED(SPA_LOG_DEBUG) && Debug.isLevelActive(Debug.DEBUG)) Debug.logDeferred(Debug.DEBUG, __func__, fmt, ##__VA_ARGS__); } while (0)
+#define debugDeferredI(fmt, ...) do { if (SPA_LOG_ALLOWED(SPA_LOG_INFO) && Debug.isLevelActive(Debug.INFO)) Debug.logDeferred(Debug.INFO, __func__, fmt, ##__VA_ARGS__); } while (0)
+
 #endif // WEB_REMOTE_DEBUG_H
@@ -1,5 +1,8 @@
 #include "WebUI.h"
 
+#undef SPA_LOG_MODULE_LEVEL
+#define SPA_LOG_MODULE_LEVEL SPA_LOG_LEVEL_WEB
+
 WebUI::WebUI(SpaInterface *spa, Config *config, MQTTClientWrapper *mqttClient) {
     _spa = spa;
     _config = config;
@@ -7,13 +10,313 @@ WebUI::WebUI(SpaInterface *spa, Config *config, MQTTClientWrapper *mqttClient) {
 }
 
 const char * WebUI::getError() {
-    return Update.errorString();
+    return _ota.hasError() ? _ota.error() : Update.errorString();
+}
+
+void WebUI::sendChunkedResponse(AsyncWebServerRequest *request, const char *contentType, ChunkGenerator generator) {
+    // The filler is called from the async TCP task each time there is room in the
+    // send buffer, so the state has to outlive this call.
+    struct ChunkState {
+        ChunkGenerator generator;
+        String piece;
+        size_t offset = 0;
+        bool finished = false;
+    };
+    auto state = std::make_shared<ChunkState>();
+    state->generator = std::move(generator);
+    RouteMetrics *route = _activeRoute;
+
+    AsyncWebServerResponse *response = request->beginChunkedResponse(contentType,
+        [state, route](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+            size_t written = 0;
+            while (written < maxLen && !state->finished) {
+                if (state->offset >= state->piece.length()) {
+                    state->piece = "";
+                    state->offset = 0;
+                    if (!state->generator(state->piece)) {
+                        state->finished = true;
+                    }
+                    continue;
+                }
+                size_t count = state->piece.length() - state->offset;
+                if (count > maxLen - written) count = maxLen - written;
+                memcpy(buffer + written, state->piece.c_str() + state->offset, count);
+                state->offset += count;
+                written += count;
+            }
+            if (route != nullptr) {
+                route->responseBytes += written;
+                recordHeap(route);
+            }
+            return written; // returning 0 ends the chunked response
+        });
+    response->addHeader("Connection", "close");
+    request->send(response);
+}
+
+void WebUI::sendSharedResponse(AsyncWebServerRequest *request, const char *contentType, std::shared_ptr<const String> body) {
+    AsyncWebServerResponse *response = request->beginResponse(contentType, body->length(),
+        [body](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+            if (index >= body->length()) return 0;
+            size_t count = body->length() - index;
+            if (count > maxLen) count = maxLen;
+            memcpy(buffer, body->c_str() + index, count);
+            return count;
+        });
+    response->addHeader("Connection", "close");
+    request->send(response);
+    if (_activeRoute != nullptr) _activeRoute->responseBytes += body->length();
+}
+
+void WebUI::sendText(AsyncWebServerRequest *request, int code, const char *contentType, const String &body) {
+    AsyncWebServerResponse *response = request->beginResponse(code, contentType, body);
+    response->addHeader("Connection", "close");
+    request->send(response);
+    if (_activeRoute != nullptr) _activeRoute->responseBytes += body.length();
+}
+
+void WebUI::recordHeap(RouteMetrics *route) {
+    const uint32_t freeHeap = ESP.getFreeHeap();
+    if (freeHeap < route->minFreeHeap) route->minFreeHeap = freeHeap;
+}
+
+void WebUI::onRoute(const char *uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest,
+                    ArUploadHandlerFunction onUpload) {
+    if (_routeCount >= MAX_ROUTES) {
+        debugW("Route table full, %s is not instrumented", uri);
+        if (onUpload) server.on(uri, method, onRequest, onUpload);
+        else server.on(uri, method, onRequest);
+        return;
+    }
+
+    RouteMetrics *route = &_routes[_routeCount++];
+    route->uri = uri;
+    route->method = method == HTTP_GET ? "GET" : method == HTTP_POST ? "POST" : "ANY";
+
+    ArRequestHandlerFunction instrumented = [this, route, onRequest](AsyncWebServerRequest *request) {
+        SPA_HEAP_TAG(WebUI);
+        RouteMetrics *previous = _activeRoute;
+        _activeRoute = route;
+        recordHeap(route);
+        const uint32_t start = micros();
+
+        onRequest(request);
+
+        const uint32_t elapsed = micros() - start;
+        recordHeap(route);
+        _activeRoute = previous;
+
+        route->requests++;
+        route->latencyTotalUs += elapsed;
+        if (elapsed > route->latencyMaxUs) route->latencyMaxUs = elapsed;
+        size_t bucket = 0;
+        while (bucket < ROUTE_LATENCY_BUCKETS - 1 && elapsed > ROUTE_LATENCY_BOUNDS_US[bucket]) bucket++;
+        route->latency[bucket]++;
+    };
+
+    if (onUpload) server.on(uri, method, instrumented, onUpload);
+    else server.on(uri, method, instrumented);
+}
+
+void WebUI::appendHeapMetrics(String &piece) const {
+    const HeapTracker::Snapshot heap = HeapTracker::snapshot();
+    piece += "# TYPE espa_largest_free_block_bytes gauge\nespa_largest_free_block_bytes " + String(ESP.getMaxAllocHeap()) + "\n";
+    piece += "# TYPE espa_min_largest_free_block_bytes gauge\nespa_min_largest_free_block_bytes " + String(heap.minLargestFreeBlock) + "\n";
+    if (!HeapTracker::trackingAllocations()) return;
+
+    piece += "# TYPE espa_heap_allocations_total counter\n";
+    piece += "# TYPE espa_heap_allocated_bytes_total counter\n";
+    for (size_t i = 0; i < HeapTracker::TAG_COUNT; i++) {
+        const String labels = String("{subsystem=\"") + HeapTracker::tagName(i) + "\"} ";
+        piece += "espa_heap_allocations_total" + labels + String(heap.allocations[i]) + "\n";
+        piece += "espa_heap_allocated_bytes_total" + labels + String(heap.allocatedBytes[i]) + "\n";
+    }
+    piece += "# TYPE espa_heap_poll_allocations gauge\nespa_heap_poll_allocations " + String(heap.lastPollAllocations) + "\n";
+    piece += "# TYPE espa_heap_max_poll_allocations gauge\nespa_heap_max_poll_allocations " + String(heap.maxPollAllocations) + "\n";
+    piece += "# TYPE espa_heap_over_budget_polls_total counter\nespa_heap_over_budget_polls_total " + String(heap.overBudgetPolls) + "\n";
+}
+
+void WebUI::appendLinkMetrics(String &piece) const {
+    const SpaInterface::LinkMetrics &link = _spa->getLinkMetrics();
+
+    auto histogram = [&piece](const char *name, const SpaInterface::LinkHistogram &h, double scale) {
+        piece += String("# TYPE ") + name + " histogram\n";
+        // Every other log2 bound (powers of 4) keeps the output short.
+        uint32_t cumulative = 0;
+        for (size_t b = 0; b < SpaInterface::LinkHistogram::BUCKETS; b++) {
+            cumulative += h.buckets[b];
+            const uint32_t bound = SpaInterface::LinkHistogram::bound(b);
+            if (bound != 0 && b % 2 == 0) continue;
+            const String le = bound != 0 ? String(bound * scale, scale < 1 ? 6 : 0) : String("+Inf");
+            piece += String(name) + "_bucket{le=\"" + le + "\"} " + String(cumulative) + "\n";
+        }
+        piece += String(name) + "_sum " + String(h.sum * scale, scale < 1 ? 6 : 0) + "\n";
+        piece += String(name) + "_count " + String(h.count) + "\n";
+    };
+    histogram("espa_serial_first_byte_seconds", link.firstByteUs, 1e-6);
+    histogram("espa_serial_command_frame_seconds", link.commandFrameUs, 1e-6);
+    histogram("espa_serial_status_frame_seconds", link.statusFrameUs, 1e-6);
+    histogram("espa_serial_status_frame_bytes", link.statusFrameBytes, 1);
+    histogram("espa_serial_wake_seconds", link.wakeUs, 1e-6);
+
+    auto counter = [&piece](const char *name, uint32_t value) {
+        piece += String("# TYPE ") + name + " counter\n" + name + " " + String(value) + "\n";
+    };
+    counter("espa_serial_commands_total", link.commands);
+    counter("espa_serial_no_response_total", link.noResponse);
+    counter("espa_serial_stray_bytes_total", link.strayBytes);
+    counter("espa_serial_stray_flushes_total", link.strayFlushes);
+    counter("espa_serial_register_errors_total", link.registerErrors);
+    counter("espa_serial_echo_mismatches_total", link.echoMismatches);
+    counter("espa_serial_polls_total", link.polls);
+    counter("espa_serial_poll_retries_total", link.pollRetries);
+    counter("espa_serial_command_retries_total", link.commandRetries);
+    counter("espa_serial_retry_recoveries_total", link.retryRecoveries);
+    counter("espa_serial_confirmed_writes_total", link.confirmedWrites);
+    counter("espa_serial_write_divergences_total", link.writeDivergences);
+    counter("espa_serial_salvaged_frames_total", link.salvagedFrames);
+    counter("espa_serial_profile_redetections_total", link.profileRedetections);
+    counter("espa_serial_async_writes_total", link.asyncWrites);
+    counter("espa_serial_collapsed_writes_total", link.collapsedWrites);
+    counter("espa_serial_rolled_back_writes_total", link.rolledBackWrites);
+
+    // 1 while the register's values are carried over from an earlier RF frame.
+    piece += "# TYPE espa_serial_register_stale gauge\n";
+    const uint16_t stale = _spa->getStaleRegisters();
+    for (size_t r = 0; r < SpaInterface::registerCount(); r++) {
+        piece += String("espa_serial_register_stale{register=\"") + SpaInterface::registerName(r) + "\"} " + String((stale >> r) & 1) + "\n";
+    }
+
+    piece += "# TYPE espa_serial_firmware_profile_valid gauge\n";
+    piece += "espa_serial_firmware_profile_valid " + String(_spa->getFirmwareProfile().valid ? 1 : 0) + "\n";
+
+    const ClockSync &clock = _spa->getClockSync();
+    if (clock.hasOffset()) {
+        piece += "# TYPE espa_spa_clock_offset_seconds gauge\n";
+        piece += "espa_spa_clock_offset_seconds " + String(clock.offsetS()) + "\n";
+    }
+    if (clock.driftKnown()) {
+        piece += "# TYPE espa_spa_clock_drift_ppm gauge\n";
+        piece += "espa_spa_clock_drift_ppm " + String(clock.driftPpm(), 2) + "\n";
+    }
+    counter("espa_spa_clock_corrections_total", clock.corrections());
+
+    const LinkTiming &timing = _spa->getLinkTiming();
+    piece += "# TYPE espa_serial_gap_timeout_seconds gauge\n";
+    piece += "espa_serial_gap_timeout_seconds " + String(timing.gapTimeoutMs() / 1e3, 3) + "\n";
+    piece += "# TYPE espa_serial_wake_level gauge\n";
+    piece += "espa_serial_wake_level " + String(timing.wakeLevel()) + "\n";
+    piece += "# TYPE espa_serial_wake_settled gauge\n";
+    piece += "espa_serial_wake_settled " + String(timing.wakeSettled() ? 1 : 0) + "\n";
+    piece += "# TYPE espa_serial_response_timeout_seconds gauge\n";
+    piece += "# TYPE espa_serial_response_timeouts_total counter\n";
+    for (size_t i = 0; i < LinkTiming::MAX_COMMANDS; i++) {
+        const LinkTiming::CommandTiming &command = timing.commands()[i];
+        if (command.code[0] == '\0') break;
+        const String labels = String("{command=\"") + command.code + "\"} ";
+        piece += "espa_serial_response_timeout_seconds" + labels + String(LinkTiming::responseTimeoutMs(command) / 1e3, 3) + "\n";
+        piece += "espa_serial_response_timeouts_total" + labels + String(command.timeouts) + "\n";
+    }
+}
+
+bool WebUI::loopMetricsPiece(size_t index, String &piece) const {
+    if (_loopProfiler == nullptr) return false;
+    const size_t phases = _loopProfiler->phaseCount();
+    if (index > phases) return false;
+
+    if (index == 0) {
+        piece = "# TYPE espa_loop_phase_duration_seconds histogram\n";
+        piece += "# TYPE espa_loop_phase_duration_quantile_seconds gauge\n";
+        piece += "# TYPE espa_loop_phase_duration_max_seconds gauge\n";
+    }
+
+    if (index < phases) {
+        const LoopProfiler::PhaseStats &stats = _loopProfiler->stats(index);
+        const String labels = String("phase=\"") + _loopProfiler->phaseName(index) + "\"";
+        // The profiler keeps log2 buckets; every other bound (powers of 4) keeps the output short.
+        uint32_t cumulative = 0;
+        for (size_t b = 0; b < LoopProfiler::BUCKETS; b++) {
+            cumulative += stats.buckets[b];
+            const uint32_t bound = LoopProfiler::bucketBoundUs(b);
+            if (bound != 0 && b % 2 == 0) continue;
+            const String le = bound != 0 ? String(bound / 1e6, 6) : String("+Inf");
+            piece += "espa_loop_phase_duration_seconds_bucket{" + labels + ",le=\"" + le + "\"} " + String(cumulative) + "\n";
+        }
+        piece += "espa_loop_phase_duration_seconds_sum{" + labels + "} " + String(stats.totalUs / 1e6, 6) + "\n";
+        piece += "espa_loop_phase_duration_seconds_count{" + labels + "} " + String(stats.count) + "\n";
+        piece += "espa_loop_phase_duration_quantile_seconds{" + labels + ",quantile=\"0.5\"} " + String(_loopProfiler->percentileUs(index, 50) / 1e6, 6) + "\n";
+        piece += "espa_loop_phase_duration_quantile_seconds{" + labels + ",quantile=\"0.99\"} " + String(_loopProfiler->percentileUs(index, 99) / 1e6, 6) + "\n";
+        piece += "espa_loop_phase_duration_max_seconds{" + labels + "} " + String(stats.maxUs / 1e6, 6) + "\n";
+        return true;
+    }
+
+    piece = "# TYPE espa_loop_stall_seconds gauge\n";
+    piece += "# TYPE espa_loop_stall_uptime_seconds gauge\n";
+    const LoopProfiler::Stall *stalls = _loopProfiler->stalls();
+    for (size_t i = 0; i < LoopProfiler::MAX_STALLS && stalls[i].durationUs != 0; i++) {
+        const String labels = String("rank=\"") + String(i + 1) + "\",phase=\"" + _loopProfiler->phaseName(stalls[i].phase) + "\"";
+        piece += "espa_loop_stall_seconds{" + labels + "} " + String(stalls[i].durationUs / 1e6, 6) + "\n";
+        piece += "espa_loop_stall_uptime_seconds{" + labels + "} " + String(stalls[i].atMs / 1e3, 3) + "\n";
+    }
+    return true;
+}
+
+String WebUI::getRouteMetricsSummary() const {
+    String summary;
+    for (size_t i = 0; i < _routeCount; i++) {
+        const RouteMetrics &route = _routes[i];
+        if (route.requests == 0) continue;
+        if (!summary.isEmpty()) summary += "\n";
+        summary += String(route.method) + " " + route.uri;
+        summary += ": requests=" + String(route.requests);
+        summary += ", avg=" + String((uint32_t)(route.latencyTotalUs / route.requests)) + "us";
+        summary += ", max=" + String(route.latencyMaxUs) + "us";
+        summary += ", bytes=" + String((uint32_t)route.responseBytes);
+        summary += ", min heap=" + String(route.minFreeHeap);
+    }
+    return summary;
+}
+
+std::shared_ptr<const String> WebUI::getStatusJson(bool pretty) {
+    const uint32_t version = _spa->getStatusVersion();
+    const bool mqttConnected = _mqttClient->connected();
+    StatusJsonCache &cache = _statusJson[pretty ? 1 : 0];
+
+    {
+        std::lock_guard<std::mutex> lock(_statusJsonMutex);
+        if (cache.result && cache.version == version && cache.mqttConnected == mqttConnected) {
+            _statusJsonShared++;
+            return cache.result;
+        }
+    }
+
+    auto json = std::make_shared<String>();
+    if (!generateStatusJson(*_spa, *_mqttClient, *json, pretty)) return nullptr;
+    std::shared_ptr<const String> result = json;
+
+    std::lock_guard<std::mutex> lock(_statusJsonMutex);
+    _statusJsonRenders++;
+    // Another task may have rendered a newer version meanwhile; keep that one.
+    if (!cache.result || (int32_t)(version - cache.version) >= 0) {
+        cache.result = result;
+        cache.version = version;
+        cache.mqttConnected = mqttConnected;
+    }
+    return result;
+}
+
+WebUI::StatusJsonStats WebUI::getStatusJsonStats() const {
+    StatusJsonStats stats;
+    stats.renders = _statusJsonRenders;
+    stats.shared = _statusJsonShared;
+    return stats;
 }
 
 void WebUI::begin() {
     configureDebugWebSocket();
+    configureApiWebSocket();
 
-    server.on("/reboot", HTTP_GET, [&](AsyncWebServerRequest *request) {
+    onRoute("/reboot", HTTP_GET, [&](AsyncWebServerRequest *request) {
         debugD("uri: %s", request->url().c_str());
 
         AsyncWebServerResponse *response = request->beginResponse(200, "text/plain", "Rebooting ESP...");
@@ -26,27 +329,27 @@ void WebUI::begin() {
         ESP.restart();
     });
 
-    server.on("/fota", HTTP_GET, [&](AsyncWebServerRequest *request) {
+    onRoute("/fota", HTTP_GET, [&](AsyncWebServerRequest *request) {
         debugD("uri: %s", request->url().c_str());
-        request->send(200, "text/html", fotaPage);
+        sendText(request, 200, "text/html", fotaPage);
     });
 
-    server.on("/config", HTTP_GET, [&](AsyncWebServerRequest *request) {
+    onRoute("/config", HTTP_GET, [&](AsyncWebServerRequest *request) {
         debugD("uri: %s", request->url().c_str());
         request->send(SPIFFS, "/www/config.htm");
     });
 
-    server.on("/fota", HTTP_POST, [this](AsyncWebServerRequest *request) {
+    onRoute("/fota", HTTP_POST, [this](AsyncWebServerRequest *request) {
         debugD("uri: %s", request->url().c_str());
-        if (Update.hasError()) {
-            AsyncWebServerResponse *response = request->beginResponse(200, "text/plain", String("Update error: ") + String(this->getError()));
-            response->addHeader("Connection", "close");
-            request->send(response);
+        if (_ota.hasError() || Update.hasError()) {
+            sendText(request, 500, "text/plain", String("Update error: ") + String(this->getError()));
         } else {
             request->client()->setNoDelay(true);
-            AsyncWebServerResponse *response = request->beginResponse(200, "text/plain", "OK");
-            response->addHeader("Connection", "close");
-            request->send(response);
+            const OtaUpdater::Stats &stats = _ota.stats();
+            String body = "OK (" + String(stats.receivedBytes) + " bytes" + (stats.compressed ? " gzip" : "") +
+                          " in " + String(stats.elapsedMs) + " ms, " + String(_ota.bytesPerSecond()) + " B/s, flash " +
+                          String(stats.flashWriteMs) + " ms, sha256 " + _ota.sha256() + ")";
+            sendText(request, 200, "text/plain", body);
         }
     }, [this](AsyncWebServerRequest *request, String filename, size_t index, uint8_t *data, size_t len, bool final) {
         if (index == 0) {
@@ -69,24 +372,32 @@ void WebUI::begin() {
                 debugD("No update type specified. Defaulting to application update.");
             }
 
-            debugD("Update: %s", filename.c_str());
-            if (!Update.begin(UPDATE_SIZE_UNKNOWN, updateType)) { // start with max available size
+            // Expected hash comes from a form field sent ahead of the file, or a header.
+            String sha256;
+            if (request->hasArg("sha256")) sha256 = request->arg("sha256");
+            else if (request->hasHeader("X-Update-SHA256")) sha256 = request->header("X-Update-SHA256");
+
+            debugD("Update: %s%s", filename.c_str(), sha256.isEmpty() ? "" : " (SHA-256 check)");
+            if (!_ota.begin(updateType, sha256.c_str())) {
                 debugD("Update Error: %s", this->getError());
             }
         }
-        if (Update.write(data, len) != len) {
+        if (!_ota.hasError() && !_ota.write(data, len)) {
             debugD("Update Error: %s", this->getError());
         }
         if (final) {
-            if (Update.end(true)) { // true to set the size to the current progress
-                debugD("Update Success: %u\n", index + len);
+            if (_ota.end()) {
+                const OtaUpdater::Stats &stats = _ota.stats();
+                debugI("Update Success: %u bytes received, %u written%s, %u ms (%u B/s), flash write %u ms, sha256 %s",
+                       stats.receivedBytes, stats.writtenBytes, stats.compressed ? " (gzip)" : "",
+                       stats.elapsedMs, _ota.bytesPerSecond(), stats.flashWriteMs, _ota.sha256());
             } else {
                 debugD("Update Error: %s", this->getError());
             }
         }
     });
 
-    server.on("/config", HTTP_POST, [this](AsyncWebServerRequest *request) {
+    onRoute("/config", HTTP_POST, [this](AsyncWebServerRequest *request) {
         debugD("uri: %s", request->url().c_str());
         if (request->hasParam("spaName", true)) _config->SpaName.setValue(request->getParam("spaName", true)->value());
         if (request->hasParam("softAPAlwaysOn", true)) _config->SoftAPAlwaysOn.setValue(true);
@@ -97,81 +408,128 @@ void WebUI::begin() {
         if (request->hasParam("mqttUsername", true)) _config->MqttUsername.setValue(request->getParam("mqttUsername", true)->value());
         if (request->hasParam("mqttPassword", true)) _config->MqttPassword.setValue(request->getParam("mqttPassword", true)->value());
         if (request->hasParam("spaPollFrequency", true)) _config->SpaPollFrequency.setValue(request->getParam("spaPollFrequency", true)->value().toInt());
+        if (request->hasParam("timeZone", true)) _config->TimeZone.setValue(request->getParam("timeZone", true)->value());
         _config->writeConfig();
-        AsyncWebServerResponse *response = request->beginResponse(200, "text/plain", "Updated");
-        response->addHeader("Connection", "close");
-        request->send(response);
+        sendText(request, 200, "text/plain", "Updated");
     });
 
-    server.on("/json/config", HTTP_GET, [this](AsyncWebServerRequest *request) {
+    onRoute("/json/config", HTTP_GET, [this](AsyncWebServerRequest *request) {
         debugD("uri: %s", request->url().c_str());
-        String configJson = "{";
-        configJson += "\"spaName\":\"" + _config->SpaName.getValue() + "\",";
-        configJson += "\"softAPAlwaysOn\":" + String(_config->SoftAPAlwaysOn.getValue() ? "true" : "false") + ",";
-        configJson += "\"softAPPassword\":\"" + _config->SoftAPPassword.getValue() + "\",";
-        configJson += "\"mqttServer\":\"" + _config->MqttServer.getValue() + "\",";
-        configJson += "\"mqttPort\":\"" + String(_config->MqttPort.getValue()) + "\",";
-        configJson += "\"mqttUsername\":\"" + _config->MqttUsername.getValue() + "\",";
-        configJson += "\"mqttPassword\":\"" + _config->MqttPassword.getValue() + "\",";
-        configJson += "\"spaPollFrequency\":" + String(_config->SpaPollFrequency.getValue());
-        configJson += "}";
-        AsyncWebServerResponse *response = request->beginResponse(200, "application/json", configJson);
-        response->addHeader("Connection", "close");
-        request->send(response);
+        // Emit one field per piece rather than building the whole document up front.
+        auto field = std::make_shared<int>(0);
+        sendChunkedResponse(request, "application/json", [this, field](String &piece) {
+            switch ((*field)++) {
+                case 0: piece = "{\"spaName\":\"" + _config->SpaName.getValue() + "\","; break;
+                case 1: piece = "\"softAPAlwaysOn\":" + String(_config->SoftAPAlwaysOn.getValue() ? "true" : "false") + ","; break;
+                case 2: piece = "\"softAPPassword\":\"" + _config->SoftAPPassword.getValue() + "\","; break;
+                case 3: piece = "\"mqttServer\":\"" + _config->MqttServer.getValue() + "\","; break;
+                case 4: piece = "\"mqttPort\":\"" + String(_config->MqttPort.getValue()) + "\","; break;
+                case 5: piece = "\"mqttUsername\":\"" + _config->MqttUsername.getValue() + "\","; break;
+                case 6: piece = "\"mqttPassword\":\"" + _config->MqttPassword.getValue() + "\","; break;
+                case 7: piece = "\"spaPollFrequency\":" + String(_config->SpaPollFrequency.getValue()) + ","; break;
+                case 8: piece = "\"timeZone\":\"" + _config->TimeZone.getValue() + "\"}"; break;
+                default: return false;
+            }
+            return true;
+        });
     });
 
-    server.on("/json", HTTP_GET, [&](AsyncWebServerRequest *request) {
+    onRoute("/json", HTTP_GET, [&](AsyncWebServerRequest *request) {
         debugD("uri: %s", request->url().c_str());
-        String json;
-        AsyncWebServerResponse *response;
-        if (generateStatusJson(*_spa, *_mqttClient, json, true)) {
-            response = request->beginResponse(200, "application/json", json);
+        _httpApiRequests++;
+        std::shared_ptr<const String> json = getStatusJson(true);
+        if (json) {
+            sendSharedResponse(request, "application/json", json);
         } else {
-            response = request->beginResponse(200, "text/plain", "Error generating json");
+            sendText(request, 200, "text/plain", "Error generating json");
         }
-        response->addHeader("Connection", "close");
-        request->send(response);
     });
 
     // Handle /set endpoint (POST)
-    server.on("/set", HTTP_POST, [this](AsyncWebServerRequest *request) {
+    onRoute("/set", HTTP_POST, [this](AsyncWebServerRequest *request) {
         debugD("uri: %s", request->url().c_str());
+        _httpApiRequests++;
 
         if (_setSpaCallback != nullptr) {
             for (uint8_t i = 0; i < request->params(); i++) {
                 _setSpaCallback(request->getParam(i)->name(), request->getParam(i)->value());
             }
-            AsyncWebServerResponse *response = request->beginResponse(200, "text/plain", "Spa update initiated");
-            response->addHeader("Connection", "close");
-            request->send(response);
+            sendText(request, 200, "text/plain", "Spa update initiated");
         } else {
-            AsyncWebServerResponse *response = request->beginResponse(400, "text/plain", "setSpaCallback not set");
-            response->addHeader("Connection", "close");
-            request->send(response);
+            sendText(request, 400, "text/plain", "setSpaCallback not set");
         }
     });
 
     // Handle /wifi-manager endpoint (GET)
-    server.on("/wifi-manager", HTTP_GET, [this](AsyncWebServerRequest *request) {
+    onRoute("/wifi-manager", HTTP_GET, [this](AsyncWebServerRequest *request) {
         debugD("uri: %s", request->url().c_str());
-        AsyncWebServerResponse *response = request->beginResponse(200, "text/plain", "WiFi Manager launching, connect to ESP WiFi...");
-        response->addHeader("Connection", "close");
-        request->send(response);
+        sendText(request, 200, "text/plain", "WiFi Manager launching, connect to ESP WiFi...");
         if (_wifiManagerCallback != nullptr) { _wifiManagerCallback(); }
     });
 
-    server.on("/status", HTTP_GET, [this](AsyncWebServerRequest *request) {
+    onRoute("/status", HTTP_GET, [this](AsyncWebServerRequest *request) {
         debugD("uri: %s", request->url().c_str());
-        AsyncWebServerResponse *response = request->beginResponse(200, "text/plain", _spa->statusResponse.get());
-        response->addHeader("Connection", "close");
-        request->send(response);
+        _httpApiRequests++;
+        // Stream slices of one snapshot: the loop task replaces the response on every poll.
+        std::shared_ptr<const String> status = _spa->getStatusResponseSnapshot();
+        if (status) {
+            sendSharedResponse(request, "text/plain", status);
+        } else {
+            sendText(request, 200, "text/plain", "");
+        }
     });
 
-    server.on("/debug", HTTP_GET, [&](AsyncWebServerRequest *request) {
+    onRoute("/debug", HTTP_GET, [&](AsyncWebServerRequest *request) {
         debugD("uri: %s", request->url().c_str());
         request->send(SPIFFS, "/www/debug.htm");
     });
 
+    onRoute("/crashlog", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        debugD("uri: %s", request->url().c_str());
+        if (_crashLog == nullptr) {
+            sendText(request, 404, "text/plain", "Crash log not enabled");
+            return;
+        }
+        sendText(request, 200, "text/plain", _crashLog->report());
+    });
+
+    onRoute("/metrics", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        debugD("uri: %s", request->url().c_str());
+        // Prometheus text format, one piece per route and loop phase so the body is never held in full.
+        auto index = std::make_shared<size_t>(0);
+        sendChunkedResponse(request, "text/plain; version=0.0.4", [this, index](String &piece) {
+            if (*index > _routeCount) return loopMetricsPiece((*index)++ - _routeCount - 1, piece);
+            if (*index == 0) {
+                piece = "# TYPE espa_free_heap_bytes gauge\nespa_free_heap_bytes " + String(ESP.getFreeHeap()) + "\n";
+                piece += "# TYPE espa_min_free_heap_bytes gauge\nespa_min_free_heap_bytes " + String(ESP.getMinFreeHeap()) + "\n";
+                appendHeapMetrics(piece);
+                appendLinkMetrics(piece);
+                piece += "# TYPE espa_http_requests_total counter\n";
+                piece += "# TYPE espa_http_request_duration_seconds histogram\n";
+                piece += "# TYPE espa_http_response_bytes_total counter\n";
+                piece += "# TYPE espa_http_handler_min_free_heap_bytes gauge\n";
+                (*index)++;
+                return true;
+            }
+            const RouteMetrics &route = _routes[(*index)++ - 1];
+            const String labels = String("route=\"") + route.uri + "\",method=\"" + route.method + "\"";
+            piece = "espa_http_requests_total{" + labels + "} " + String(route.requests) + "\n";
+            uint32_t cumulative = 0;
+            for (size_t b = 0; b < ROUTE_LATENCY_BUCKETS; b++) {
+                cumulative += route.latency[b];
+                const String le = b < ROUTE_LATENCY_BUCKETS - 1 ? String(ROUTE_LATENCY_BOUNDS_US[b] / 1e6, 3) : String("+Inf");
+                piece += "espa_http_request_duration_seconds_bucket{" + labels + ",le=\"" + le + "\"} " + String(cumulative) + "\n";
+            }
+            piece += "espa_http_request_duration_seconds_sum{" + labels + "} " + String(route.latencyTotalUs / 1e6, 6) + "\n";
+            piece += "espa_http_request_duration_seconds_count{" + labels + "} " + String(route.requests) + "\n";
+            piece += "espa_http_response_bytes_total{" + labels + "} " + String((uint32_t)route.responseBytes) + "\n";
+            if (route.requests > 0) {
+                piece += "espa_http_handler_min_free_heap_bytes{" + labels + "} " + String(route.minFreeHeap) + "\n";
+            }
+            return true;
+        });
+    });
+
     // As a fallback we try to load from /www any requested URL
     server.serveStatic("/", SPIFFS, "/www/");
 
@@ -180,6 +538,215 @@ void WebUI::begin() {
     initialised = true;
 }
 
+void WebUI::loop() {
+    const uint32_t now = millis();
+    if (now - _lastApiIdleCheck < API_IDLE_CHECK_INTERVAL_MS) return;
+    _lastApiIdleCheck = now;
+
+    uint32_t idle[API_MAX_CLIENTS];
+    size_t idleCount = 0;
+    {
+        std::lock_guard<std::mutex> lock(_apiClientsMutex);
+        for (ApiClientSlot &slot : _apiClients) {
+            if (slot.id == 0 || now - slot.lastActivity < API_IDLE_TIMEOUT_MS) continue;
+            idle[idleCount++] = slot.id;
+            _apiExpiredConnections++;
+            slot = ApiClientSlot();
+        }
+    }
+    for (size_t i = 0; i < idleCount; i++) {
+        debugD("Closing idle API client %u", idle[i]);
+        AsyncWebSocketClient *client = _apiSocket.client(idle[i]);
+        if (client != nullptr) client->close();
+    }
+    _apiSocket.cleanupClients(API_MAX_CLIENTS);
+}
+
+WebUI::ApiConnectionStats WebUI::getApiConnectionStats() const {
+    ApiConnectionStats stats;
+    stats.activeConnections = _apiSocket.count();
+    stats.totalConnections = _apiTotalConnections;
+    stats.rejectedConnections = _apiRejectedConnections;
+    stats.expiredConnections = _apiExpiredConnections;
+    stats.socketRequests = _apiSocketRequests;
+    stats.reusedRequests = _apiReusedRequests;
+    stats.httpRequests = _httpApiRequests;
+    return stats;
+}
+
+WebUI::ApiClientSlot* WebUI::findApiClient(uint32_t id) {
+    for (ApiClientSlot &slot : _apiClients) {
+        if (slot.id == id) return &slot;
+    }
+    return nullptr;
+}
+
+void WebUI::configureApiWebSocket() {
+    _apiSocket.onEvent(
+        [this](
+            AsyncWebSocket* server,
+            AsyncWebSocketClient* client,
+            AwsEventType type,
+            void* arg,
+            uint8_t* data,
+            size_t len
+        ) {
+            (void)server;
+            SPA_HEAP_TAG(WebUI);
+            handleApiWebSocketEvent(client, type, arg, data, len);
+        }
+    );
+
+    server.addHandler(&_apiSocket);
+}
+
+void WebUI::handleApiWebSocketEvent(
+    AsyncWebSocketClient* client,
+    AwsEventType type,
+    void* arg,
+    uint8_t* data,
+    size_t len
+) {
+    switch (type) {
+        case WS_EVT_CONNECT: {
+            bool accepted = false;
+            {
+                std::lock_guard<std::mutex> lock(_apiClientsMutex);
+                ApiClientSlot *slot = findApiClient(0);
+                if (slot != nullptr) {
+                    slot->id = client->id();
+                    slot->lastActivity = millis();
+                    slot->requests = 0;
+                    _apiTotalConnections++;
+                    accepted = true;
+                } else {
+                    _apiRejectedConnections++;
+                }
+            }
+            if (!accepted) {
+                debugW("API client %u rejected, all %u slots in use", client->id(), API_MAX_CLIENTS);
+                // The page backs off on an error frame instead of reconnecting on its next poll.
+                client->text("Error: all API connections in use");
+                client->close();
+                return;
+            }
+            debugD("API client %u connected", client->id());
+            break;
+        }
+
+        case WS_EVT_DISCONNECT: {
+            {
+                std::lock_guard<std::mutex> lock(_apiClientsMutex);
+                ApiClientSlot *slot = findApiClient(client->id());
+                if (slot != nullptr) *slot = ApiClientSlot();
+            }
+            debugD("API client %u disconnected", client->id());
+            break;
+        }
+
+        case WS_EVT_DATA: {
+            // Replies are matched to requests in order, so every request gets one,
+            // an error frame if it is not served.
+            AwsFrameInfo *info = static_cast<AwsFrameInfo*>(arg);
+            if (info == nullptr) return;
+            if (
+                !info->final ||
+                info->index != 0 ||
+                info->len != len ||
+                info->opcode != WS_TEXT
+            ) {
+                // Answer once, on the last piece of the message.
+                if (info->final && info->index + len == info->len) {
+                    client->text("Error: API requests must be single text frames");
+                }
+                return;
+            }
+
+            bool known = false;
+            bool exhausted = false;
+            {
+                std::lock_guard<std::mutex> lock(_apiClientsMutex);
+                ApiClientSlot *slot = findApiClient(client->id());
+                if (slot != nullptr) {
+                    known = true;
+                    slot->lastActivity = millis();
+                    if (slot->requests++ > 0) _apiReusedRequests++;
+                    _apiSocketRequests++;
+
+                    // Recycle long-lived connections so one client can't hold a slot forever.
+                    if (slot->requests >= API_MAX_REQUESTS_PER_CONNECTION) {
+                        _apiExpiredConnections++;
+                        *slot = ApiClientSlot();
+                        exhausted = true;
+                    }
+                }
+            }
+            if (!known) {
+                // Rejected, or expired and not closed yet.
+                client->text("Error: API connection closed, reconnect");
+                client->close();
+                return;
+            }
+
+            String command;
+            command.reserve(len);
+            command.concat(reinterpret_cast<const char*>(data), len);
+            command.trim();
+
+            processApiCommand(command, client);
+
+            if (exhausted) {
+                debugD("API client %u reached its request budget", client->id());
+                client->close();
+            }
+            break;
+        }
+
+        case WS_EVT_PONG:
+        case WS_EVT_ERROR:
+        default:
+            break;
+    }
+}
+
+void WebUI::processApiCommand(
+    const String& command,
+    AsyncWebSocketClient* client
+) {
+    if (command == "json") {
+        std::shared_ptr<const String> json = getStatusJson(false);
+        if (json) {
+            client->text(*json);
+        } else {
+            client->text("Error generating json");
+        }
+        return;
+    }
+
+    if (command == "status") {
+        std::shared_ptr<const String> status = _spa->getStatusResponseSnapshot();
+        client->text(status ? *status : String());
+        return;
+    }
+
+    if (command.startsWith("set ")) {
+        int separator = command.indexOf('=');
+        if (separator < 0) {
+            client->text("Invalid set command, expected: set <property>=<value>");
+            return;
+        }
+        if (_setSpaCallback == nullptr) {
+            client->text("setSpaCallback not set");
+            return;
+        }
+        _setSpaCallback(command.substring(4, separator), command.substring(separator + 1));
+        client->text("Spa update initiated");
+        return;
+    }
+
+    client->text("Unknown command: " + command);
+}
+
 void WebUI::configureDebugWebSocket() {
     /*
     * Give WebRemoteDebug access to the WebSocket, without giving it
@@ -196,6 +763,7 @@ void WebUI::configureDebugWebSocket() {
             uint8_t* data,
             size_t len
         ) {
+            SPA_HEAP_TAG(WebUI);
             handleDebugWebSocketEvent(
                 server,
                 client,
@@ -223,6 +791,12 @@ void WebUI::handleDebugWebSocketEvent(
 
     switch (type) {
         case WS_EVT_CONNECT: {
+            if (!Debug.addWebClient(client->id())) {
+                client->text("Too many debug clients connected");
+                client->close();
+                break;
+            }
+
             String message =
                 "Connected to ESP32 debug WebSocket; level=";
 
@@ -246,6 +820,9 @@ void WebUI::handleDebugWebSocketEvent(
             break;
 
         case WS_EVT_DISCONNECT:
+            Debug.removeWebClient(client->id());
+            break;
+
         case WS_EVT_PONG:
         case WS_EVT_ERROR:
         default:
@@ -297,7 +874,9 @@ bool WebUI::processDebugCommand(
         client->text(
             "Commands: help, status, level verbose, "
             "level debug, level info, level warning, "
-            "level error, level any, silence, reboot"
+            "level error, level any, silence, deferred on, "
+            "deferred off, ratelimit on, ratelimit off, profile, "
+            "profile reset, ss <cmd>, reboot"
         );
 
         return true;
@@ -314,6 +893,47 @@ bool WebUI::processDebugCommand(
         response += Debug.isWebSilenced()
             ? "yes"
             : "no";
+        response += ", slow client dropped lines=";
+        response += String(Debug.slowClientDroppedLines());
+
+        const ApiConnectionStats api = getApiConnectionStats();
+        response += ", api sockets=";
+        response += String(api.activeConnections);
+        response += ", api connections=";
+        response += String(api.totalConnections);
+        response += ", api reused requests=";
+        response += String(api.reusedRequests);
+        response += ", api rejected=";
+        response += String(api.rejectedConnections);
+        response += ", api expired=";
+        response += String(api.expiredConnections);
+        response += ", http api requests=";
+        response += String(api.httpRequests);
+
+        const StatusJsonStats statusJson = getStatusJsonStats();
+        response += ", json renders=";
+        response += String(statusJson.renders);
+        response += ", json shared=";
+        response += String(statusJson.shared);
+
+        response += ", deferred log=";
+        response += Debug.isDeferredLogging() ? "on" : "off";
+        response += ", deferred pending=";
+        response += String(Debug.deferredPending());
+        response += ", deferred dropped=";
+        response += String(Debug.deferredDropped());
+        response += ", rate limit=";
+        response += Debug.isRateLimiting() ? "on" : "off";
+        response += ", rate limited lines=";
+        response += String(Debug.rateLimitedLines());
+        response += ", collapsed repeats=";
+        response += String(Debug.collapsedRepeats());
+
+        const String routes = getRouteMetricsSummary();
+        if (!routes.isEmpty()) {
+            response += "\n";
+            response += routes;
+        }
 
         client->text(response);
         return true;
@@ -332,6 +952,51 @@ bool WebUI::processDebugCommand(
         return true;
     }
 
+    if (normalisedCommand == "deferred on" || normalisedCommand == "deferred off") {
+        Debug.setDeferredLogging(normalisedCommand == "deferred on");
+        client->text(
+            Debug.isDeferredLogging()
+                ? "Deferred logging enabled"
+                : "Deferred logging disabled"
+        );
+        return true;
+    }
+
+    if (normalisedCommand.startsWith("ss ")) {
+        // Spa commands are case sensitive, so take the payload from the original text.
+        const String payload = command.substring(3);
+        const uint32_t id = client->id();
+        const bool queued = _spa->queueRawCommand(payload, [this, id](const char *line) {
+            AsyncWebSocketClient *requester = _debugSocket.client(id);
+            if (requester != nullptr) requester->text(line);
+        });
+        client->text(queued ? "TX: " + payload : String("Raw command queue full"));
+        return true;
+    }
+
+    if (normalisedCommand == "profile" || normalisedCommand == "profile reset") {
+        if (_loopProfiler == nullptr) {
+            client->text("Loop profiler not enabled");
+        } else if (normalisedCommand == "profile reset") {
+            _loopProfiler->reset();
+            client->text("Loop profile reset");
+        } else {
+            const String summary = _loopProfiler->summary();
+            client->text(summary.isEmpty() ? String("No loop samples yet") : summary);
+        }
+        return true;
+    }
+
+    if (normalisedCommand == "ratelimit on" || normalisedCommand == "ratelimit off") {
+        Debug.setRateLimiting(normalisedCommand == "ratelimit on");
+        client->text(
+            Debug.isRateLimiting()
+                ? "Log rate limiting enabled"
+                : "Log rate limiting disabled"
+        );
+        return true;
+    }
+
     if (normalisedCommand == "reboot") {
         client->text("Rebooting ESP32...");
         delay(200);
@@ -2,6 +2,9 @@
 #define WEBUI_H
 
 #include <Arduino.h>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <SPIFFS.h>
 #include <Update.h>
 #include <ESPAsyncWebServer.h>
@@ -10,6 +13,10 @@
 #include "SpaUtils.h"
 #include "Config.h"
 #include "MQTTClientWrapper.h"
+#include "OtaUpdater.h"
+#include "CrashLog.h"
+#include "LoopProfiler.h"
+#include "HeapTracker.h"
 
 extern WebRemoteDebug Debug;
 
@@ -27,9 +34,55 @@ class WebUI {
         void setSpaCallback(void (*f)(const String, const String)) {
           _setSpaCallback = f;
         }
+        /// @brief Set the crash log served at `/crashlog`.
+        /// @param crashLog
+        void setCrashLog(CrashLog *crashLog) {
+          _crashLog = crashLog;
+        }
+        /// @brief Set the main loop profiler reported by `/metrics` and the debug `profile` command.
+        /// @param profiler
+        void setLoopProfiler(LoopProfiler *profiler) {
+          _loopProfiler = profiler;
+        }
         void begin();
+
+        /// @brief To be called by loop function of main sketch. Expires idle API socket clients.
+        void loop();
+
         bool initialised = false;
 
+        /// @brief Connection reuse counters for the `/api/ws` endpoint.
+        struct ApiConnectionStats {
+            size_t activeConnections;       ///< API sockets currently open
+            uint32_t totalConnections;      ///< API sockets accepted since boot
+            uint32_t rejectedConnections;   ///< Refused because all client slots were in use
+            uint32_t expiredConnections;    ///< Closed for idling or exhausting their request budget
+            uint32_t socketRequests;        ///< Requests served over API sockets
+            uint32_t reusedRequests;        ///< Socket requests that did not need a new TCP connection
+            uint32_t httpRequests;          ///< Requests to the /json, /status and /set HTTP endpoints
+        };
+
+        ApiConnectionStats getApiConnectionStats() const;
+
+        /// @brief Status JSON for the current status version, cached per format.
+        /// @details Web handlers, API sockets and MQTT publishing asking for a version that was
+        /// already rendered share that render. Otherwise the caller renders it itself and never
+        /// waits on another task, so the async TCP task is not blocked by the loop task.
+        /// @param pretty Pretty-printed (web UI) or compact (MQTT/API) output.
+        /// @return The shared JSON, or nullptr if generation failed.
+        std::shared_ptr<const String> getStatusJson(bool pretty);
+
+        /// @brief Status JSON cache counters.
+        struct StatusJsonStats {
+            uint32_t renders;   ///< Times generateStatusJson() actually ran
+            uint32_t shared;    ///< Requests answered from an existing render
+        };
+
+        StatusJsonStats getStatusJsonStats() const;
+
+        /// @brief One line per instrumented route: requests, latency, response bytes and heap low water mark.
+        String getRouteMetricsSummary() const;
+
     private:
         AsyncWebServer server{80};
         SpaInterface *_spa;
@@ -37,11 +90,113 @@ class WebUI {
         MQTTClientWrapper *_mqttClient;
         AsyncWebSocket _debugSocket{"/debug/ws"};
 
+        /// @brief Persistent API channel so pollers don't pay a TCP handshake per request.
+        /// @details AsyncWebServer closes its HTTP connection after every response, so
+        /// connection reuse is offered over a WebSocket instead of HTTP keep-alive.
+        AsyncWebSocket _apiSocket{"/api/ws"};
+
+        /// @brief Maximum number of concurrently open API sockets.
+        static constexpr size_t API_MAX_CLIENTS = 4;
+        /// @brief API sockets with no request for this long are closed (ms).
+        static constexpr uint32_t API_IDLE_TIMEOUT_MS = 60000;
+        /// @brief Requests served on one API socket before it is closed and must reconnect.
+        static constexpr uint32_t API_MAX_REQUESTS_PER_CONNECTION = 1000;
+        /// @brief How often loop() checks for idle API sockets (ms).
+        static constexpr uint32_t API_IDLE_CHECK_INTERVAL_MS = 1000;
+
+        struct ApiClientSlot {
+            uint32_t id = 0;            // 0 = slot free
+            uint32_t lastActivity = 0;
+            uint32_t requests = 0;
+        };
+        /// @brief Guards _apiClients: the socket events (async TCP task) and the idle check
+        /// in loop() (loop task) both claim and free slots. Never held across a send or close.
+        std::mutex _apiClientsMutex;
+        ApiClientSlot _apiClients[API_MAX_CLIENTS];
+        uint32_t _lastApiIdleCheck = 0;
+
+        uint32_t _apiTotalConnections = 0;
+        uint32_t _apiRejectedConnections = 0;
+        uint32_t _apiExpiredConnections = 0;
+        uint32_t _apiSocketRequests = 0;
+        uint32_t _apiReusedRequests = 0;
+        uint32_t _httpApiRequests = 0;
+
+        /// @brief Streaming /fota upload pipeline (gzip inflate + SHA-256) in front of `Update`.
+        UpdateClassSink _otaSink;
+        OtaUpdater _ota{_otaSink};
+
+        /// @brief Upper bounds (us) of the handler latency histogram; a final bucket catches the rest.
+        static constexpr uint32_t ROUTE_LATENCY_BOUNDS_US[] = {1000, 5000, 10000, 50000, 100000, 500000, 1000000};
+        static constexpr size_t ROUTE_LATENCY_BUCKETS = sizeof(ROUTE_LATENCY_BOUNDS_US) / sizeof(ROUTE_LATENCY_BOUNDS_US[0]) + 1;
+        /// @brief Maximum number of routes registered through onRoute().
+        static constexpr size_t MAX_ROUTES = 16;
+
+        /// @brief Per-route handler instrumentation.
+        /// @details Handlers, fillers and the readers (/metrics, debug `status`) all run on the
+        /// async TCP task, so the counters are not locked.
+        struct RouteMetrics {
+            const char *uri = nullptr;
+            const char *method = "";
+            uint32_t requests = 0;
+            uint32_t latency[ROUTE_LATENCY_BUCKETS] = {};  // non-cumulative bucket counts
+            uint64_t latencyTotalUs = 0;
+            uint32_t latencyMaxUs = 0;
+            uint64_t responseBytes = 0;     // bodies built by WebUI; files served from SPIFFS are not sized
+            uint32_t minFreeHeap = UINT32_MAX;
+        };
+        RouteMetrics _routes[MAX_ROUTES];
+        size_t _routeCount = 0;
+        RouteMetrics *_activeRoute = nullptr;  // route whose handler is currently running
+
+        /// @brief server.on() with the handler wrapped in per-route instrumentation.
+        void onRoute(const char *uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest,
+                     ArUploadHandlerFunction onUpload = nullptr);
+
+        /// @brief Send a complete text body with `Connection: close`, counting it against the active route.
+        void sendText(AsyncWebServerRequest *request, int code, const char *contentType, const String &body);
+
+        static void recordHeap(RouteMetrics *route);
+        /// @brief /metrics piece for loop phase `index`, then the stall table; false when done.
+        bool loopMetricsPiece(size_t index, String &piece) const;
+        /// @brief Largest free block and, in heap tracking builds, allocation counters for /metrics.
+        void appendHeapMetrics(String &piece) const;
+        /// @brief Serial link histograms and counters for /metrics.
+        void appendLinkMetrics(String &piece) const;
+
         void (*_wifiManagerCallback)() = nullptr;
         void (*_setSpaCallback)(const String, const String) = nullptr;
+        CrashLog *_crashLog = nullptr;
+        LoopProfiler *_loopProfiler = nullptr;
 
         const char* getError();
 
+        /// @brief Produces the next piece of a streamed response body.
+        /// @details Called repeatedly until it returns false. Only the current piece is held
+        /// in memory, so peak heap does not grow with the size of the response.
+        using ChunkGenerator = std::function<bool(String &piece)>;
+
+        /// @brief Send a chunked (Transfer-Encoding: chunked) response built by a generator.
+        /// @param request Request to answer.
+        /// @param contentType MIME type of the body.
+        /// @param generator Called with an empty String to fill; return false once there is no more data.
+        void sendChunkedResponse(AsyncWebServerRequest *request, const char *contentType, ChunkGenerator generator);
+
+        /// @brief Send a response whose body is a shared, immutable String, without copying it.
+        void sendSharedResponse(AsyncWebServerRequest *request, const char *contentType, std::shared_ptr<const String> body);
+
+        /// @brief The latest render of one JSON format.
+        struct StatusJsonCache {
+            std::shared_ptr<const String> result;
+            uint32_t version = 0;
+            bool mqttConnected = false;
+        };
+        StatusJsonCache _statusJson[2];
+        /// @brief Held only to read or replace a cache entry, never while rendering.
+        std::mutex _statusJsonMutex;
+        uint32_t _statusJsonRenders = 0;
+        uint32_t _statusJsonShared = 0;
+
         void configureDebugWebSocket();
 
         void handleDebugWebSocketEvent(
@@ -65,6 +220,25 @@ class WebUI {
             AsyncWebSocketClient* client
         );
 
+        void configureApiWebSocket();
+
+        void handleApiWebSocketEvent(
+            AsyncWebSocketClient* client,
+            AwsEventType type,
+            void* arg,
+            uint8_t* data,
+            size_t len
+        );
+
+        /// @brief Run one API socket request: `json`, `status` or `set <property>=<value>`.
+        void processApiCommand(
+            const String& command,
+            AsyncWebSocketClient* client
+        );
+
+        /// @brief Slot of a client id (0 = a free slot); call with _apiClientsMutex held.
+        ApiClientSlot* findApiClient(uint32_t id);
+
         // hard-coded FOTA page in case file system gets wiped
         static constexpr const char *fotaPage PROGMEM = R"(
 <!DOCTYPE html>
@@ -84,9 +258,17 @@ class WebUI {
 <td><input type="file" accept=".bin,.bin.gz" name="appFile" id="appFile"></td>
 </tr>
 <tr>
+<td><label for="appSha256">Application SHA-256 (optional):</label></td>
+<td><input type="text" name="appSha256" id="appSha256" size="64" maxlength="64"></td>
+</tr>
+<tr>
 <td><label for="fsFile">Filesystem Update File:</label></td>
 <td><input type="file" accept=".bin,.bin.gz" name="fsFile" id="fsFile"></td>
 </tr>
+<tr>
+<td><label for="fsSha256">Filesystem SHA-256 (optional):</label></td>
+<td><input type="text" name="fsSha256" id="fsSha256" size="64" maxlength="64"></td>
+</tr>
 <tr><td><input type="submit" value="Update"></td><tr>
 </table>
 </form>
@@ -110,6 +292,7 @@ $(function() {
     if (appFile) {
       const appData = new FormData();
       appData.append('updateType', 'application');
+      if ($('#appSha256').val()) appData.append('sha256', $('#appSha256').val().trim());
       appData.append('update', appFile);
       appSuccess = await uploadFileAsync(appData, '/fota');
     }
@@ -118,6 +301,7 @@ $(function() {
     if (fsFile) {
       const fsData = new FormData();
       fsData.append('updateType', 'filesystem');
+      if ($('#fsSha256').val()) fsData.append('sha256', $('#fsSha256').val().trim());
       fsData.append('update', fsFile);
       fsSuccess = await uploadFileAsync(fsData, '/fota');
     }
@@ -149,12 +333,12 @@ $(function() {
           });
           return xhr;
         },
-        success: () => {
-          msg('Update successful!', 'green');
+        success: (data) => {
+          msg('Update successful! ' + data, 'green');
           resolve(true);
         },
-        error: () => {
-          msg('Update failed! Please try again.', 'red');
+        error: (xhr) => {
+          msg('Update failed! ' + (xhr.responseText || 'Please try again.'), 'red');
           resolve(false);
         }
       });
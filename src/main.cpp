@@ -17,9 +17,31 @@
 #include "HAAutoDiscovery.h"
 #include "MQTTClientWrapper.h"
 #include "ESPAsyncWebServer.h"
+#include "CrashLog.h"
+#include "LoopProfiler.h"
+#include "HeapTracker.h"
 
 unsigned long bootStartMillis;  // To track when the device started
 WebRemoteDebug Debug;
+CrashLog crashLog;
+
+enum LoopPhase : uint8_t {
+  PHASE_LOOP,
+  PHASE_BUTTON,
+  PHASE_DEBUG,
+  PHASE_WEB,
+  PHASE_SPA_SET,
+  PHASE_WIFI_RECONNECT,
+  PHASE_SPA,
+  PHASE_MQTT_CONNECT,
+  PHASE_MQTT_DISCOVERY,
+  PHASE_MQTT_LOOP,
+  PHASE_COUNT
+};
+const char *const loopPhaseNames[PHASE_COUNT] = {
+  "loop", "button", "debug", "web", "spa_set", "wifi_reconnect", "spa", "mqtt_connect", "mqtt_discovery", "mqtt_loop"
+};
+LoopProfiler loopProfiler(loopPhaseNames, PHASE_COUNT, PHASE_LOOP);
 
 SpaInterface si;
 Config config;
@@ -46,12 +68,17 @@ ulong mqttLastConnect = millis();
 ulong wifiLastConnect = millis();
 ulong bootTime = millis();
 ulong statusLastPublish = millis();
+ulong diagnosticsLastPublish = millis();
+const ulong DIAGNOSTICS_PUBLISH_INTERVAL_MS = 60000;
 bool delayedStart = true; // Delay spa connection for 10sec after boot to allow for external debugging if required.
 bool autoDiscoveryPublished = false;
 bool wifiRestoredFlag = true; // Flag to indicate if Wi-Fi has been restored after a disconnect.
 
 String mqttBase = "";
 String mqttStatusTopic = "";
+String mqttHeapTopic = "";
+String mqttLinkTopic = "";
+String mqttKeypadMacroTopic = "";
 String mqttSet = "";
 String mqttAvailability = "";
 
@@ -63,10 +90,22 @@ String mqttAvailability = "";
 bool updateMqtt = false;
 /// @brief Flag to indicate that the Wi-Fi configuration has changed and therefore the Wi-Fi
 bool updateSoftAP = false;
+/// @brief Flag to indicate that the time zone has changed and therefore SNTP and the spa
+/// clock correction need reconfiguring.
+bool updateClock = false;
 bool setSpaCallbackReady = false;
 String spaCallbackProperty;
 String spaCallbackValue;
 
+/// @brief Start SNTP in the configured time zone. The spa clock is only corrected once a time
+/// zone is set; without one the system clock runs in UTC and is used for drift estimation alone.
+void configureClock() {
+  const String timeZone = config.TimeZone.getValue();
+  configTzTime(timeZone.isEmpty() ? "UTC0" : timeZone.c_str(), "pool.ntp.org");
+  si.setClockCorrection(!timeZone.isEmpty());
+  debugI("SNTP started, time zone '%s'", timeZone.c_str());
+}
+
 void WMsaveConfigCallback(){
   WMsaveConfig = true;
 }
@@ -164,6 +203,7 @@ void configChangeCallbackString(const char* name, String value) {
   else if (strcmp(name, "SpaName") == 0) { } //TODO - Changing the SpaName currently requires the user to:
                                   // delete the entities in MQTT then reboot the ESP
   else if (strcmp(name, "SoftAPPassword") == 0) updateSoftAP = true;
+  else if (strcmp(name, "TimeZone") == 0) updateClock = true;
 }
 
 void configChangeCallbackInt(const char* name, int value) {
@@ -176,6 +216,9 @@ void configChangeCallbackBool(const char* name, bool value) {
   if (strcmp(name, "SoftAPAlwaysOn") == 0) updateSoftAP = true;
 }
 
+#undef SPA_LOG_MODULE_LEVEL
+#define SPA_LOG_MODULE_LEVEL SPA_LOG_LEVEL_MQTT
+
 void mqttHaAutoDiscovery() {
   debugI("Publishing Home Assistant auto discovery");
 
@@ -321,20 +364,20 @@ void mqttHaAutoDiscovery() {
   const String* selectedPumpOptions = nullptr;
   size_t arrSize = 0;
   for (int pumpNumber = 1; pumpNumber <= 5; pumpNumber++) {
-    String pumpInstallState = (si.*(SpaInterface::pumpInstallStateFunctions[pumpNumber - 1])).get();
-    if (getPumpInstalledState(pumpInstallState) && getPumpPossibleStates(pumpInstallState).length() > 1) {
+    const SpaInterface::PumpCapabilities &pump = si.getPumpCapabilities(pumpNumber);
+    if (pump.installed && pump.stateCount > 1) {
       ADConf.displayName = "Pump " + String(pumpNumber);
       ADConf.propertyId = "pump" + String(pumpNumber);
       ADConf.valueTemplate = "{{ value_json.pumps.pump" + String(pumpNumber) + " }}";
-      if (pumpInstallState.endsWith("4")) {
+      if (pump.autoCapable) {
 
         (si.*(SpaInterface::pumpStatuses[pumpNumber-1])).setLabelMap({{"Manual",3},{"Auto",4}});
 
       }
-      if (getPumpSpeedType(pumpInstallState) == "1") {
+      if (pump.speedType == 1) {
         generateFanAdJSON(output, ADConf, spa, discoveryTopic, 0, 0, (si.*(SpaInterface::pumpStatuses[pumpNumber-1])));
       } else {
-        generateFanAdJSON(output, ADConf, spa, discoveryTopic, getPumpSpeedMin(pumpInstallState), getPumpSpeedMax(pumpInstallState), (si.*(SpaInterface::pumpStatuses[pumpNumber-1])));
+        generateFanAdJSON(output, ADConf, spa, discoveryTopic, pump.minSpeed, pump.maxSpeed, (si.*(SpaInterface::pumpStatuses[pumpNumber-1])));
       }
       mqttClient.publish(discoveryTopic.c_str(), output.c_str(), true);
     }
@@ -541,34 +584,46 @@ void mqttPublishStatusString(String s){
 
 }
 
-void mqttPublishStatus() {
+void mqttPublishKeypadMacro(const SpaInterface::KeypadMacroProgress &progress) {
   String json;
-  if (generateStatusJson(si, mqttClient, json, false)) {
-    mqttClient.publish(mqttStatusTopic.c_str(),json.c_str());
+  if (generateKeypadMacroJson(progress, json)) {
+    mqttClient.publish(mqttKeypadMacroTopic.c_str(), json.c_str());
+  } else {
+    debugD("Error generating json");
+  }
+}
+
+void mqttPublishStatus() {
+  std::shared_ptr<const String> json = ui.getStatusJson(false);
+  if (json) {
+    mqttClient.publish(mqttStatusTopic.c_str(),json->c_str());
   } else {
     debugD("Error generating json");
   }
 }
 
+#undef SPA_LOG_MODULE_LEVEL
+#define SPA_LOG_MODULE_LEVEL SPA_LOG_LEVEL_DEFAULT
+
 void setSpaProperty(String property, String p) {
 
   debugI("Received update for %s to %s",property.c_str(),p.c_str());
 
   if (property == "temperatures_setPoint") {
     try {
-      si.STMP = int(p.toFloat()*10);
+      si.STMP.setAsync(int(p.toFloat()*10), property, p);
     } catch (const std::exception& ex) {
       debugE("Failed to set STMP: %s", ex.what());
     }
   } else if (property == "heatpump_mode") {
     try {
-      si.HPMP.setLabel(p.c_str());
+      si.HPMP.setLabelAsync(p.c_str(), property, p);
     } catch (const std::exception& ex) {
       debugE("Failed to set HPMP label: %s", ex.what());
     }
   } else if (property == "powerSave_level") {
     try {
-      si.PSAV_LVL.setLabel(p.c_str());
+      si.PSAV_LVL.setLabelAsync(p.c_str(), property, p);
     } catch (const std::exception& ex) {
       debugE("Failed to set PSAV_LVL from label '%s': %s", p.c_str(), ex.what());
     }
@@ -577,12 +632,13 @@ void setSpaProperty(String property, String p) {
     int pumpNum = property.charAt(4) - '0';
     // p = 1 = Off, p = 2 = Low, p = 3 = High
     // send values need to be changed to the appropriate values
-    if (p == "1") p = "0";
-    else if (p == "2") p = "3";
-    else if (p == "3") p = "2";
+    String speed = p;
+    if (p == "1") speed = "0";
+    else if (p == "2") speed = "3";
+    else if (p == "3") speed = "2";
     if (pumpNum - 1 < array_count(SpaInterface::pumpStatuses))
       try {
-        (si.*(SpaInterface::pumpStatuses[pumpNum-1])).set(p.toInt());
+        (si.*(SpaInterface::pumpStatuses[pumpNum-1])).setAsync(speed.toInt(), property, p);
       } catch (const std::exception& ex) {
         debugE("Failed to set pump%d speed: %s", pumpNum, ex.what());
       }
@@ -590,44 +646,43 @@ void setSpaProperty(String property, String p) {
     int pumpNum = property.charAt(4) - '0';
     if (pumpNum - 1 < array_count(SpaInterface::pumpStatuses)) {
       try {
-        if (p == "Auto") (si.*(SpaInterface::pumpStatuses[pumpNum-1])).set(4);
-        else (si.*(SpaInterface::pumpStatuses[pumpNum-1])).set(3); // When we change mode to manual set speed to low, as this matches the auto display speed
+        if (p == "Auto") (si.*(SpaInterface::pumpStatuses[pumpNum-1])).setAsync(4, property, p);
+        else (si.*(SpaInterface::pumpStatuses[pumpNum-1])).setAsync(3, property, p); // When we change mode to manual set speed to low, as this matches the auto display speed
       } catch (const std::exception& ex) {
         debugE("Failed to set pump%d mode: %s", pumpNum, ex.what());
       }
     }
   } else if (property.startsWith("pump") && property.endsWith("_state")) {
     int pumpNum = property.charAt(4) - '0';
-    String pumpState = (si.*(SpaInterface::pumpInstallStateFunctions[pumpNum-1])).get();
     if (pumpNum - 1 < array_count(SpaInterface::pumpStatuses)) {
       try {
-        if (getPumpSpeedType(pumpState) == "2") (si.*(SpaInterface::pumpStatuses[pumpNum-1])).set(p=="OFF"?0:2); // When we turn on the pump use speed high
-        else (si.*(SpaInterface::pumpStatuses[pumpNum-1])).set(p=="OFF"?0:1);
+        if (si.getPumpCapabilities(pumpNum).speedType == 2) (si.*(SpaInterface::pumpStatuses[pumpNum-1])).setAsync(p=="OFF"?0:2, property, p); // When we turn on the pump use speed high
+        else (si.*(SpaInterface::pumpStatuses[pumpNum-1])).setAsync(p=="OFF"?0:1, property, p);
       } catch (const std::exception& ex) {
         debugE("Failed to set pump%d state: %s", pumpNum, ex.what());
       }
     }
   } else if (property == "heatpump_auxheat") {
     try {
-      si.HELE.set(p != "OFF");
+      si.HELE.setAsync(p != "OFF", property, p);
     } catch (const std::exception& ex) {
       debugE("Failed to set HELE: %s", ex.what());
     }
   } else if (property == "vmax") {
     try {
-      si.VMAX = p.toInt();
+      si.VMAX.setAsync(p.toInt(), property, p);
     } catch (const std::exception& ex) {
       debugE("Failed to set VMAX: %s", ex.what());
     }
   } else if (property == "clmt") {
     try {
-      si.CLMT = p.toInt();
+      si.CLMT.setAsync(p.toInt(), property, p);
     } catch (const std::exception& ex) {
       debugE("Failed to set CLMT: %s", ex.what());
     }
   } else if (property == "wclnTime") {
     try {
-      si.WCLNTime = convertToInteger(p);
+      si.WCLNTime.setAsync(convertToInteger(p), property, p);
     } catch (const std::exception& ex) {
       debugE("Failed to set WCLNTime: %s", ex.what());
     }
@@ -640,31 +695,31 @@ void setSpaProperty(String property, String p) {
     tm.Minute=p.substring(14,16).toInt();
     tm.Second=p.substring(17).toInt();
     try {
-      si.SpaTime.set(makeTime(tm));
+      si.SpaTime.setAsync(makeTime(tm), property, p);
     } catch (const std::exception& ex) {
       debugE("Failed to set SpaTime: %s", ex.what());
     }
   } else if (property == "status_dayOfWeek") {
     try {
-      si.SpaDayOfWeek.setLabel(p.c_str());
+      si.SpaDayOfWeek.setLabelAsync(p.c_str(), property, p);
     } catch (const std::exception& ex) {
       debugE("Failed to set SpaDayOfWeek '%s': %s", p.c_str(), ex.what());
     }
   } else if (property == "lights_state") {
     try {
-      si.RB_TP_Light.set(p=="ON"?1:0);
+      si.RB_TP_Light.setAsync(p=="ON"?1:0, property, p);
     } catch (const std::exception& ex) {
       debugE("Failed to set RB_TP_Light: %s", ex.what());
     }
   } else if (property == "lights_effect") {
     try {
-      si.ColorMode.setLabel(p.c_str());
+      si.ColorMode.setLabelAsync(p.c_str(), property, p);
     } catch (const std::exception& ex) {
       debugE("Failed to set ColorMode label: %s", ex.what());
     }
   } else if (property == "lights_brightness") {
     try {
-      si.LBRTValue = p.toInt();
+      si.LBRTValue.setAsync(p.toInt(), property, p);
     } catch (const std::exception& ex) {
       debugE("Failed to set LBRTValue: %s", ex.what());
     }
@@ -677,105 +732,105 @@ void setSpaProperty(String property, String p) {
       if (hue > 360) hue = 360;
       String hueLabel = String(hue);
       try {
-        si.CurrClr.setLabel(hueLabel.c_str());
+        si.CurrClr.setLabelAsync(hueLabel.c_str(), property, p);
       } catch (const std::exception& ex) {
         debugE("Failed to set CurrClr: %s", ex.what());
       }
     }
   } else if (property == "lights_speed") {
     try {
-      si.LSPDValue = p.toInt();
+      si.LSPDValue.setAsync(p.toInt(), property, p);
     } catch (const std::exception& ex) {
       debugE("Failed to set LSPDValue: %s", ex.what());
     }
   } else if (property == "blower_state") {
     try {
-      si.Outlet_Blower.set(p=="OFF"?2:0);
+      si.Outlet_Blower.setAsync(p=="OFF"?2:0, property, p);
     } catch (const std::exception& ex) {
       debugE("Failed to set blower state: %s", ex.what());
     }
   } else if (property == "blower_speed") {
     try {
-      if (p=="0") si.Outlet_Blower.set(2);
-      else si.VARIValue.set(p.toInt());
+      if (p=="0") si.Outlet_Blower.setAsync(2, property, p);
+      else si.VARIValue.setAsync(p.toInt(), property, p);
     } catch (const std::exception& ex) {
       debugE("Failed to set blower speed: %s", ex.what());
     }
   } else if (property == "blower_mode") {
     try {
-      si.Outlet_Blower.setLabel(p.c_str());
+      si.Outlet_Blower.setLabelAsync(p.c_str(), property, p);
     } catch (const std::exception& ex) {
       debugE("Failed to set blower mode from label '%s': %s", p.c_str(), ex.what());
     }
   } else if (property == "sleepTimers_1_state") {
     try {
-      si.L_1SNZ_DAY.setLabel(p.c_str());
+      si.L_1SNZ_DAY.setLabelAsync(p.c_str(), property, p);
     } catch (const std::exception& ex) {
       debugE("Failed to set L_1SNZ_DAY from label '%s': %s", p.c_str(), ex.what());
     }
   } else if (property == "sleepTimers_2_state") {
     try {
-      si.L_2SNZ_DAY.setLabel(p.c_str());
+      si.L_2SNZ_DAY.setLabelAsync(p.c_str(), property, p);
     } catch (const std::exception& ex) {
       debugE("Failed to set L_2SNZ_DAY from label '%s': %s", p.c_str(), ex.what());
     }
   } else if (property == "sleepTimers_1_begin") {
     try {
-      si.L_1SNZ_BGN = convertToInteger(p);
+      si.L_1SNZ_BGN.setAsync(convertToInteger(p), property, p);
     } catch (const std::exception& ex) {
       debugE("Failed to set L_1SNZ_BGN: %s", ex.what());
     }
   } else if (property == "sleepTimers_1_end") {
     try {
-      si.L_1SNZ_END = convertToInteger(p);
+      si.L_1SNZ_END.setAsync(convertToInteger(p), property, p);
     } catch (const std::exception& ex) {
       debugE("Failed to set L_1SNZ_END: %s", ex.what());
     }
   } else if (property == "sleepTimers_2_begin") {
     try {
-      si.L_2SNZ_BGN = convertToInteger(p);
+      si.L_2SNZ_BGN.setAsync(convertToInteger(p), property, p);
     } catch (const std::exception& ex) {
       debugE("Failed to set L_2SNZ_BGN: %s", ex.what());
     }
   } else if (property == "sleepTimers_2_end") {
     try {
-      si.L_2SNZ_END = convertToInteger(p);
+      si.L_2SNZ_END.setAsync(convertToInteger(p), property, p);
     } catch (const std::exception& ex) {
       debugE("Failed to set L_2SNZ_END: %s", ex.what());
     }
   } else if (property == "powerSave_begin") {
     try {
-      si.PSAV_BGN = convertToInteger(p);
+      si.PSAV_BGN.setAsync(convertToInteger(p), property, p);
     } catch (const std::exception& ex) {
       debugE("Failed to set PSAV_BGN: %s", ex.what());
     }
   } else if (property == "powerSave_end") {
     try {
-      si.PSAV_END = convertToInteger(p);
+      si.PSAV_END.setAsync(convertToInteger(p), property, p);
     } catch (const std::exception& ex) {
       debugE("Failed to set PSAV_END: %s", ex.what());
     }
   } else if (property == "status_spaMode") {
     try {
-      si.Mode.setLabel(p.c_str());
+      si.Mode.setLabelAsync(p.c_str(), property, p);
     } catch (const std::exception& ex) {
       debugE("Failed to set Mode from label '%s': %s", p.c_str(), ex.what());
     }
   } else if (property == "filtration_blockDuration") {
     try {
-      si.FiltBlockHrs.setLabel(p.c_str());
+      si.FiltBlockHrs.setLabelAsync(p.c_str(), property, p);
     } catch (const std::exception& ex) {
       debugE("Failed to set FiltBlockHrs from label '%s': %s", p.c_str(), ex.what());
     }
   } else if (property == "filtration_hours") {
     try {
-      si.FiltHrs.set(p.toInt());
+      si.FiltHrs.setAsync(p.toInt(), property, p);
     } catch (const std::exception& ex) {
       debugE("Failed to set FiltHrs: %s", ex.what());
     }
   } else if (property == "lock_mode") {
     try {
-      si.LockMode.setLabel(p.c_str());
+      si.LockMode.setLabelAsync(p.c_str(), property, p);
     } catch (const std::exception& ex) {
       debugE("Failed to set LockMode from label '%s': %s", p.c_str(), ex.what());
     }
@@ -785,11 +840,20 @@ void setSpaProperty(String property, String p) {
     } catch (const std::exception& ex) {
       debugE("Failed to send keypad up: %s", ex.what());
     }
+  } else if (property == "keypad_macro") {
+    try {
+      if (!si.startKeypadMacro(p, mqttPublishKeypadMacro)) debugW("Keypad macro '%s' ignored, another is running", p.c_str());
+    } catch (const std::exception& ex) {
+      debugE("Failed to start keypad macro '%s': %s", p.c_str(), ex.what());
+    }
   } else {
     debugE("Unhandled property - %s",property.c_str());
   }
 }
 
+#undef SPA_LOG_MODULE_LEVEL
+#define SPA_LOG_MODULE_LEVEL SPA_LOG_LEVEL_MQTT
+
 void mqttCallback(char* topic, byte* payload, unsigned int length) {
   String t = String(topic);
 
@@ -805,6 +869,9 @@ void mqttCallback(char* topic, byte* payload, unsigned int length) {
   setSpaProperty(property, p);
 }
 
+#undef SPA_LOG_MODULE_LEVEL
+#define SPA_LOG_MODULE_LEVEL SPA_LOG_LEVEL_DEFAULT
+
 String sanitizeHostname(const String& input) {
   String sanitized = "";
 
@@ -850,6 +917,9 @@ static String getUID() {
 
 
 void setup() {
+  crashLog.begin();  // Before anything logs, so the previous run's bank is set aside first
+  Debug.attachCrashLog(&crashLog);
+
   #if defined(EN_PIN)
     pinMode(EN_PIN, INPUT_PULLUP);
   #endif
@@ -939,7 +1009,10 @@ void setup() {
 
   ui.setWifiManagerCallback(startWifiManagerCallback);
   ui.setSpaCallback(setSpaCallback);
+  ui.setCrashLog(&crashLog);
+  ui.setLoopProfiler(&loopProfiler);
   si.setSpaPollFrequency(config.SpaPollFrequency.getValue());
+  configureClock();
 
   config.setCallback(configChangeCallbackString);
   config.setCallback(configChangeCallbackInt);
@@ -947,6 +1020,9 @@ void setup() {
 
   mqttBase = String("eSpa/") + getUID() + String("/");
   mqttStatusTopic = mqttBase + "status";
+  mqttHeapTopic = mqttBase + "diagnostics/heap";
+  mqttLinkTopic = mqttBase + "diagnostics/link";
+  mqttKeypadMacroTopic = mqttBase + "keypad/macro";
   mqttSet = mqttBase + "set";
   mqttAvailability = mqttBase+"available";
   debugI("MQTT base topic is %s",mqttBase.c_str());
@@ -954,12 +1030,25 @@ void setup() {
 }
 
 void loop() {  
+  const uint32_t loopStart = micros();
+  LoopProfiler::Scope loopScope(loopProfiler, PHASE_LOOP);
 
-  checkButton(); // Check if the button is pressed to start Wi-Fi Manager
+  {
+    LoopProfiler::Scope scope(loopProfiler, PHASE_BUTTON);
+    checkButton(); // Check if the button is pressed to start Wi-Fi Manager
+  }
 
-  Debug.handle();
+  {
+    LoopProfiler::Scope scope(loopProfiler, PHASE_DEBUG);
+    Debug.handle();
+  }
+  {
+    LoopProfiler::Scope scope(loopProfiler, PHASE_WEB);
+    ui.loop();
+  }
 
   if (setSpaCallbackReady) {
+    LoopProfiler::Scope scope(loopProfiler, PHASE_SPA_SET);
     debugD("Setting Spa Properties...");
     setSpaCallbackReady = false;
     setSpaProperty(spaCallbackProperty, spaCallbackValue);
@@ -970,6 +1059,7 @@ void loop() {
     wifiRestoredFlag = false;
 
     if (millis() - wifiLastConnect > 10000) { // Reconnect every 10 seconds if not connected
+      LoopProfiler::Scope scope(loopProfiler, PHASE_WIFI_RECONNECT);
       debugI("Wifi reconnecting...");
       wifiLastConnect = millis();
       WiFi.disconnect();
@@ -997,7 +1087,10 @@ void loop() {
     if (delayedStart) {
       delayedStart = !(bootTime + 10000 < millis());
     } else {
-      si.loop();
+      {
+        LoopProfiler::Scope scope(loopProfiler, PHASE_SPA);
+        si.loop();
+      }
 
       if (!si.isInitialised()) {
         // set status lights to indicate we are waiting for spa connection before we proceed
@@ -1017,6 +1110,7 @@ void loop() {
 
         if (!mqttClient.connected()) {  // MQTT broker reconnect if not connected
           if (millis() - mqttLastConnect > 1000) {
+            LoopProfiler::Scope scope(loopProfiler, PHASE_MQTT_CONNECT);
             blinker.setState(STATE_MQTT_NOT_CONNECTED);
             
             debugW("MQTT not connected, attempting connection to %s:%i", config.MqttServer.getValue(), config.MqttPort.getValue());
@@ -1041,6 +1135,7 @@ void loop() {
           }
         } else {
           if (!autoDiscoveryPublished && si.isInitialised()) {  // This is the setup area, gets called once when communication with Spa and MQTT broker have been established.
+            LoopProfiler::Scope scope(loopProfiler, PHASE_MQTT_DISCOVERY);
             debugI("Publish autodiscovery information");
             mqttHaAutoDiscovery();
             autoDiscoveryPublished = true;
@@ -1050,6 +1145,13 @@ void loop() {
             si.statusResponse.setCallback(mqttPublishStatusString);
           }
           
+          if (millis() - diagnosticsLastPublish > DIAGNOSTICS_PUBLISH_INTERVAL_MS) {
+            diagnosticsLastPublish = millis();
+            mqttClient.publish(mqttHeapTopic.c_str(), HeapTracker::toJson().c_str());
+            String link;
+            if (generateLinkMetricsJson(si, link)) mqttClient.publish(mqttLinkTopic.c_str(), link.c_str());
+          }
+
           // all systems are go! Start the knight rider animation loop
           blinker.setState(KNIGHT_RIDER);
         }
@@ -1080,5 +1182,16 @@ void loop() {
     updateSoftAP = false;
   }
 
-  mqttClient.loop();
+  if (updateClock) {
+    debugD("Changing time zone...");
+    configureClock();
+    updateClock = false;
+  }
+
+  {
+    LoopProfiler::Scope scope(loopProfiler, PHASE_MQTT_LOOP);
+    mqttClient.loop();
+  }
+
+  crashLog.recordLoop(micros() - loopStart);
 }
@@ -0,0 +1,201 @@
+/**
+ * @file bench_read_status.cpp
+ * @brief Allocation and parse-time budgets for polling the spa.
+ *
+ * Polls the snapshot frame through SpaInterface::loop() as the firmware does,
+ * built like the espa-v1-heap-tracking environment, so HeapTracker counts every
+ * SpaInterface allocation a poll makes (C++ allocations included, through the
+ * operator new below). Fails if a steady state poll goes over the allocation
+ * budget, or if parsing the frame takes longer than the parse budget.
+ *
+ * Parse time is getLastParseMicros(), the median over many polls. After each
+ * poll a reference parser (split the frame into a String array, nothing else)
+ * is timed on the same frame, and the budget is the ratio of the two medians,
+ * so it does not depend on how fast or how busy the host is.
+ *
+ *   SPA_BENCH_POLLS    polls to time (default 2000)
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "HeapTracker.h"
+#include "SpaFrame.h"
+#include "SpaInterface.h"
+
+// As on the device, where operator new is malloc and so goes through the wrappers.
+void *operator new(size_t size) {
+    void *p = malloc(size != 0 ? size : 1);
+    if (p == nullptr) throw std::bad_alloc();
+    return p;
+}
+void *operator new[](size_t size) { return operator new(size); }
+void *operator new(size_t size, const std::nothrow_t &) noexcept { return malloc(size != 0 ? size : 1); }
+void *operator new[](size_t size, const std::nothrow_t &) noexcept { return malloc(size != 0 ? size : 1); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+namespace {
+
+/// @brief Steady state SpaInterface allocations one poll of the snapshot frame may make.
+/// @details A poll makes 72 today. The firmware's SPA_HEAP_ALLOC_BUDGET_PER_POLL is
+/// looser because it has to hold for any controller and log level.
+constexpr uint32_t POLL_ALLOCATION_BUDGET = 80;
+
+/// @brief Median parse time as a multiple of the reference parser's, quiet and with a
+/// verbose trace captured through the deferred log ring.
+/// @details About 6x and 9x today. Formatting the verbose trace inline instead of
+/// deferring it takes the verbose figure to about 23x.
+constexpr double PARSE_TIME_BUDGET_QUIET = 8;
+constexpr double PARSE_TIME_BUDGET_VERBOSE = 13;
+
+constexpr int WARMUP_POLLS = 20;
+
+int benchPolls() {
+    const char *polls = getenv("SPA_BENCH_POLLS");
+    return polls != nullptr && atoi(polls) > 0 ? atoi(polls) : 2000;
+}
+
+uint32_t median(std::vector<uint32_t> samples) {
+    std::sort(samples.begin(), samples.end());
+    return samples[samples.size() / 2];
+}
+
+/// What any parser of the frame has to do: split it into fields and keep each one
+/// as a String, as SpaInterface does in statusResponseRaw.
+class ReferenceParser {
+public:
+    /// @brief Nanoseconds for one pass, averaged over a few so the timer resolution does not show.
+    uint32_t timePass(const std::string &frame) {
+        const auto start = std::chrono::steady_clock::now();
+        for (int pass = 0; pass < PASSES; pass++) parse(frame);
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        return (uint32_t)(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / PASSES);
+    }
+
+private:
+    static constexpr int PASSES = 8;
+    String _fields[400];
+    size_t _count = 0;
+
+    void parse(const std::string &frame) {
+        _count = 0;
+        size_t begin = 0;
+        for (size_t i = 0; i < frame.size() && _count < 400; i++) {
+            const char c = frame[i];
+            if (c == ',' || c == '\r' || c == '\n') {
+                _fields[_count++] = String(frame.data() + begin, (unsigned)(i - begin));
+                begin = i + 1;
+            }
+        }
+        EXPECT_GT(_count, 250u);
+    }
+};
+
+class ReadStatusBench : public ::testing::TestWithParam<uint8_t> {
+protected:
+    SpaFrame frame = SpaFrame::fromSnapshot();
+    std::string response = frame.response();
+    std::unique_ptr<SpaInterface> spa;
+
+    void SetUp() override {
+        RemoteDebug::hostActiveLevel = GetParam();
+        RemoteDebug::hostOutput = nullptr;   // formatted as on the device, then dropped
+
+        Serial2.reset();
+        Serial2.setResponder([this](HardwareSerial &port, const std::string &line) {
+            // The fake spa is not the firmware's work.
+            HeapTracker::Scope scope(HeapTag::Other);
+            if (line == "RF") port.inject(response);
+        });
+        spa.reset(new SpaInterface());
+        spa->begin();
+    }
+
+    void TearDown() override {
+        spa.reset();
+        Serial2.reset();
+        RemoteDebug::hostActiveLevel = RemoteDebug::ANY;
+        RemoteDebug::hostOutput = stderr;
+    }
+
+    bool verbose() const { return GetParam() == RemoteDebug::VERBOSE; }
+    const char *levelName() const { return verbose() ? "verbose" : "quiet"; }
+    double parseTimeBudget() const { return verbose() ? PARSE_TIME_BUDGET_VERBOSE : PARSE_TIME_BUDGET_QUIET; }
+
+    /// One scheduled poll through loop(), then the main loop's Debug.handle().
+    void poll() {
+        const uint32_t polls = spa->getLinkMetrics().polls;
+        host::advance(61000);
+        for (int pass = 0; pass < 10 && spa->getLinkMetrics().polls == polls; pass++) {
+            spa->loop();
+            Debug.handle();
+            host::advance(600);
+        }
+        ASSERT_GT(spa->getLinkMetrics().polls, polls);
+        ASSERT_EQ(spa->getStaleRegisters(), 0);
+    }
+};
+
+TEST_P(ReadStatusBench, PollAllocations) {
+    for (int i = 0; i < WARMUP_POLLS; i++) poll();
+
+    std::vector<uint32_t> allocations;
+    for (int i = 0; i < 100; i++) {
+        poll();
+        allocations.push_back(HeapTracker::snapshot().lastPollAllocations);
+    }
+
+    const uint32_t worst = *std::max_element(allocations.begin(), allocations.end());
+    printf("[ bench    ] %s: %u allocations per poll (worst of %zu), budget %u\n",
+           levelName(), worst, allocations.size(), POLL_ALLOCATION_BUDGET);
+    RecordProperty("worstPollAllocations", (int)worst);
+    EXPECT_LE(worst, POLL_ALLOCATION_BUDGET);
+    EXPECT_EQ(HeapTracker::snapshot().overBudgetPolls, 0u);
+}
+
+TEST_P(ReadStatusBench, ParseTime) {
+    for (int i = 0; i < WARMUP_POLLS; i++) poll();
+
+    // Reference passes are interleaved with the polls so both see the same load.
+    std::unique_ptr<ReferenceParser> referenceParser(new ReferenceParser());
+    std::vector<uint32_t> parseNanos;
+    std::vector<uint32_t> referenceNanos;
+    const int polls = benchPolls();
+    for (int i = 0; i < polls; i++) {
+        poll();
+        parseNanos.push_back(spa->getLastParseMicros() * 1000);
+        referenceNanos.push_back(referenceParser->timePass(response));
+    }
+
+    std::sort(parseNanos.begin(), parseNanos.end());
+    const uint32_t p50 = parseNanos[parseNanos.size() / 2] / 1000;
+    const uint32_t p90 = parseNanos[parseNanos.size() * 9 / 10] / 1000;
+    const uint32_t reference = std::max<uint32_t>(1, median(referenceNanos));
+    const double ratio = (double)parseNanos[parseNanos.size() / 2] / reference;
+    const double budget = parseTimeBudget();
+    printf("[ bench    ] %s: parse median %u us, p90 %u us over %d polls; %.1fx the reference parser (%u ns), budget %.0fx\n",
+           levelName(), p50, p90, polls, ratio, reference, budget);
+    RecordProperty("parseMedianMicros", (int)p50);
+    RecordProperty("parseP90Micros", (int)p90);
+    RecordProperty("referenceNanos", (int)reference);
+    EXPECT_LE(ratio, budget);
+}
+
+// Quiet, as usually deployed, and with a verbose trace being captured.
+INSTANTIATE_TEST_SUITE_P(LogLevel, ReadStatusBench,
+                         ::testing::Values((uint8_t)RemoteDebug::ANY, (uint8_t)RemoteDebug::VERBOSE),
+                         [](const ::testing::TestParamInfo<uint8_t> &info) {
+                             return info.param == RemoteDebug::VERBOSE ? std::string("Verbose") : std::string("Quiet");
+                         });
+
+} // namespace
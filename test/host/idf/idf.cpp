@@ -0,0 +1,54 @@
+#include "miniz.h"
+#include "mbedtls/sha256.h"
+
+#include <openssl/evp.h>
+
+tinfl_status tinfl_decompress(tinfl_decompressor *r, const uint8_t *pIn_buf_next, size_t *pIn_buf_size,
+                              uint8_t *pOut_buf_start, uint8_t *pOut_buf_next, size_t *pOut_buf_size,
+                              const uint32_t decomp_flags) {
+    (void)pOut_buf_start;
+    (void)decomp_flags;
+    z_stream &zs = r->stream;
+    if (r->m_state == 0) {
+        zs = z_stream();
+        // Negative window bits: raw deflate, as tinfl without TINFL_FLAG_PARSE_ZLIB_HEADER.
+        if (inflateInit2(&zs, -15) != Z_OK) return TINFL_STATUS_FAILED;
+        r->m_state = 1;
+    }
+    zs.next_in = const_cast<Bytef *>(pIn_buf_next);
+    zs.avail_in = (uInt)*pIn_buf_size;
+    zs.next_out = pOut_buf_next;
+    zs.avail_out = (uInt)*pOut_buf_size;
+    const int rc = inflate(&zs, Z_NO_FLUSH);
+    *pIn_buf_size -= zs.avail_in;
+    *pOut_buf_size -= zs.avail_out;
+
+    if (rc == Z_STREAM_END || (rc != Z_OK && rc != Z_BUF_ERROR)) {
+        inflateEnd(&zs);
+        r->m_state = 0;
+        return rc == Z_STREAM_END ? TINFL_STATUS_DONE : TINFL_STATUS_FAILED;
+    }
+    return zs.avail_out == 0 ? TINFL_STATUS_HAS_MORE_OUTPUT : TINFL_STATUS_NEEDS_MORE_INPUT;
+}
+
+void mbedtls_sha256_init(mbedtls_sha256_context *ctx) {
+    ctx->md = nullptr;
+}
+
+void mbedtls_sha256_free(mbedtls_sha256_context *ctx) {
+    EVP_MD_CTX_free(static_cast<EVP_MD_CTX *>(ctx->md));
+    ctx->md = nullptr;
+}
+
+int mbedtls_sha256_starts(mbedtls_sha256_context *ctx, int is224) {
+    if (ctx->md == nullptr) ctx->md = EVP_MD_CTX_new();
+    return EVP_DigestInit_ex(static_cast<EVP_MD_CTX *>(ctx->md), is224 ? EVP_sha224() : EVP_sha256(), nullptr) == 1 ? 0 : -1;
+}
+
+int mbedtls_sha256_update(mbedtls_sha256_context *ctx, const unsigned char *input, size_t ilen) {
+    return EVP_DigestUpdate(static_cast<EVP_MD_CTX *>(ctx->md), input, ilen) == 1 ? 0 : -1;
+}
+
+int mbedtls_sha256_finish(mbedtls_sha256_context *ctx, unsigned char output[32]) {
+    return EVP_DigestFinal_ex(static_cast<EVP_MD_CTX *>(ctx->md), output, nullptr) == 1 ? 0 : -1;
+}
@@ -0,0 +1,21 @@
+#ifndef HOST_MBEDTLS_SHA256_H
+#define HOST_MBEDTLS_SHA256_H
+
+/**
+ * @file sha256.h
+ * @brief Host stand-in for mbedTLS SHA-256, backed by OpenSSL.
+ */
+
+#include <cstddef>
+
+typedef struct {
+    void *md;   // EVP_MD_CTX, created by mbedtls_sha256_starts()
+} mbedtls_sha256_context;
+
+void mbedtls_sha256_init(mbedtls_sha256_context *ctx);
+void mbedtls_sha256_free(mbedtls_sha256_context *ctx);
+int mbedtls_sha256_starts(mbedtls_sha256_context *ctx, int is224);
+int mbedtls_sha256_update(mbedtls_sha256_context *ctx, const unsigned char *input, size_t ilen);
+int mbedtls_sha256_finish(mbedtls_sha256_context *ctx, unsigned char output[32]);
+
+#endif // HOST_MBEDTLS_SHA256_H
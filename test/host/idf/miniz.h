@@ -0,0 +1,45 @@
+#ifndef HOST_MINIZ_H
+#define HOST_MINIZ_H
+
+/**
+ * @file miniz.h
+ * @brief Host stand-in for the tinfl part of the ESP32 ROM miniz, backed by zlib.
+ *
+ * Only what OtaUpdater uses: a raw deflate stream inflated into a wrapping
+ * TINFL_LZ_DICT_SIZE dictionary, with TINFL_FLAG_HAS_MORE_INPUT.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <zlib.h>
+
+#define TINFL_LZ_DICT_SIZE 32768
+
+enum {
+    TINFL_FLAG_PARSE_ZLIB_HEADER = 1,
+    TINFL_FLAG_HAS_MORE_INPUT = 2,
+    TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF = 4,
+    TINFL_FLAG_COMPUTE_ADLER32 = 8
+};
+
+typedef enum {
+    TINFL_STATUS_BAD_PARAM = -3,
+    TINFL_STATUS_ADLER32_MISMATCH = -2,
+    TINFL_STATUS_FAILED = -1,
+    TINFL_STATUS_DONE = 0,
+    TINFL_STATUS_NEEDS_MORE_INPUT = 1,
+    TINFL_STATUS_HAS_MORE_OUTPUT = 2
+} tinfl_status;
+
+typedef struct {
+    uint32_t m_state;   // 0 until the zlib stream has been set up
+    z_stream stream;
+} tinfl_decompressor;
+
+#define tinfl_init(r) do { (r)->m_state = 0; } while (0)
+
+tinfl_status tinfl_decompress(tinfl_decompressor *r, const uint8_t *pIn_buf_next, size_t *pIn_buf_size,
+                              uint8_t *pOut_buf_start, uint8_t *pOut_buf_next, size_t *pOut_buf_size,
+                              const uint32_t decomp_flags);
+
+#endif // HOST_MINIZ_H
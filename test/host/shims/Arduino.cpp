@@ -0,0 +1,79 @@
+#include "Arduino.h"
+
+#include <chrono>
+
+HardwareSerial Serial;
+HardwareSerial Serial1;
+HardwareSerial Serial2;
+EspClass ESP;
+
+namespace {
+
+const auto start = std::chrono::steady_clock::now();
+uint64_t skippedUs = 0;
+
+} // namespace
+
+namespace host {
+
+void advance(uint32_t ms) {
+    skippedUs += (uint64_t)ms * 1000;
+}
+
+} // namespace host
+
+unsigned long micros() {
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    return (unsigned long)(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() + skippedUs);
+}
+
+unsigned long millis() {
+    return micros() / 1000;
+}
+
+void delay(uint32_t ms) {
+    host::advance(ms);
+}
+
+void delayMicroseconds(uint32_t us) {
+    skippedUs += us;
+}
+
+void yield() {}
+
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t, uint8_t) {}
+int digitalRead(uint8_t) { return HIGH; }
+
+void configTzTime(const char *tz, const char *, const char *, const char *) {
+    setenv("TZ", tz, 1);
+    tzset();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+    static int loopTask;
+    return &loopTask;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+    static int semaphore;
+    return &semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+    return xSemaphoreCreateBinary();
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t) {
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t, TickType_t ticks) {
+    // Nothing else runs, so waiting for data is just time passing.
+    host::advance(ticks == portMAX_DELAY ? 1 : ticks);
+    return pdFALSE;
+}
+
+void vTaskDelay(TickType_t ticks) {
+    host::advance(ticks);
+}
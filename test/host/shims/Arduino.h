@@ -0,0 +1,95 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+/**
+ * @file Arduino.h
+ * @brief Just enough of the Arduino-ESP32 core to build the spa link code on
+ * the host, for the tests in test/host.
+ *
+ * Time is real (steady clock) plus whatever delay() and host::advance() have
+ * added, so code that waits with delay() runs instantly while micros() still
+ * measures real work.
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cmath>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include "WString.h"
+#include "Print.h"
+#include "Stream.h"
+#include "HardwareSerial.h"
+
+using std::max;
+using std::min;
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define PROGMEM
+#define F(text) (text)
+#define IRAM_ATTR
+#define DEC 10
+#define HEX 16
+#define SERIAL_8N1 0x800001c
+#define HIGH 1
+#define LOW 0
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+void configTzTime(const char *tz, const char *server1, const char *server2 = nullptr, const char *server3 = nullptr);
+
+namespace host {
+/// @brief Move the clock forward without waiting, e.g. to make a poll due.
+void advance(uint32_t ms);
+}
+
+/// @brief Heap figures for HeapTracker and CrashLog; fixed values on the host.
+class EspClass {
+public:
+    uint32_t getFreeHeap() { return 200000; }
+    uint32_t getMinFreeHeap() { return 180000; }
+    uint32_t getMaxAllocHeap() { return 100000; }
+    uint32_t getHeapSize() { return 320000; }
+    void restart() {}
+};
+extern EspClass ESP;
+
+// FreeRTOS, as used by the spa link: one task, and semaphores that never block.
+typedef void *TaskHandle_t;
+typedef void *SemaphoreHandle_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define portMAX_DELAY 0xffffffffUL
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+TaskHandle_t xTaskGetCurrentTaskHandle();
+SemaphoreHandle_t xSemaphoreCreateBinary();
+SemaphoreHandle_t xSemaphoreCreateMutex();
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks);
+void vTaskDelay(TickType_t ticks);
+
+#endif // HOST_ARDUINO_H
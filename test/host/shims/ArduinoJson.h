@@ -0,0 +1,30 @@
+#ifndef HOST_ARDUINOJSON_H
+#define HOST_ARDUINOJSON_H
+
+/**
+ * @file ArduinoJson.h
+ * @brief Accepts the document building HeapTracker::toJson() does so the real
+ * HeapTracker.cpp links on the host; serialises to an empty object. The host
+ * tests read HeapTracker::snapshot() instead.
+ */
+
+#include <Arduino.h>
+
+class JsonVariant {
+public:
+    JsonVariant operator[](const char *) { return JsonVariant(); }
+    template <typename T>
+    JsonVariant &operator=(const T &) { return *this; }
+};
+
+class JsonDocument {
+public:
+    JsonVariant operator[](const char *) { return JsonVariant(); }
+};
+
+inline size_t serializeJson(const JsonDocument &, String &output) {
+    output = "{}";
+    return output.length();
+}
+
+#endif // HOST_ARDUINOJSON_H
@@ -0,0 +1,32 @@
+#ifndef HOST_ESPASYNCWEBSERVER_H
+#define HOST_ESPASYNCWEBSERVER_H
+
+/**
+ * @file ESPAsyncWebServer.h
+ * @brief The WebSocket surface WebRemoteDebug uses, for host builds. No
+ * socket is ever attached in the host tests, so nothing here does any work.
+ */
+
+#include <Arduino.h>
+
+class AsyncWebSocketClient {
+public:
+    uint32_t id() const { return 0; }
+    bool queueIsFull() const { return false; }
+    bool text(const char *, size_t) { return true; }
+    bool text(const String &) { return true; }
+    void close(uint16_t = 0, const char * = nullptr) {}
+};
+
+class AsyncWebSocket {
+public:
+    explicit AsyncWebSocket(const String &) {}
+    AsyncWebSocketClient *client(uint32_t) { return nullptr; }
+    size_t count() const { return 0; }
+    void cleanupClients(uint16_t = 8) {}
+    void closeAll(uint16_t = 0, const char * = nullptr) {}
+    bool textAll(const char *, size_t) { return true; }
+    bool textAll(const String &) { return true; }
+};
+
+#endif // HOST_ESPASYNCWEBSERVER_H
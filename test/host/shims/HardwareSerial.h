@@ -0,0 +1,75 @@
+#ifndef HOST_HARDWARESERIAL_H
+#define HOST_HARDWARESERIAL_H
+
+#include <functional>
+#include <string>
+#include "Stream.h"
+
+/**
+ * @brief In-memory UART for host tests.
+ *
+ * Bytes queued with inject() are what the spa sent; everything written is kept
+ * in sent(). A responder, if set, sees each line written and may inject the
+ * spa's reply, e.g. the echo of a write command.
+ */
+class HardwareSerial : public Stream {
+public:
+    using Responder = std::function<void(HardwareSerial &port, const std::string &line)>;
+
+    void begin(unsigned long, uint32_t = 0, int8_t = -1, int8_t = -1) {}
+    void end() {}
+    size_t setRxBufferSize(size_t size) { return size; }
+    size_t setTxBufferSize(size_t size) { return size; }
+    void onReceive(std::function<void()> callback, bool = false) { _onReceive = callback; }
+    operator bool() const { return true; }
+
+    int available() override { return (int)(_rx.size() - _rxPos); }
+    int read() override { return _rxPos < _rx.size() ? (uint8_t)_rx[_rxPos++] : -1; }
+    int peek() override { return _rxPos < _rx.size() ? (uint8_t)_rx[_rxPos] : -1; }
+
+    size_t write(uint8_t value) override {
+        _tx += (char)value;
+        if (value == '\n') {
+            std::string line = _line;
+            _line.clear();
+            if (_responder) _responder(*this, line);
+        } else {
+            _line += (char)value;
+        }
+        return 1;
+    }
+    using Print::write;
+
+    /// @brief Queue bytes as if the spa had sent them.
+    void inject(const std::string &data) {
+        if (_rxPos == _rx.size()) {
+            _rx.clear();
+            _rxPos = 0;
+        }
+        _rx += data;
+        if (_onReceive) _onReceive();
+    }
+    void setResponder(Responder responder) { _responder = responder; }
+    const std::string &sent() const { return _tx; }
+    void reset() {
+        _rx.clear();
+        _rxPos = 0;
+        _tx.clear();
+        _line.clear();
+        _responder = nullptr;
+    }
+
+private:
+    std::string _rx;
+    size_t _rxPos = 0;
+    std::string _tx;
+    std::string _line;
+    Responder _responder;
+    std::function<void()> _onReceive;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+extern HardwareSerial Serial2;
+
+#endif // HOST_HARDWARESERIAL_H
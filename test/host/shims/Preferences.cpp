@@ -0,0 +1,64 @@
+#include "Preferences.h"
+
+#include <map>
+#include <string>
+
+namespace {
+
+std::map<std::string, std::string> &store() {
+    static std::map<std::string, std::string> values;
+    return values;
+}
+
+std::string keyOf(const String &space, const char *key) {
+    return std::string(space.c_str()) + "/" + key;
+}
+
+} // namespace
+
+bool Preferences::begin(const char *name, bool readOnly) {
+    _namespace = name;
+    _readOnly = readOnly;
+    _open = true;
+    return true;
+}
+
+void Preferences::end() {
+    _open = false;
+}
+
+int32_t Preferences::getInt(const char *key, int32_t defaultValue) {
+    auto found = store().find(keyOf(_namespace, key));
+    return found == store().end() ? defaultValue : atoi(found->second.c_str());
+}
+
+String Preferences::getString(const char *key, String defaultValue) {
+    auto found = store().find(keyOf(_namespace, key));
+    return found == store().end() ? defaultValue : String(found->second.c_str());
+}
+
+size_t Preferences::putInt(const char *key, int32_t value) {
+    if (!_open || _readOnly) return 0;
+    store()[keyOf(_namespace, key)] = std::to_string(value);
+    return sizeof(value);
+}
+
+size_t Preferences::putString(const char *key, String value) {
+    if (!_open || _readOnly) return 0;
+    store()[keyOf(_namespace, key)] = value.c_str();
+    return value.length();
+}
+
+bool Preferences::remove(const char *key) {
+    return _open && !_readOnly && store().erase(keyOf(_namespace, key)) > 0;
+}
+
+bool Preferences::clear() {
+    if (!_open || _readOnly) return false;
+    const std::string prefix = std::string(_namespace.c_str()) + "/";
+    for (auto it = store().begin(); it != store().end();) {
+        if (it->first.compare(0, prefix.size(), prefix) == 0) it = store().erase(it);
+        else ++it;
+    }
+    return true;
+}
@@ -0,0 +1,26 @@
+#ifndef HOST_PREFERENCES_H
+#define HOST_PREFERENCES_H
+
+/// @file Preferences.h
+/// @brief NVS preferences kept in memory for the life of the test process.
+
+#include <Arduino.h>
+
+class Preferences {
+public:
+    bool begin(const char *name, bool readOnly = false);
+    void end();
+    int32_t getInt(const char *key, int32_t defaultValue = 0);
+    String getString(const char *key, String defaultValue = String());
+    size_t putInt(const char *key, int32_t value);
+    size_t putString(const char *key, String value);
+    bool remove(const char *key);
+    bool clear();
+
+private:
+    String _namespace;
+    bool _readOnly = true;
+    bool _open = false;
+};
+
+#endif // HOST_PREFERENCES_H
@@ -0,0 +1,52 @@
+#ifndef HOST_PRINT_H
+#define HOST_PRINT_H
+
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "WString.h"
+
+/// @brief Host stand-in for the Arduino Print base class.
+class Print {
+public:
+    virtual ~Print() {}
+
+    virtual size_t write(uint8_t value) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size) {
+        size_t n = 0;
+        while (size-- > 0 && write(*buffer++) == 1) n++;
+        return n;
+    }
+    size_t write(const char *text) { return text == nullptr ? 0 : write((const uint8_t *)text, strlen(text)); }
+    virtual void flush() {}
+
+    size_t print(const String &text) { return write((const uint8_t *)text.c_str(), text.length()); }
+    size_t print(const char *text) { return write(text); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int value) { return print(String(value)); }
+    size_t print(unsigned int value) { return print(String(value)); }
+    size_t print(long value) { return print(String(value)); }
+    size_t print(unsigned long value) { return print(String(value)); }
+    size_t println() { return print("\r\n"); }
+    template <typename T>
+    size_t println(const T &value) { return print(value) + println(); }
+
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3))) {
+        va_list arguments;
+        va_start(arguments, format);
+        const size_t written = vprintf(format, arguments);
+        va_end(arguments);
+        return written;
+    }
+
+    size_t vprintf(const char *format, va_list arguments) {
+        char buffer[256];
+        int length = vsnprintf(buffer, sizeof(buffer), format, arguments);
+        if (length < 0) return 0;
+        if ((size_t)length >= sizeof(buffer)) length = sizeof(buffer) - 1;
+        return write((const uint8_t *)buffer, length);
+    }
+};
+
+#endif // HOST_PRINT_H
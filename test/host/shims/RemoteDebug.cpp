@@ -0,0 +1,11 @@
+#include "RemoteDebug.h"
+
+#include <cstdlib>
+
+static uint8_t initialLevel() {
+    const char *level = getenv("SPA_HOST_LOG_LEVEL");
+    return level != nullptr ? (uint8_t)atoi(level) : RemoteDebug::ANY;
+}
+
+uint8_t RemoteDebug::hostActiveLevel = initialLevel();
+FILE *RemoteDebug::hostOutput = stderr;
@@ -0,0 +1,74 @@
+#ifndef HOST_REMOTEDEBUG_H
+#define HOST_REMOTEDEBUG_H
+
+/**
+ * @file RemoteDebug.h
+ * @brief Host stand-in for the RemoteDebug telnet logger.
+ *
+ * Output goes to RemoteDebug::hostOutput (stderr, or nullptr to format and
+ * discard it). A level is active when it is at or above
+ * RemoteDebug::hostActiveLevel, which is ANY (quiet) unless the environment
+ * sets SPA_HOST_LOG_LEVEL, e.g. SPA_HOST_LOG_LEVEL=1 for verbose.
+ */
+
+#include <Arduino.h>
+#include <cstdio>
+
+class RemoteDebug : public Print {
+public:
+    static const uint8_t PROFILER = 0;
+    static const uint8_t VERBOSE = 1;
+    static const uint8_t DEBUG = 2;
+    static const uint8_t INFO = 3;
+    static const uint8_t WARNING = 4;
+    static const uint8_t ERROR = 5;
+    static const uint8_t ANY = 6;
+
+    static uint8_t hostActiveLevel;
+    static FILE *hostOutput;
+
+    bool begin(String, uint8_t = DEBUG) { return true; }
+    bool begin(String, uint16_t, uint8_t) { return true; }
+    void stop() {}
+    void handle() {}
+    bool isActive(uint8_t level = DEBUG) { return level >= hostActiveLevel; }
+    bool isConnected() { return false; }
+    void disconnect(bool = false) {}
+
+    void setPassword(String) {}
+    void setSerialEnabled(bool) {}
+    void setResetCmdEnabled(bool) {}
+    void setHelpProjectsCmds(String) {}
+    void setCallBackProjectCmds(void (*)()) {}
+    void setCallBackNewClient(void (*)()) {}
+    String getLastCommand() { return String(); }
+    void clearLastCommand() {}
+    void showTime(bool) {}
+    void showProfiler(bool, uint32_t = 0) {}
+    void showDebugLevel(bool) {}
+    void showColors(bool) {}
+    void showRaw(bool) {}
+    void setFilter(String) {}
+    void setNoFilter() {}
+    void silence(bool, bool = false, bool = false, uint32_t = 0) {}
+    bool isSilence() { return false; }
+
+    size_t write(uint8_t value) override { return hostOutput != nullptr ? fwrite(&value, 1, 1, hostOutput) : 1; }
+    size_t write(const uint8_t *buffer, size_t size) override {
+        return hostOutput != nullptr ? fwrite(buffer, 1, size, hostOutput) : size;
+    }
+    using Print::write;
+};
+
+#define rdebugVln(fmt, ...) if (Debug.isActive(Debug.VERBOSE)) Debug.printf("(%s)(C%d) " fmt "\n", __func__, 1, ##__VA_ARGS__)
+#define rdebugDln(fmt, ...) if (Debug.isActive(Debug.DEBUG)) Debug.printf("(%s)(C%d) " fmt "\n", __func__, 1, ##__VA_ARGS__)
+#define rdebugIln(fmt, ...) if (Debug.isActive(Debug.INFO)) Debug.printf("(%s)(C%d) " fmt "\n", __func__, 1, ##__VA_ARGS__)
+#define rdebugWln(fmt, ...) if (Debug.isActive(Debug.WARNING)) Debug.printf("(%s)(C%d) " fmt "\n", __func__, 1, ##__VA_ARGS__)
+#define rdebugEln(fmt, ...) if (Debug.isActive(Debug.ERROR)) Debug.printf("(%s)(C%d) " fmt "\n", __func__, 1, ##__VA_ARGS__)
+#define debugV(fmt, ...) rdebugVln(fmt, ##__VA_ARGS__)
+#define debugD(fmt, ...) rdebugDln(fmt, ##__VA_ARGS__)
+#define debugI(fmt, ...) rdebugIln(fmt, ##__VA_ARGS__)
+#define debugW(fmt, ...) rdebugWln(fmt, ##__VA_ARGS__)
+#define debugE(fmt, ...) rdebugEln(fmt, ##__VA_ARGS__)
+
+#endif // HOST_REMOTEDEBUG_H
@@ -0,0 +1,44 @@
+#ifndef HOST_STREAM_H
+#define HOST_STREAM_H
+
+#include "Print.h"
+
+/// @brief Host stand-in for the Arduino Stream class; reads never block.
+class Stream : public Print {
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+
+    void setTimeout(unsigned long timeout) { _timeout = timeout; }
+
+    size_t readBytes(char *buffer, size_t length) {
+        size_t count = 0;
+        while (count < length) {
+            const int c = read();
+            if (c < 0) break;
+            buffer[count++] = (char)c;
+        }
+        return count;
+    }
+    size_t readBytes(uint8_t *buffer, size_t length) { return readBytes((char *)buffer, length); }
+
+    String readString() {
+        String result;
+        int c;
+        while ((c = read()) >= 0) result += (char)c;
+        return result;
+    }
+
+    String readStringUntil(char terminator) {
+        String result;
+        int c;
+        while ((c = read()) >= 0 && c != terminator) result += (char)c;
+        return result;
+    }
+
+protected:
+    unsigned long _timeout = 1000;
+};
+
+#endif // HOST_STREAM_H
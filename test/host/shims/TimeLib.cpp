@@ -0,0 +1,38 @@
+#include "TimeLib.h"
+
+time_t makeTime(const tmElements_t &tm) {
+    struct tm t = {};
+    t.tm_year = tm.Year + 70;
+    t.tm_mon = tm.Month - 1;
+    t.tm_mday = tm.Day;
+    t.tm_hour = tm.Hour;
+    t.tm_min = tm.Minute;
+    t.tm_sec = tm.Second;
+    return timegm(&t);
+}
+
+void breakTime(time_t time, tmElements_t &tm) {
+    struct tm t;
+    gmtime_r(&time, &t);
+    tm.Second = t.tm_sec;
+    tm.Minute = t.tm_min;
+    tm.Hour = t.tm_hour;
+    tm.Wday = t.tm_wday + 1;
+    tm.Day = t.tm_mday;
+    tm.Month = t.tm_mon + 1;
+    tm.Year = t.tm_year - 70;
+}
+
+static tmElements_t broken(time_t t) {
+    tmElements_t tm;
+    breakTime(t, tm);
+    return tm;
+}
+
+int year(time_t t) { return tmYearToCalendar(broken(t).Year); }
+int month(time_t t) { return broken(t).Month; }
+int day(time_t t) { return broken(t).Day; }
+int hour(time_t t) { return broken(t).Hour; }
+int minute(time_t t) { return broken(t).Minute; }
+int second(time_t t) { return broken(t).Second; }
+int weekday(time_t t) { return broken(t).Wday; }
@@ -0,0 +1,35 @@
+#ifndef HOST_TIMELIB_H
+#define HOST_TIMELIB_H
+
+/// @file TimeLib.h
+/// @brief The parts of Paul Stoffregen's Time library the spa code uses, on top of the C library.
+
+#include <ctime>
+#include <cstdint>
+
+typedef struct {
+    uint8_t Second;
+    uint8_t Minute;
+    uint8_t Hour;
+    uint8_t Wday;   // day of week, Sunday is day 1
+    uint8_t Day;
+    uint8_t Month;
+    uint8_t Year;   // offset from 1970
+} tmElements_t;
+
+#define tmYearToCalendar(Y) ((Y) + 1970)
+#define CalendarYrToTm(Y) ((Y) - 1970)
+#define tmYearToY2k(Y) ((Y) - 30)
+#define y2kYearToTm(Y) ((Y) + 30)
+
+time_t makeTime(const tmElements_t &tm);
+void breakTime(time_t time, tmElements_t &tm);
+int year(time_t t);
+int month(time_t t);
+int day(time_t t);
+int hour(time_t t);
+int minute(time_t t);
+int second(time_t t);
+int weekday(time_t t);
+
+#endif // HOST_TIMELIB_H
@@ -0,0 +1,326 @@
+#include "WString.h"
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+namespace {
+
+// Digits of value in base, most significant first, into out (at least 66 bytes).
+void formatUnsigned(unsigned long long value, unsigned char base, char *out) {
+    char digits[65];
+    size_t count = 0;
+    if (base < 2 || base > 36) base = 10;
+    do {
+        const unsigned digit = value % base;
+        digits[count++] = digit < 10 ? '0' + digit : 'a' + digit - 10;
+        value /= base;
+    } while (value != 0);
+    for (size_t i = 0; i < count; i++) out[i] = digits[count - 1 - i];
+    out[count] = '\0';
+}
+
+void formatSigned(long long value, unsigned char base, char *out) {
+    if (value < 0 && base == 10) {
+        *out++ = '-';
+        formatUnsigned(0ULL - (unsigned long long)value, base, out);
+    } else {
+        formatUnsigned((unsigned long long)value, base, out);
+    }
+}
+
+} // namespace
+
+String::String(const char *cstr) {
+    _sso[0] = '\0';
+    if (cstr != nullptr) copy(cstr, strlen(cstr));
+}
+
+String::String(const char *cstr, unsigned length) {
+    _sso[0] = '\0';
+    if (cstr != nullptr) copy(cstr, length);
+}
+
+String::String(const String &other) {
+    _sso[0] = '\0';
+    copy(other.buffer(), other._length);
+}
+
+String::String(String &&other) noexcept {
+    _sso[0] = '\0';
+    move(other);
+}
+
+String::String(char c) {
+    const char text[2] = {c, '\0'};
+    _sso[0] = '\0';
+    copy(text, 1);
+}
+
+String::String(unsigned char value, unsigned char base) : String((unsigned long long)value, base) {}
+String::String(int value, unsigned char base) : String((long long)value, base) {}
+String::String(unsigned int value, unsigned char base) : String((unsigned long long)value, base) {}
+String::String(long value, unsigned char base) : String((long long)value, base) {}
+String::String(unsigned long value, unsigned char base) : String((unsigned long long)value, base) {}
+
+String::String(long long value, unsigned char base) {
+    char text[67];
+    formatSigned(value, base, text);
+    _sso[0] = '\0';
+    copy(text, strlen(text));
+}
+
+String::String(unsigned long long value, unsigned char base) {
+    char text[66];
+    formatUnsigned(value, base, text);
+    _sso[0] = '\0';
+    copy(text, strlen(text));
+}
+
+String::String(float value, unsigned int decimalPlaces) : String((double)value, decimalPlaces) {}
+
+String::String(double value, unsigned int decimalPlaces) {
+    char text[64];
+    snprintf(text, sizeof(text), "%.*f", (int)decimalPlaces, value);
+    _sso[0] = '\0';
+    copy(text, strlen(text));
+}
+
+String::~String() {
+    free(_heap);
+}
+
+String &String::operator=(const String &rhs) {
+    if (this != &rhs) copy(rhs.buffer(), rhs._length);
+    return *this;
+}
+
+String &String::operator=(String &&rhs) noexcept {
+    if (this != &rhs) move(rhs);
+    return *this;
+}
+
+String &String::operator=(const char *cstr) {
+    if (cstr == nullptr) cstr = "";
+    copy(cstr, strlen(cstr));
+    return *this;
+}
+
+bool String::reserve(unsigned int size) {
+    if (size <= _capacity) return true;
+    // As the ESP32 core: heap buffers grow in 16-byte steps, through realloc.
+    const size_t newSize = (size + 16) & ~(size_t)0xf;
+    char *grown = (char *)realloc(_heap, newSize);
+    if (grown == nullptr) return false;
+    if (_heap == nullptr) memcpy(grown, _sso, _length + 1);
+    _heap = grown;
+    _capacity = newSize - 1;
+    return true;
+}
+
+void String::copy(const char *cstr, unsigned int length) {
+    if (!reserve(length)) return;
+    memmove(wbuffer(), cstr, length);
+    _length = length;
+    wbuffer()[_length] = '\0';
+}
+
+void String::move(String &rhs) {
+    free(_heap);
+    _heap = rhs._heap;
+    _capacity = rhs._capacity;
+    _length = rhs._length;
+    if (_heap == nullptr) memcpy(_sso, rhs._sso, _length + 1);
+    rhs._heap = nullptr;
+    rhs._capacity = SSO_LENGTH;
+    rhs._length = 0;
+    rhs._sso[0] = '\0';
+}
+
+bool String::concat(const char *cstr, unsigned int length) {
+    if (cstr == nullptr) return false;
+    if (length == 0) return true;
+    // cstr may point into this string, which reserve() can move.
+    const bool self = cstr >= buffer() && cstr < buffer() + _capacity + 1;
+    const size_t offset = self ? cstr - buffer() : 0;
+    if (!reserve(_length + length)) return false;
+    if (self) cstr = buffer() + offset;
+    memmove(wbuffer() + _length, cstr, length);
+    _length += length;
+    wbuffer()[_length] = '\0';
+    return true;
+}
+
+bool String::concat(const String &str) { return concat(str.buffer(), str._length); }
+bool String::concat(const char *cstr) { return cstr != nullptr && concat(cstr, strlen(cstr)); }
+bool String::concat(char c) { return concat(&c, 1); }
+bool String::concat(unsigned char value) { return concat(String(value)); }
+bool String::concat(int value) { return concat(String(value)); }
+bool String::concat(unsigned int value) { return concat(String(value)); }
+bool String::concat(long value) { return concat(String(value)); }
+bool String::concat(unsigned long value) { return concat(String(value)); }
+bool String::concat(long long value) { return concat(String(value)); }
+bool String::concat(unsigned long long value) { return concat(String(value)); }
+bool String::concat(float value) { return concat(String(value)); }
+bool String::concat(double value) { return concat(String(value)); }
+
+int String::compareTo(const String &rhs) const {
+    return strcmp(buffer(), rhs.buffer());
+}
+
+bool String::equals(const String &rhs) const {
+    return _length == rhs._length && memcmp(buffer(), rhs.buffer(), _length) == 0;
+}
+
+bool String::equals(const char *cstr) const {
+    return strcmp(buffer(), cstr != nullptr ? cstr : "") == 0;
+}
+
+bool String::equalsIgnoreCase(const String &rhs) const {
+    return _length == rhs._length && strcasecmp(buffer(), rhs.buffer()) == 0;
+}
+
+bool String::startsWith(const String &prefix) const {
+    return prefix._length <= _length && memcmp(buffer(), prefix.buffer(), prefix._length) == 0;
+}
+
+bool String::endsWith(const String &suffix) const {
+    return suffix._length <= _length &&
+           memcmp(buffer() + _length - suffix._length, suffix.buffer(), suffix._length) == 0;
+}
+
+char String::charAt(unsigned int index) const {
+    return index < _length ? buffer()[index] : '\0';
+}
+
+void String::setCharAt(unsigned int index, char c) {
+    if (index < _length) wbuffer()[index] = c;
+}
+
+char String::operator[](unsigned int index) const {
+    return charAt(index);
+}
+
+char &String::operator[](unsigned int index) {
+    static char dummy;
+    if (index >= _length) {
+        dummy = '\0';
+        return dummy;
+    }
+    return wbuffer()[index];
+}
+
+void String::toCharArray(char *buf, unsigned int bufsize, unsigned int index) const {
+    if (bufsize == 0 || buf == nullptr) return;
+    if (index >= _length) {
+        buf[0] = '\0';
+        return;
+    }
+    unsigned int n = bufsize - 1;
+    if (n > _length - index) n = _length - index;
+    memcpy(buf, buffer() + index, n);
+    buf[n] = '\0';
+}
+
+int String::indexOf(char ch, unsigned int fromIndex) const {
+    if (fromIndex >= _length) return -1;
+    const char *found = (const char *)memchr(buffer() + fromIndex, ch, _length - fromIndex);
+    return found == nullptr ? -1 : (int)(found - buffer());
+}
+
+int String::indexOf(const String &str, unsigned int fromIndex) const {
+    if (fromIndex > _length) return -1;
+    const char *found = strstr(buffer() + fromIndex, str.buffer());
+    return found == nullptr ? -1 : (int)(found - buffer());
+}
+
+int String::lastIndexOf(char ch) const {
+    const char *found = strrchr(buffer(), ch);
+    return found == nullptr ? -1 : (int)(found - buffer());
+}
+
+int String::lastIndexOf(const String &str) const {
+    if (str._length > _length) return -1;
+    for (int i = (int)(_length - str._length); i >= 0; i--) {
+        if (memcmp(buffer() + i, str.buffer(), str._length) == 0) return i;
+    }
+    return -1;
+}
+
+String String::substring(unsigned int beginIndex, unsigned int endIndex) const {
+    if (beginIndex > endIndex) {
+        const unsigned int swap = beginIndex;
+        beginIndex = endIndex;
+        endIndex = swap;
+    }
+    if (beginIndex >= _length) return String();
+    if (endIndex > _length) endIndex = _length;
+    return String(buffer() + beginIndex, endIndex - beginIndex);
+}
+
+void String::replace(char find, char replace) {
+    for (unsigned int i = 0; i < _length; i++) {
+        if (wbuffer()[i] == find) wbuffer()[i] = replace;
+    }
+}
+
+void String::replace(const String &find, const String &replace) {
+    if (find._length == 0) return;
+    String result;
+    unsigned int from = 0;
+    int at;
+    while ((at = indexOf(find, from)) >= 0) {
+        result.concat(buffer() + from, at - from);
+        result.concat(replace);
+        from = at + find._length;
+    }
+    if (from == 0) return;
+    result.concat(buffer() + from, _length - from);
+    *this = std::move(result);
+}
+
+void String::remove(unsigned int index) {
+    remove(index, (unsigned int)-1);
+}
+
+void String::remove(unsigned int index, unsigned int count) {
+    if (index >= _length) return;
+    if (count > _length - index) count = _length - index;
+    memmove(wbuffer() + index, buffer() + index + count, _length - index - count + 1);
+    _length -= count;
+}
+
+void String::toLowerCase() {
+    for (unsigned int i = 0; i < _length; i++) wbuffer()[i] = (char)tolower((unsigned char)wbuffer()[i]);
+}
+
+void String::toUpperCase() {
+    for (unsigned int i = 0; i < _length; i++) wbuffer()[i] = (char)toupper((unsigned char)wbuffer()[i]);
+}
+
+void String::trim() {
+    unsigned int begin = 0;
+    while (begin < _length && isspace((unsigned char)buffer()[begin])) begin++;
+    unsigned int end = _length;
+    while (end > begin && isspace((unsigned char)buffer()[end - 1])) end--;
+    _length = end - begin;
+    memmove(wbuffer(), buffer() + begin, _length);
+    wbuffer()[_length] = '\0';
+}
+
+long String::toInt() const { return atol(buffer()); }
+float String::toFloat() const { return (float)atof(buffer()); }
+double String::toDouble() const { return atof(buffer()); }
+
+String operator+(const String &lhs, const String &rhs) { String s(lhs); s.concat(rhs); return s; }
+String operator+(const String &lhs, const char *rhs) { String s(lhs); s.concat(rhs); return s; }
+String operator+(const char *lhs, const String &rhs) { String s(lhs); s.concat(rhs); return s; }
+String operator+(const String &lhs, char rhs) { String s(lhs); s.concat(rhs); return s; }
+String operator+(const String &lhs, int rhs) { String s(lhs); s.concat(rhs); return s; }
+String operator+(const String &lhs, unsigned int rhs) { String s(lhs); s.concat(rhs); return s; }
+String operator+(const String &lhs, long rhs) { String s(lhs); s.concat(rhs); return s; }
+String operator+(const String &lhs, unsigned long rhs) { String s(lhs); s.concat(rhs); return s; }
+String operator+(const String &lhs, float rhs) { String s(lhs); s.concat(rhs); return s; }
+String operator+(const String &lhs, double rhs) { String s(lhs); s.concat(rhs); return s; }
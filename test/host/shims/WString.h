@@ -0,0 +1,130 @@
+#ifndef HOST_WSTRING_H
+#define HOST_WSTRING_H
+
+/**
+ * @file WString.h
+ * @brief Host stand-in for the Arduino-ESP32 String.
+ *
+ * Allocates the way the ESP32 core does, so allocation counts taken on the
+ * host mean the same as on the device: up to SSO_LENGTH characters live in
+ * the object, longer strings go to the heap in 16-byte steps and grow with
+ * realloc() only when the capacity is exceeded.
+ */
+
+#include <cstddef>
+#include <cstdint>
+
+class String {
+public:
+    /// @brief Longest string kept without a heap allocation (ESP32, 32-bit).
+    static constexpr unsigned SSO_LENGTH = 9;
+
+    String(const char *cstr = "");
+    String(const char *cstr, unsigned length);
+    String(const String &other);
+    String(String &&other) noexcept;
+    explicit String(char c);
+    explicit String(unsigned char value, unsigned char base = 10);
+    explicit String(int value, unsigned char base = 10);
+    explicit String(unsigned int value, unsigned char base = 10);
+    explicit String(long value, unsigned char base = 10);
+    explicit String(unsigned long value, unsigned char base = 10);
+    explicit String(long long value, unsigned char base = 10);
+    explicit String(unsigned long long value, unsigned char base = 10);
+    explicit String(float value, unsigned int decimalPlaces = 2);
+    explicit String(double value, unsigned int decimalPlaces = 2);
+    ~String();
+
+    String &operator=(const String &rhs);
+    String &operator=(String &&rhs) noexcept;
+    String &operator=(const char *cstr);
+
+    bool reserve(unsigned int size);
+    unsigned int length() const { return _length; }
+    bool isEmpty() const { return _length == 0; }
+    const char *c_str() const { return buffer(); }
+
+    bool concat(const String &str);
+    bool concat(const char *cstr);
+    bool concat(const char *cstr, unsigned int length);
+    bool concat(char c);
+    bool concat(unsigned char value);
+    bool concat(int value);
+    bool concat(unsigned int value);
+    bool concat(long value);
+    bool concat(unsigned long value);
+    bool concat(long long value);
+    bool concat(unsigned long long value);
+    bool concat(float value);
+    bool concat(double value);
+
+    template <typename T>
+    String &operator+=(const T &rhs) {
+        concat(rhs);
+        return *this;
+    }
+
+    int compareTo(const String &rhs) const;
+    bool equals(const String &rhs) const;
+    bool equals(const char *cstr) const;
+    bool equalsIgnoreCase(const String &rhs) const;
+    bool operator==(const String &rhs) const { return equals(rhs); }
+    bool operator==(const char *cstr) const { return equals(cstr); }
+    bool operator!=(const String &rhs) const { return !equals(rhs); }
+    bool operator!=(const char *cstr) const { return !equals(cstr); }
+    bool operator<(const String &rhs) const { return compareTo(rhs) < 0; }
+    bool operator>(const String &rhs) const { return compareTo(rhs) > 0; }
+    bool operator<=(const String &rhs) const { return compareTo(rhs) <= 0; }
+    bool operator>=(const String &rhs) const { return compareTo(rhs) >= 0; }
+    bool startsWith(const String &prefix) const;
+    bool endsWith(const String &suffix) const;
+
+    char charAt(unsigned int index) const;
+    void setCharAt(unsigned int index, char c);
+    char operator[](unsigned int index) const;
+    char &operator[](unsigned int index);
+    void toCharArray(char *buf, unsigned int bufsize, unsigned int index = 0) const;
+
+    int indexOf(char ch, unsigned int fromIndex = 0) const;
+    int indexOf(const String &str, unsigned int fromIndex = 0) const;
+    int lastIndexOf(char ch) const;
+    int lastIndexOf(const String &str) const;
+    String substring(unsigned int beginIndex) const { return substring(beginIndex, _length); }
+    String substring(unsigned int beginIndex, unsigned int endIndex) const;
+
+    void replace(char find, char replace);
+    void replace(const String &find, const String &replace);
+    void remove(unsigned int index);
+    void remove(unsigned int index, unsigned int count);
+    void toLowerCase();
+    void toUpperCase();
+    void trim();
+
+    long toInt() const;
+    float toFloat() const;
+    double toDouble() const;
+
+private:
+    char _sso[SSO_LENGTH + 1];
+    char *_heap = nullptr;
+    unsigned int _capacity = SSO_LENGTH;
+    unsigned int _length = 0;
+
+    const char *buffer() const { return _heap != nullptr ? _heap : _sso; }
+    char *wbuffer() { return _heap != nullptr ? _heap : _sso; }
+    void copy(const char *cstr, unsigned int length);
+    void move(String &rhs);
+};
+
+String operator+(const String &lhs, const String &rhs);
+String operator+(const String &lhs, const char *rhs);
+String operator+(const char *lhs, const String &rhs);
+String operator+(const String &lhs, char rhs);
+String operator+(const String &lhs, int rhs);
+String operator+(const String &lhs, unsigned int rhs);
+String operator+(const String &lhs, long rhs);
+String operator+(const String &lhs, unsigned long rhs);
+String operator+(const String &lhs, float rhs);
+String operator+(const String &lhs, double rhs);
+
+#endif // HOST_WSTRING_H
@@ -0,0 +1,4 @@
+#include "WebRemoteDebug.h"
+
+// Defined by src/main.cpp in the firmware.
+WebRemoteDebug Debug;
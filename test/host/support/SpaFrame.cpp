@@ -0,0 +1,83 @@
+#include "SpaFrame.h"
+
+#include <fstream>
+#include <gtest/gtest.h>
+
+SpaFrame SpaFrame::fromSnapshot(const char *path) {
+    SpaFrame frame;
+    std::ifstream in(path);
+    EXPECT_TRUE(in.good()) << "cannot open " << path;
+
+    bool strings = false;
+    std::string text;
+    while (std::getline(in, text)) {
+        if (!text.empty() && text.back() == '\r') text.pop_back();
+        if (text == "[Strings]") {
+            strings = true;
+            continue;
+        }
+        // Register lines look like "R2=,R2,84,...,241:" (the final one ends ":*").
+        const size_t equals = text.find("=,");
+        if (!strings || equals == std::string::npos) continue;
+
+        std::vector<std::string> fields;
+        size_t start = equals + 2;
+        for (;;) {
+            const size_t comma = text.find(',', start);
+            fields.push_back(text.substr(start, comma == std::string::npos ? std::string::npos : comma - start));
+            if (comma == std::string::npos) break;
+            start = comma + 1;
+        }
+        frame._lines.push_back(fields);
+    }
+    EXPECT_FALSE(frame._lines.empty()) << "no register lines in " << path;
+    return frame;
+}
+
+std::vector<std::string> *SpaFrame::line(const std::string &reg) {
+    for (auto &fields : _lines) {
+        if (fields[0] == reg) return &fields;
+    }
+    return nullptr;
+}
+
+const std::vector<std::string> *SpaFrame::line(const std::string &reg) const {
+    return const_cast<SpaFrame *>(this)->line(reg);
+}
+
+std::string SpaFrame::field(const std::string &reg, size_t index) const {
+    const std::vector<std::string> *fields = line(reg);
+    if (fields == nullptr || index >= fields->size()) {
+        ADD_FAILURE() << "no field " << reg << "+" << index;
+        return std::string();
+    }
+    return (*fields)[index];
+}
+
+void SpaFrame::setField(const std::string &reg, size_t index, const std::string &value) {
+    std::vector<std::string> *fields = line(reg);
+    if (fields == nullptr || index >= fields->size()) {
+        ADD_FAILURE() << "no field " << reg << "+" << index;
+        return;
+    }
+    (*fields)[index] = value;
+}
+
+void SpaFrame::removeRegister(const std::string &reg) {
+    for (auto it = _lines.begin(); it != _lines.end(); ++it) {
+        if ((*it)[0] == reg) {
+            _lines.erase(it);
+            return;
+        }
+    }
+    ADD_FAILURE() << "no register " << reg;
+}
+
+std::string SpaFrame::response() const {
+    std::string out = "RF:\r\n";
+    for (const auto &fields : _lines) {
+        for (const auto &field : fields) out += "," + field;
+        out += "\r\n";
+    }
+    return out;
+}
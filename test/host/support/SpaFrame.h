@@ -0,0 +1,35 @@
+#ifndef SPAFRAME_H
+#define SPAFRAME_H
+
+/**
+ * @file SpaFrame.h
+ * @brief RF responses for host tests, built from a SpaNET debug snapshot.
+ */
+
+#include <string>
+#include <vector>
+
+/// @brief The register lines of an RF response, editable before it is sent.
+class SpaFrame {
+public:
+    /// @brief Load the [Strings] register lines of a snapshot file; fails the test if missing.
+    static SpaFrame fromSnapshot(const char *path = SPA_SNAPSHOT);
+
+    /// @brief Field of a register, 1 being the first after the header (as R4+1 in updateMeasures()).
+    std::string field(const std::string &reg, size_t index) const;
+    void setField(const std::string &reg, size_t index, const std::string &value);
+
+    /// @brief Leave a register out of the response, as a truncated line would be dropped.
+    void removeRegister(const std::string &reg);
+
+    /// @brief The bytes the controller sends in answer to RF.
+    std::string response() const;
+
+private:
+    std::vector<std::vector<std::string>> _lines;   // fields of each line, header first
+
+    std::vector<std::string> *line(const std::string &reg);
+    const std::vector<std::string> *line(const std::string &reg) const;
+};
+
+#endif // SPAFRAME_H
@@ -0,0 +1,72 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <stdexcept>
+
+#include "SpaInterface.h"
+
+namespace {
+
+/// A SpaInterface on Serial2 that echoes keypad presses as the controller does.
+class KeypadMacroTest : public ::testing::Test {
+protected:
+    std::unique_ptr<SpaInterface> spa;
+
+    void SetUp() override {
+        Serial2.reset();
+        Serial2.setResponder([](HardwareSerial &port, const std::string &line) {
+            if (line == "W08") port.inject("W8\r\n");
+            else if (line == "W09") port.inject("W9\r\n");
+            else if (line == "W10" || line == "W11") port.inject(line + "\r\n");
+        });
+        spa.reset(new SpaInterface());
+        spa->begin();
+    }
+
+    void TearDown() override {
+        spa.reset();
+        Serial2.reset();
+    }
+
+    /// Message of the std::invalid_argument startKeypadMacro() throws, or "" if it does not.
+    std::string rejection(const char *macro) {
+        try {
+            spa->startKeypadMacro(macro);
+        } catch (const std::invalid_argument &ex) {
+            return ex.what();
+        }
+        return "";
+    }
+};
+
+TEST_F(KeypadMacroTest, ZeroRepeatHasItsOwnError) {
+    EXPECT_EQ(rejection("UP*0"), "Keypad key repeat 'up*0' must be 1 or more");
+    EXPECT_EQ(rejection("ok down*"), "Keypad key repeat 'down*' must be 1 or more");
+}
+
+TEST_F(KeypadMacroTest, TooManyKeysIsTooLong) {
+    EXPECT_EQ(rejection("up*20 down*20"), "Keypad macro too long");
+}
+
+TEST_F(KeypadMacroTest, TrailingPauseIsRejected) {
+    EXPECT_EQ(rejection("up,down,800"), "Keypad macro ends with a pause, which has no key to delay");
+    EXPECT_EQ(spa->getKeypadMacroProgress().state, SpaInterface::KeypadMacroProgress::State::Idle);
+}
+
+TEST_F(KeypadMacroTest, PauseBeforeAKeyRuns) {
+    ASSERT_TRUE(spa->startKeypadMacro("up*2 800 down"));
+
+    const SpaInterface::KeypadMacroProgress &progress = spa->getKeypadMacroProgress();
+    EXPECT_EQ(progress.steps, 3);
+    for (int pass = 0; pass < 100 && progress.state == SpaInterface::KeypadMacroProgress::State::Running; pass++) {
+        spa->loop();
+        host::advance(100);
+    }
+
+    EXPECT_EQ(progress.state, SpaInterface::KeypadMacroProgress::State::Done);
+    EXPECT_EQ(progress.confirmed, 3);
+    // Each key goes out after its wake-up newline.
+    EXPECT_EQ(Serial2.sent(), "\nW08\n\nW08\n\nW10\n");
+}
+
+} // namespace
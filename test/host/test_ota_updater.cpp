@@ -0,0 +1,182 @@
+#include <gtest/gtest.h>
+
+#include <openssl/sha.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "OtaUpdater.h"
+
+namespace {
+
+using Bytes = std::vector<uint8_t>;
+
+/// Records what reaches the flash, and which of end()/abort() finished the update.
+class MockSink : public OtaSink {
+public:
+    Bytes written;
+    int begins = 0;
+    int ends = 0;
+    int aborts = 0;
+
+    bool begin(size_t size, int command) override {
+        (void)size;
+        (void)command;
+        begins++;
+        written.clear();
+        return true;
+    }
+    size_t write(uint8_t *data, size_t len) override {
+        written.insert(written.end(), data, data + len);
+        return len;
+    }
+    bool end(bool evenIfRemaining) override {
+        (void)evenIfRemaining;
+        ends++;
+        return true;
+    }
+    void abort() override { aborts++; }
+    const char *errorString() override { return "mock sink error"; }
+};
+
+/// A firmware-like image: compressible, and longer than the 32 KB inflate dictionary.
+Bytes image() {
+    Bytes data(100000);
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < data.size(); i++) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = (i % 64 < 48) ? (uint8_t)(i / 64) : (uint8_t)(seed >> 24);
+    }
+    return data;
+}
+
+/// gzip member of data, as produced by `gzip -9`.
+Bytes gzip(const Bytes &data) {
+    z_stream zs{};
+    EXPECT_EQ(deflateInit2(&zs, 9, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY), Z_OK);
+    Bytes out(deflateBound(&zs, data.size()) + 32);
+    zs.next_in = const_cast<Bytef *>(data.data());
+    zs.avail_in = data.size();
+    zs.next_out = out.data();
+    zs.avail_out = out.size();
+    EXPECT_EQ(deflate(&zs, Z_FINISH), Z_STREAM_END);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return out;
+}
+
+std::string sha256Hex(const Bytes &data) {
+    uint8_t digest[SHA256_DIGEST_LENGTH];
+    SHA256(data.data(), data.size(), digest);
+    static const char hex[] = "0123456789abcdef";
+    std::string out;
+    for (uint8_t b : digest) {
+        out += hex[b >> 4];
+        out += hex[b & 0x0f];
+    }
+    return out;
+}
+
+uint64_t fakeNowUs = 0;
+uint64_t fakeClockUs() { return fakeNowUs += 1000; }
+
+class OtaUpdaterTest : public ::testing::Test {
+protected:
+    MockSink sink;
+    OtaUpdater ota{sink, fakeClockUs};
+    const Bytes plain = image();
+
+    /// Upload in chunks of chunkSize, as the web server hands them over; result of end().
+    bool upload(Bytes data, const char *expectedSha256 = nullptr, size_t chunkSize = 1436) {
+        EXPECT_TRUE(ota.begin(U_FLASH, expectedSha256)) << ota.error();
+        for (size_t at = 0; at < data.size(); at += chunkSize) {
+            const size_t len = std::min(chunkSize, data.size() - at);
+            if (!ota.write(data.data() + at, len)) break;
+        }
+        return ota.end();
+    }
+};
+
+TEST_F(OtaUpdaterTest, GzipUploadIsInflatedAndCommitted) {
+    const Bytes compressed = gzip(plain);
+    for (size_t chunkSize : {(size_t)1, (size_t)7, (size_t)1436, compressed.size()}) {
+        SCOPED_TRACE(chunkSize);
+        sink = MockSink();
+        ASSERT_TRUE(upload(compressed, sha256Hex(compressed).c_str(), chunkSize)) << ota.error();
+
+        EXPECT_EQ(sink.written, plain);
+        EXPECT_EQ(sink.ends, 1);
+        EXPECT_EQ(sink.aborts, 0);
+        EXPECT_TRUE(ota.stats().compressed);
+        EXPECT_EQ(ota.stats().receivedBytes, compressed.size());
+        EXPECT_EQ(ota.stats().writtenBytes, plain.size());
+        EXPECT_EQ(ota.sha256(), sha256Hex(compressed));
+    }
+}
+
+TEST_F(OtaUpdaterTest, CorruptCrcIsRejected) {
+    Bytes compressed = gzip(plain);
+    compressed[compressed.size() - 8] ^= 0xff;  // first byte of the trailer CRC-32
+
+    EXPECT_FALSE(upload(compressed));
+
+    EXPECT_STREQ(ota.error(), "gzip CRC-32 mismatch");
+    EXPECT_EQ(sink.ends, 0);
+    EXPECT_EQ(sink.aborts, 1);
+}
+
+TEST_F(OtaUpdaterTest, WrongIsizeIsRejected) {
+    Bytes compressed = gzip(plain);
+    compressed[compressed.size() - 4] ^= 0x01;  // low byte of ISIZE
+
+    EXPECT_FALSE(upload(compressed));
+
+    EXPECT_STREQ(ota.error(), "gzip length mismatch");
+    EXPECT_EQ(sink.ends, 0);
+    EXPECT_EQ(sink.aborts, 1);
+}
+
+TEST_F(OtaUpdaterTest, ShaMismatchIsNotCommitted) {
+    const Bytes compressed = gzip(plain);
+    const std::string wrong(64, '0');
+
+    EXPECT_FALSE(upload(compressed, wrong.c_str()));
+
+    const std::string expected = "SHA-256 mismatch, expected " + wrong + " got " + sha256Hex(compressed);
+    EXPECT_EQ(ota.error(), expected);
+    // The image inflated cleanly, but must not be made bootable.
+    EXPECT_EQ(sink.written, plain);
+    EXPECT_EQ(sink.ends, 0);
+    EXPECT_EQ(sink.aborts, 1);
+}
+
+TEST_F(OtaUpdaterTest, PlainUploadIsPassedThrough) {
+    const std::string sha = "  " + sha256Hex(plain) + "\r\n";  // as a form field may carry it
+    ASSERT_TRUE(upload(plain, sha.c_str())) << ota.error();
+
+    EXPECT_EQ(sink.written, plain);
+    EXPECT_EQ(sink.ends, 1);
+    EXPECT_EQ(sink.aborts, 0);
+    EXPECT_FALSE(ota.stats().compressed);
+    EXPECT_EQ(ota.stats().writtenBytes, plain.size());
+    EXPECT_EQ(ota.sha256(), sha256Hex(plain));
+    EXPECT_STREQ(ota.error(), "");
+}
+
+TEST_F(OtaUpdaterTest, MalformedExpectedShaFailsBegin) {
+    EXPECT_FALSE(ota.begin(U_FLASH, "abc"));
+    EXPECT_STREQ(ota.error(), "Expected SHA-256 must be 64 hex characters");
+}
+
+TEST_F(OtaUpdaterTest, TimingsComeFromTheInjectedClock) {
+    ASSERT_TRUE(upload(plain, nullptr, plain.size()));
+
+    // Each read of the fake clock is 1 ms on. begin() and end() read it once; the
+    // two sink writes (the detected magic bytes, then the rest) read it twice each.
+    EXPECT_EQ(ota.stats().flashWriteMs, 2u);
+    EXPECT_EQ(ota.stats().elapsedMs, 5u);
+}
+
+} // namespace
@@ -0,0 +1,116 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+
+#include "SpaFrame.h"
+#include "SpaInterface.h"
+
+namespace {
+
+constexpr uint16_t R2_STALE = 1 << 0;
+constexpr uint16_t R4_STALE = 1 << 2;
+
+/// A SpaInterface on Serial2, answering RF with frame and echoing W66 (Mode) writes.
+class ModeWriteTest : public ::testing::Test {
+protected:
+    SpaFrame frame = SpaFrame::fromSnapshot();
+    std::unique_ptr<SpaInterface> spa;
+
+    void SetUp() override {
+        Serial2.reset();
+        Serial2.setResponder([this](HardwareSerial &port, const std::string &line) {
+            if (line == "RF") {
+                port.inject(frame.response());
+            } else if (line.rfind("W66:", 0) == 0) {
+                port.inject(line.substr(4) + "\r\n");
+            }
+        });
+        spa.reset(new SpaInterface());
+        spa->begin();
+
+        ASSERT_EQ(frame.field("R4", 1), "NORM");
+        poll();
+        ASSERT_TRUE(spa->isInitialised());
+        ASSERT_EQ(spa->Mode.get(), 0);
+    }
+
+    void TearDown() override {
+        spa.reset();
+        Serial2.reset();
+    }
+
+    /// Run loop() until the next poll has been read, as the firmware's main loop would.
+    void poll() {
+        const uint32_t polls = spa->getLinkMetrics().polls;
+        host::advance(_pollIntervalMs);
+        for (int pass = 0; pass < 10 && spa->getLinkMetrics().polls == polls; pass++) {
+            spa->loop();
+            host::advance(_passMs);
+        }
+        ASSERT_GT(spa->getLinkMetrics().polls, polls);
+    }
+
+    uint32_t divergences() const { return spa->getLinkMetrics().writeDivergences; }
+
+private:
+    const uint32_t _pollIntervalMs = 61000;
+    const uint32_t _passMs = 600;
+};
+
+TEST_F(ModeWriteTest, PolledLabelMatchingTheWriteIsNoDivergence) {
+    spa->Mode.set(1);
+    EXPECT_EQ(spa->Mode.get(), 1);
+
+    frame.setField("R4", 1, "ECON");
+    poll();
+
+    EXPECT_EQ(divergences(), 0u);
+    EXPECT_EQ(spa->Mode.get(), 1);
+}
+
+TEST_F(ModeWriteTest, PolledLabelDifferingFromTheWriteIsCounted) {
+    spa->Mode.set(1);
+
+    // The controller took the echo but still reports NORM.
+    poll();
+
+    EXPECT_EQ(divergences(), 1u);
+    EXPECT_EQ(spa->Mode.get(), 0);
+
+    // Only the first poll after the write is compared.
+    poll();
+    EXPECT_EQ(divergences(), 1u);
+}
+
+TEST_F(ModeWriteTest, OtherStaleRegisterDoesNotHoldVerification) {
+    spa->Mode.set(1);
+
+    frame.removeRegister("R2");
+    poll();
+
+    ASSERT_EQ(spa->getStaleRegisters(), R2_STALE);
+    EXPECT_EQ(divergences(), 1u);
+    EXPECT_EQ(spa->Mode.get(), 0);
+}
+
+TEST_F(ModeWriteTest, StaleModeRegisterHoldsVerification) {
+    spa->Mode.set(1);
+
+    SpaFrame full = frame;
+    frame.removeRegister("R4");
+    poll();
+
+    // R4 was carried over from before the write, so it says nothing about it.
+    ASSERT_EQ(spa->getStaleRegisters(), R4_STALE);
+    EXPECT_EQ(divergences(), 0u);
+    EXPECT_EQ(spa->Mode.get(), 1);
+
+    frame = full;
+    poll();
+
+    ASSERT_EQ(spa->getStaleRegisters(), 0);
+    EXPECT_EQ(divergences(), 1u);
+    EXPECT_EQ(spa->Mode.get(), 0);
+}
+
+} // namespace